@@ -64,38 +64,22 @@ int transmission_callback(void *context,
   return(size);
 }
 
-void transmit(unsigned char *data,
-              unsigned int size,
-              unsigned long int frequency)
+void transmit(ofdm_transfer_t transfer,
+              unsigned char *data,
+              unsigned int size)
 {
   struct message_s message = {data, size, 0};
-  ofdm_transfer_t transfer = ofdm_transfer_create_callback(RADIO_DRIVER,
-                                                           1,
-                                                           transmission_callback,
-                                                           (void *) &message,
-                                                           SAMPLE_RATE,
-                                                           BIT_RATE,
-                                                           frequency,
-                                                           FREQUENCY_OFFSET,
-                                                           TRANSMISSION_GAIN,
-                                                           0,
-                                                           SUBCARRIER_MODULATION,
-                                                           SUBCARRIERS,
-                                                           CYCLIC_PREFIX_LENGTH,
-                                                           TAPER_LENGTH,
-                                                           INNER_FEC,
-                                                           OUTER_FEC,
-                                                           "",
-                                                           NULL,
-                                                           0,
-                                                           0);
-  if(transfer == NULL)
+
+  if(ofdm_transfer_set_direction(transfer,
+                                 1,
+                                 transmission_callback,
+                                 (void *) &message,
+                                 TRANSMISSION_GAIN) != 0)
   {
     return;
   }
   ofdm_transfer_start(transfer);
   sleep(1); /* Give time to the hackrf to send the last samples */
-  ofdm_transfer_free(transfer);
 }
 
 int reception_callback(void *context,
@@ -112,15 +96,33 @@ int reception_callback(void *context,
   return(payload_size);
 }
 
-void receive_1(unsigned char *data,
-               unsigned int *size,
-               unsigned long int frequency)
+void receive_1(ofdm_transfer_t transfer,
+               unsigned char *data,
+               unsigned int *size)
 {
   struct message_s message = {data, *size, 0};
+
+  if(ofdm_transfer_set_direction(transfer,
+                                 0,
+                                 reception_callback,
+                                 (void *) &message,
+                                 RECEPTION_GAIN) != 0)
+  {
+    *size = 0;
+    return;
+  }
+  ofdm_transfer_start(transfer);
+  *size = message.done;
+}
+
+/* Open the radio once, the same transfer is then used to send and receive
+ * all the messages */
+ofdm_transfer_t open_session(unsigned long int frequency)
+{
   ofdm_transfer_t transfer = ofdm_transfer_create_callback(RADIO_DRIVER,
                                                            0,
                                                            reception_callback,
-                                                           (void *) &message,
+                                                           NULL,
                                                            SAMPLE_RATE,
                                                            BIT_RATE,
                                                            frequency,
@@ -139,11 +141,11 @@ void receive_1(unsigned char *data,
                                                            0);
   if(transfer == NULL)
   {
-    return;
+    return(NULL);
   }
-  ofdm_transfer_start(transfer);
-  ofdm_transfer_free(transfer);
-  *size = message.done;
+  /* Keep the boundaries of the messages */
+  ofdm_transfer_set_datagram_mode(transfer, 1);
+  return(transfer);
 }
 
 void process_request(unsigned char *data, unsigned int size)
@@ -159,7 +161,7 @@ void process_request(unsigned char *data, unsigned int size)
   }
 }
 
-void server(unsigned long int frequency)
+void server(ofdm_transfer_t transfer)
 {
   unsigned char data[1024];
   unsigned int size;
@@ -167,7 +169,7 @@ void server(unsigned long int frequency)
   while(!stop_loop)
   {
     size = sizeof(data) - 1;
-    receive_1(data, &size, frequency);
+    receive_1(transfer, data, &size);
     if(stop_loop)
     {
       return;
@@ -181,18 +183,18 @@ void server(unsigned long int frequency)
     {
       return;
     }
-    transmit(data, size, frequency);
+    transmit(transfer, data, size);
   }
 }
 
-void client(unsigned char *data, unsigned int size, unsigned long int frequency)
+void client(ofdm_transfer_t transfer, unsigned char *data, unsigned int size)
 {
   unsigned char buffer[1024];
   unsigned int n = sizeof(buffer) - 1;
 
   printf("\nSending: %s\n", data);
-  transmit(data, size, frequency);
-  receive_1(buffer, &n, frequency);
+  transmit(transfer, data, size);
+  receive_1(transfer, buffer, &n);
   buffer[n] = '\0';
   printf("Received: %s\n", buffer);
 }
@@ -216,6 +218,7 @@ int main(int argc, char **argv)
   unsigned long int frequency;
   unsigned char *mode;
   unsigned char *data;
+  ofdm_transfer_t transfer;
 
   if((argc != 3) && (argc != 4))
   {
@@ -238,16 +241,27 @@ int main(int argc, char **argv)
       return(-1);
     }
     data = argv[3];
-    client(data, strlen(data), frequency);
+    transfer = open_session(frequency);
+    if(transfer == NULL)
+    {
+      return(-1);
+    }
+    client(transfer, data, strlen(data));
   }
   else if(strcmp(mode, "server") == 0)
   {
-    server(frequency);
+    transfer = open_session(frequency);
+    if(transfer == NULL)
+    {
+      return(-1);
+    }
+    server(transfer);
   }
   else
   {
     usage();
     return(-1);
   }
+  ofdm_transfer_free(transfer);
   return(0);
 }
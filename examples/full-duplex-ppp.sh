@@ -28,7 +28,7 @@ case "$1" in
              nodetach \
              passive \
              10.0.0.1:10.0.0.2 \
-             pty "./full-duplex 433800000 434200000"
+             pty "./full-duplex 433800000 434200000 $2"
         ;;
 
     client)
@@ -38,12 +38,12 @@ case "$1" in
              nodefaultroute \
              debug \
              nodetach \
-             pty "./full-duplex 434200000 433800000"
+             pty "./full-duplex 434200000 433800000 $2"
         ;;
 
     *)
         echo "" >& 2
-        echo "Usage: $0 <server | client>" >& 2
+        echo "Usage: $0 <server | client> [full-duplex radio]" >& 2
         echo "" >& 2
         exit 1
         ;;
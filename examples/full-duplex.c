@@ -18,7 +18,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <ofdm-transfer.h>
-#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define UPLINK_SAMPLE_RATE 4000000
 #define UPLINK_GAIN "36"
 #define UPLINK_FREQUENCY_OFFSET 100000
+#define FULL_DUPLEX_SAMPLE_RATE 4000000
+#define FULL_DUPLEX_FREQUENCY_OFFSET 1000000
 #define BIT_RATE 38400
 #define SUBCARRIER_MODULATION "bpsk"
 #define SUBCARRIERS 64
@@ -43,33 +44,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void usage()
 {
   fprintf(stderr, "Usage:\n");
-  fprintf(stderr, "  full-duplex <downlink frequency> <uplink frequency>\n");
+  fprintf(stderr, "  full-duplex <downlink frequency> <uplink frequency> [radio]\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "If 'radio' is specified (e.g. 'driver=lime'), this full-duplex radio is\n");
+  fprintf(stderr, "used for both the downlink and the uplink.\n");
 }
 
-void signal_handler(int signum)
-{
-  ofdm_transfer_stop_all();
-}
+ofdm_transfer_t downlink;
+ofdm_transfer_t uplink;
 
-void * transfer_thread(void *arg)
+void signal_handler(int signum)
 {
-  ofdm_transfer_t *transfer = (ofdm_transfer_t *) arg;
-
-  ofdm_transfer_start(*transfer);
-
-  return(NULL);
+  ofdm_transfer_stop(downlink);
+  ofdm_transfer_stop(uplink);
 }
 
 int main(int argc, char **argv)
 {
   unsigned long int downlink_frequency;
-  ofdm_transfer_t downlink;
-  pthread_t downlink_thread;
+  unsigned char downlink_running;
   unsigned long int uplink_frequency;
-  ofdm_transfer_t uplink;
-  pthread_t uplink_thread;
+  unsigned char uplink_running;
 
-  if(argc != 3)
+  if((argc != 3) && (argc != 4))
   {
     usage();
     return(EXIT_FAILURE);
@@ -78,14 +75,81 @@ int main(int argc, char **argv)
   downlink_frequency = strtoul(argv[1], NULL, 10);
   uplink_frequency = strtoul(argv[2], NULL, 10);
 
-  downlink = ofdm_transfer_create(DOWNLINK_RADIO,
-                                  0,
+  if(argc == 4)
+  {
+    /* One device receiving and sending at the same time */
+    downlink = ofdm_transfer_create(argv[3],
+                                    0,
+                                    NULL,
+                                    FULL_DUPLEX_SAMPLE_RATE,
+                                    BIT_RATE,
+                                    downlink_frequency,
+                                    FULL_DUPLEX_FREQUENCY_OFFSET,
+                                    DOWNLINK_GAIN,
+                                    0,
+                                    SUBCARRIER_MODULATION,
+                                    SUBCARRIERS,
+                                    CYCLIC_PREFIX_LENGTH,
+                                    TAPER_LENGTH,
+                                    INNER_FEC,
+                                    OUTER_FEC,
+                                    "",
+                                    NULL,
+                                    0,
+                                    0);
+    if(downlink == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize downlink.\n");
+      return(EXIT_FAILURE);
+    }
+
+    uplink = ofdm_transfer_create_reverse(downlink,
+                                          NULL,
+                                          NULL,
+                                          uplink_frequency,
+                                          UPLINK_GAIN);
+    if(uplink == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize uplink.\n");
+      ofdm_transfer_free(downlink);
+      return(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    downlink = ofdm_transfer_create(DOWNLINK_RADIO,
+                                    0,
+                                    NULL,
+                                    DOWNLINK_SAMPLE_RATE,
+                                    BIT_RATE,
+                                    downlink_frequency,
+                                    DOWNLINK_FREQUENCY_OFFSET,
+                                    DOWNLINK_GAIN,
+                                    0,
+                                    SUBCARRIER_MODULATION,
+                                    SUBCARRIERS,
+                                    CYCLIC_PREFIX_LENGTH,
+                                    TAPER_LENGTH,
+                                    INNER_FEC,
+                                    OUTER_FEC,
+                                    "",
+                                    NULL,
+                                    0,
+                                    0);
+    if(downlink == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize downlink.\n");
+      return(EXIT_FAILURE);
+    }
+
+    uplink = ofdm_transfer_create(UPLINK_RADIO,
+                                  1,
                                   NULL,
-                                  DOWNLINK_SAMPLE_RATE,
+                                  UPLINK_SAMPLE_RATE,
                                   BIT_RATE,
-                                  downlink_frequency,
-                                  DOWNLINK_FREQUENCY_OFFSET,
-                                  DOWNLINK_GAIN,
+                                  uplink_frequency,
+                                  UPLINK_FREQUENCY_OFFSET,
+                                  UPLINK_GAIN,
                                   0,
                                   SUBCARRIER_MODULATION,
                                   SUBCARRIERS,
@@ -97,53 +161,19 @@ int main(int argc, char **argv)
                                   NULL,
                                   0,
                                   0);
-  if(downlink == NULL)
-  {
-    fprintf(stderr, "Error: Failed to initialize downlink.\n");
-    return(EXIT_FAILURE);
-  }
-
-  uplink = ofdm_transfer_create(UPLINK_RADIO,
-                                1,
-                                NULL,
-                                UPLINK_SAMPLE_RATE,
-                                BIT_RATE,
-                                uplink_frequency,
-                                UPLINK_FREQUENCY_OFFSET,
-                                UPLINK_GAIN,
-                                0,
-                                SUBCARRIER_MODULATION,
-                                SUBCARRIERS,
-                                CYCLIC_PREFIX_LENGTH,
-                                TAPER_LENGTH,
-                                INNER_FEC,
-                                OUTER_FEC,
-                                "",
-                                NULL,
-                                0,
-                                0);
-  if(uplink == NULL)
-  {
-    fprintf(stderr, "Error: Failed to initialize uplink.\n");
-    return(EXIT_FAILURE);
-  }
-
-  if(pthread_create(&downlink_thread, NULL, transfer_thread, &downlink) != 0)
-  {
-    fprintf(stderr, "Error: Failed to start downlink thread.\n");
-    return(EXIT_FAILURE);
+    if(uplink == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize uplink.\n");
+      ofdm_transfer_free(downlink);
+      return(EXIT_FAILURE);
+    }
   }
 
-  /* Some function in the fftw library can cause errors when it is called from
-   * several threads at the same time. Waiting 1 second before starting the
-   * second thread seems to avoid the issue. */
-  sleep(1);
-
-  if(pthread_create(&uplink_thread, NULL, transfer_thread, &uplink) != 0)
+  if((ofdm_transfer_begin(downlink) != 0) ||
+     (ofdm_transfer_begin(uplink) != 0))
   {
-    fprintf(stderr, "Error: Failed to start uplink thread.\n");
-    ofdm_transfer_stop_all();
-    pthread_join(downlink_thread, NULL);
+    fprintf(stderr, "Error: Failed to start transfers.\n");
+    ofdm_transfer_free(uplink);
     ofdm_transfer_free(downlink);
     return(EXIT_FAILURE);
   }
@@ -153,8 +183,23 @@ int main(int argc, char **argv)
   signal(SIGABRT, &signal_handler);
   fprintf(stderr, "Use CTRL-C to quit.\n");
 
-  pthread_join(uplink_thread, NULL);
-  pthread_join(downlink_thread, NULL);
+  /* Both transfers are driven from the same thread, one block of samples
+   * at a time */
+  downlink_running = 1;
+  uplink_running = 1;
+  while(downlink_running || uplink_running)
+  {
+    if(downlink_running && (ofdm_transfer_process(downlink) <= 0))
+    {
+      ofdm_transfer_end(downlink);
+      downlink_running = 0;
+    }
+    if(uplink_running && (ofdm_transfer_process(uplink) <= 0))
+    {
+      ofdm_transfer_end(uplink);
+      uplink_running = 0;
+    }
+  }
   ofdm_transfer_free(uplink);
   ofdm_transfer_free(downlink);
   fprintf(stderr, "\n");
@@ -20,15 +20,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include "gettext.h"
 #include "ofdm-transfer.h"
 
 #define _(string) gettext(string)
+#define MAX_IDS 16
+
+int reverse_result = 0;
 
 void signal_handler(int signum)
 {
@@ -43,6 +48,28 @@ void signal_handler(int signum)
   ofdm_transfer_stop_all();
 }
 
+/* Run the transfer in the other direction of a full-duplex link, until it
+ * is finished or stopped by the main thread */
+void * run_reverse(void *arg)
+{
+  ofdm_transfer_t reverse = (ofdm_transfer_t) arg;
+  int r = 1;
+
+  while(r > 0)
+  {
+    r = ofdm_transfer_process(reverse);
+  }
+  ofdm_transfer_end(reverse);
+  if(r < 0)
+  {
+    /* The radio is broken, stop the other direction too */
+    reverse_result = -1;
+    ofdm_transfer_stop_all();
+  }
+
+  return(NULL);
+}
+
 void usage()
 {
   printf(_("ofdm-transfer version 1.8.0\n"));
@@ -50,36 +77,118 @@ void usage()
   printf(_("Usage: ofdm-transfer [options] [filename]\n"));
   printf("\n");
   printf(_("Options:\n"));
+  printf(_("  -A <window>  (default: 0)\n"));
+  printf(_("    Make the transfer reliable, sending the acknowledgements\n"
+           "    in the other direction (requires the '-F' option). At most\n"
+           "    'window' frames are sent before being acknowledged, and\n"
+           "    the lost frames are sent again. Both stations must use\n"
+           "    the same window, a power of 2 (at most 1024). A window\n"
+           "    of 0 disables the reliable mode.\n"));
   printf("  -a\n");
   printf(_("    Use audio samples instead of IQ samples.\n"));
   printf(_("  -b <bit rate>  (default: 38400 b/s)\n"));
   printf(_("    Bit rate of the OFDM transmission.\n"));
+  printf(_("  -C <delay>  (default: 0 ms)\n"));
+  printf(_("    Wait at most 'delay' ms for more data before sending a frame\n"
+           "    that is not full.\n"));
   printf(_("  -c <ppm>  (default: 0.0, can be negative)\n"));
   printf(_("    Correction for the radio clock.\n"));
+  printf("  -D\n");
+  printf(_("    When receiving, drop the frames that are received more than\n"
+           "    once.\n"));
   printf(_("  -d <filename>\n"));
   printf(_("    Dump a copy of the samples sent to or received from\n"
            "    the radio.\n"));
+  printf(_("  -E <data,parity>  (default: 0,0)\n"));
+  printf(_("    Send 'parity' parity frames after each block of 'data'\n"
+           "    frames, allowing the receiver to rebuild the lost frames of\n"
+           "    a block from any 'data' frames of the block\n"
+           "    (data + parity <= 255). Both stations must use the same\n"
+           "    values. A 'parity' of 0 disables the erasure code.\n"));
   printf(_("  -e <fec[,fec]>  (default: h128,none)\n"));
   printf(_("    Inner and outer forward error correction codes to use.\n"));
+  printf(_("  -F <frequency>\n"));
+  printf(_("    Also transfer data in the other direction on 'frequency'\n"
+           "    at the same time, using the same radio (full-duplex).\n"
+           "    The data of the other direction is read from standard input\n"
+           "    or written to standard output, or exchanged with the network\n"
+           "    interface of the '-N' option.\n"));
   printf(_("  -f <frequency>  (default: 434000000 Hz)\n"));
   printf(_("    Frequency of the OFDM transmission.\n"));
   printf(_("  -g <gain>  (default: 0)\n"));
   printf(_("    Gain of the radio transceiver, or audio gain in dB.\n"));
+  printf(_("  -H <dwell:frequency,frequency,...>\n"));
+  printf(_("    Hop between these frequencies, changing frequency every\n"
+           "    'dwell' frames. The frequencies starting with '+' or '-'\n"
+           "    are offsets from the frequency of the transmission.\n"));
   printf("  -h\n");
   printf(_("    This help.\n"));
+  printf(_("  -I <id:filename>\n"));
+  printf(_("    When receiving, also write the frames of 'id' to 'filename'\n"
+           "    (can be used up to 16 times). The id '*' selects all the\n"
+           "    other ids, each one having its own counters.\n"));
   printf(_("  -i <id>  (default: \"\")\n"));
   printf(_("    Transfer id (at most 4 bytes). When receiving, the frames\n"
            "    with a different id will be ignored.\n"));
+  printf(_("  -K <block>  (default: 0)\n"));
+  printf(_("    In carousel mode, start sending the file at this block\n"
+           "    (e.g. the first missing block reported by an interrupted\n"
+           "    receiver).\n"));
+  printf(_("  -k <filename>\n"));
+  printf(_("    In carousel mode, save the list of the blocks received in\n"
+           "    this checkpoint file. If the reception is interrupted and\n"
+           "    started again with the same checkpoint, the blocks already\n"
+           "    received are kept and only the missing ones are written.\n"));
+  printf(_("  -l <latency>  (default: 100 ms)\n"));
+  printf(_("    Maximum delay added by the buffering of data and samples.\n"
+           "    A latency of 0 selects the throughput mode.\n"));
   printf(_("  -m <modulation>  (default: qpsk)\n"));
   printf(_("    Modulation to use for the subcarriers.\n"));
+  printf(_("  -N <name[,mtu]>  (default MTU: 1500)\n"));
+  printf(_("    Instead of a file, send the IP packets of the TUN network\n"
+           "    interface 'name' or give it the received packets (Linux only,\n"
+           "    requires the CAP_NET_ADMIN capability). The interface is\n"
+           "    created if it doesn't exist, and must be configured with\n"
+           "    the usual tools (e.g. 'ip addr add' and 'ip link set up').\n"));
   printf(_("  -n <subcarriers[,cyclic prefix[,taper]]>  (default: 64,16,4)\n"));
   printf(_("    Number of subcarriers, cyclic prefix length and taper length\n"
            "    of the OFDM transmission.\n"));
+  printf(_("  -O <frames>  (default: 0)\n"));
+  printf(_("    When receiving, hold back at most 'frames' frames to deliver\n"
+           "    them in order when some frames arrive late (at most 1024).\n"
+           "    The missing frames are skipped after the latency.\n"
+           "    A size of 0 disables the reorder buffer.\n"));
   printf(_("  -o <offset>  (default: 0 Hz, can be negative)\n"));
   printf(_("    Set the central frequency of the transceiver 'offset' Hz\n"
            "    lower than the signal frequency to send or receive.\n"));
+  printf(_("  -p <[adaptive,]size[,maximum size]>  (default: 16,65535)\n"));
+  printf(_("    Size of the payload of the frames in bytes. If a single size is\n"
+           "    specified, all the frames use this size. If a minimum and\n"
+           "    maximum size are specified, the size is computed from the\n"
+           "    latency. If 'adaptive' is specified, the size changes with\n"
+           "    the quality of the link reported by the acknowledgements\n"
+           "    (requires the '-A' option).\n"));
+  printf(_("  -q <size[,policy]>  (default: 0,block)\n"));
+  printf(_("    When receiving, write the data from a separate thread using\n"
+           "    a queue of 'size' bytes, so that a slow output doesn't make\n"
+           "    the demodulator lose samples. When the queue is full, the\n"
+           "    policy is to wait ('block'), or to drop the oldest data\n"
+           "    ('drop-oldest') or the new data ('drop-newest').\n"
+           "    A size of 0 disables the queue.\n"));
+  printf(_("  -R <cycles>\n"));
+  printf(_("    Carousel mode. When sending, send the file 'cycles' times\n"
+           "    (0 means until interrupted), each frame containing a block\n"
+           "    of the file and its position. When receiving (with any\n"
+           "    value), write the blocks at their position in the file and\n"
+           "    stop as soon as the file is complete.\n"));
   printf(_("  -r <radio>  (default: \"\")\n"));
   printf(_("    Radio to use.\n"));
+  printf(_("  -S <dwell[,quiet]:frequency,frequency,...>  (default: 100,1000)\n"));
+  printf(_("    When receiving, scan these frequencies, staying 'dwell' ms\n"
+           "    on each one. When frames are received, stay on the frequency\n"
+           "    until there is no frame for 'quiet' ms. The frequencies\n"
+           "    starting with '+' or '-' are offsets from the frequency\n"
+           "    of the transmission.\n"));
   printf(_("  -s <sample rate>  (default: 2000000 S/s)\n"));
   printf(_("    Sample rate to use.\n"));
   printf(_("  -T <timeout>  (default: 0 s)\n"));
@@ -93,6 +202,14 @@ void usage()
   printf(_("    Wait a little before switching the radio off.\n"
            "    This can be useful if the hardware needs some time to send\n"
            "    the last samples it has buffered.\n"));
+  printf("  -X\n");
+  printf(_("    When receiving, decode the header of the frames first and\n"
+           "    skip the demodulation of the payload of the frames of the\n"
+           "    other ids.\n"));
+  printf(_("  -Z\n"));
+  printf(_("    When receiving to the standard output and it is a pipe,\n"
+           "    give the memory pages of the data to the pipe instead of\n"
+           "    copying them (Linux only).\n"));
   printf("\n");
   printf(_("By default the program is in 'receive' mode.\n"
            "Use the '-t' option to use the 'transmit' mode.\n"));
@@ -208,110 +325,412 @@ void get_ofdm_configuration(char *str,
   }
 }
 
+void get_payload_size_bounds(char *str,
+                             unsigned int *minimum,
+                             unsigned int *maximum,
+                             unsigned char *adaptive)
+{
+  char *separation;
+
+  if(strncasecmp(str, "adaptive", 8) == 0)
+  {
+    *adaptive = 1;
+    str += 8;
+    if(*str == ',')
+    {
+      str++;
+    }
+    else if(*str == '\0')
+    {
+      return;
+    }
+  }
+
+  *minimum = strtoul(str, NULL, 10);
+  if((separation = strchr(str, ',')) != NULL)
+  {
+    *maximum = strtoul(separation + 1, NULL, 10);
+  }
+  else
+  {
+    *maximum = *minimum;
+  }
+}
+
+void get_erasure_code(char *str,
+                      unsigned int *data_frames,
+                      unsigned int *parity_frames)
+{
+  char *separation;
+
+  *data_frames = strtoul(str, NULL, 10);
+  if((separation = strchr(str, ',')) != NULL)
+  {
+    *parity_frames = strtoul(separation + 1, NULL, 10);
+  }
+  else
+  {
+    *parity_frames = 0;
+  }
+}
+
+void get_tun_configuration(char *str, char *name, unsigned int *mtu)
+{
+  unsigned int size = strlen(str);
+  char spec[size + 1];
+  char *separation;
+
+  strcpy(spec, str);
+  if((separation = strchr(spec, ',')) != NULL)
+  {
+    *separation = '\0';
+    *mtu = strtoul(separation + 1, NULL, 10);
+  }
+
+  if(strlen(spec) < 32)
+  {
+    strcpy(name, spec);
+  }
+  else
+  {
+    strcpy(name, "invalid");
+  }
+}
+
+int get_delivery_queue(char *str, unsigned int *size, int *policy)
+{
+  char *separation;
+
+  *size = strtoul(str, NULL, 10);
+  if((separation = strchr(str, ',')) == NULL)
+  {
+    return(0);
+  }
+  separation++;
+
+  if(strcasecmp(separation, "block") == 0)
+  {
+    *policy = OFDM_TRANSFER_DELIVERY_BLOCK;
+  }
+  else if(strcasecmp(separation, "drop-oldest") == 0)
+  {
+    *policy = OFDM_TRANSFER_DELIVERY_DROP_OLDEST;
+  }
+  else if(strcasecmp(separation, "drop-newest") == 0)
+  {
+    *policy = OFDM_TRANSFER_DELIVERY_DROP_NEWEST;
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Invalid delivery policy '%s'\n"), separation);
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* Parse a schedule 'parameters:frequency,frequency,...'. The frequencies
+ * starting with '+' or '-' are offsets from 'frequency'. The parameters are
+ * parsed by the caller. */
+int get_frequency_schedule(char *str,
+                           unsigned long int frequency,
+                           unsigned long int **frequencies,
+                           unsigned int *count)
+{
+  char *spec;
+  unsigned int n;
+  unsigned int i;
+
+  spec = strchr(str, ':');
+  if(spec == NULL)
+  {
+    fprintf(stderr, _("Error: Invalid frequency schedule '%s'\n"), str);
+    return(-1);
+  }
+  spec++;
+
+  for(n = 1, i = 0; spec[i] != '\0'; i++)
+  {
+    if(spec[i] == ',')
+    {
+      n++;
+    }
+  }
+  *frequencies = malloc(n * sizeof(unsigned long int));
+  if(*frequencies == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+
+  for(i = 0; i < n; i++)
+  {
+    if((*spec == '+') || (*spec == '-'))
+    {
+      (*frequencies)[i] = frequency + strtol(spec, NULL, 10);
+    }
+    else
+    {
+      (*frequencies)[i] = strtoul(spec, NULL, 10);
+    }
+    spec = strchr(spec, ',');
+    if(spec != NULL)
+    {
+      spec++;
+    }
+  }
+  *count = n;
+
+  return(0);
+}
+
+/* Write the frames of another id to its file */
+int write_id_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  FILE *file = (FILE *) context;
+
+  fwrite(payload, 1, payload_size, file);
+  fflush(file);
+
+  return(payload_size);
+}
+
+/* Open the file of each 'id:filename' specification and add the id to the
+ * transfer */
+int add_ids(ofdm_transfer_t transfer,
+            char **specs,
+            unsigned int count,
+            FILE **files)
+{
+  char *separation;
+  unsigned int i;
+
+  for(i = 0; i < count; i++)
+  {
+    separation = strchr(specs[i], ':');
+    if(separation == NULL)
+    {
+      fprintf(stderr, _("Error: Invalid id specification: %s\n"), specs[i]);
+      break;
+    }
+    *separation = '\0';
+    files[i] = fopen(separation + 1, "wb");
+    if(files[i] == NULL)
+    {
+      fprintf(stderr, _("Error: Failed to open '%s'\n"), separation + 1);
+      break;
+    }
+    if(ofdm_transfer_add_id(transfer,
+                            specs[i],
+                            write_id_data,
+                            files[i]) != 0)
+    {
+      fclose(files[i]);
+      break;
+    }
+  }
+  if(i < count)
+  {
+    while(i > 0)
+    {
+      i--;
+      fclose(files[i]);
+    }
+    return(-1);
+  }
+
+  return(0);
+}
+
 int main(int argc, char **argv)
 {
   ofdm_transfer_t transfer;
-  char *radio_driver = "";
-  unsigned int emit = 0;
-  unsigned long int sample_rate = 2000000;
-  unsigned int bit_rate = 38400;
-  unsigned long int frequency = 434000000;
-  long int frequency_offset = 0;
-  char *gain = "0";
-  float ppm = 0;
-  char *subcarrier_modulation = "qpsk";
-  unsigned int subcarriers = 64;
-  unsigned int cyclic_prefix_length = 16;
-  unsigned int taper_length = 4;
+  ofdm_transfer_t reverse = NULL;
+  pthread_t reverse_thread;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  struct ofdm_transfer_id_stats_s id_stats;
+  char *id_specs[MAX_IDS];
+  FILE *id_files[MAX_IDS];
+  unsigned int id_count = 0;
+  unsigned int i;
   char inner_fec[32];
   char outer_fec[32];
-  char *id = "";
-  char *file = NULL;
-  char *dump = NULL;
+  char tun_name[32];
+  unsigned int tun_mtu = 1500;
+  unsigned long int reverse_frequency = 0;
+  unsigned int arq_window = 0;
+  char *hop_schedule = NULL;
+  char *scan_schedule = NULL;
+  char *end;
   float final_delay = 0;
   unsigned int final_delay_sec = 0;
   unsigned int final_delay_usec = 0;
-  unsigned int timeout = 0;
-  unsigned char audio = 0;
   int opt;
+  int r;
 
-  strcpy(inner_fec, "h128");
-  strcpy(outer_fec, "none");
+  ofdm_transfer_config_init_default(&config);
+  strcpy(inner_fec, config.inner_fec);
+  strcpy(outer_fec, config.outer_fec);
+  config.inner_fec = inner_fec;
+  config.outer_fec = outer_fec;
 
   setlocale(LC_ALL, "");
   setlocale(LC_NUMERIC, "C");
   bindtextdomain(PACKAGE, LOCALEDIR);
   textdomain(PACKAGE);
 
-  while((opt = getopt(argc, argv, "ab:c:d:e:f:g:hi:m:n:o:r:s:T:tvw:")) != -1)
+  while((opt = getopt(argc, argv, "A:ab:C:c:Dd:E:e:F:f:g:H:hI:i:K:k:l:m:N:n:O:o:p:q:R:r:S:s:T:tvw:XZ")) != -1)
   {
     switch(opt)
     {
+    case 'A':
+      arq_window = strtoul(optarg, NULL, 10);
+      break;
+
     case 'a':
-      audio = 1;
+      config.audio = 1;
       break;
 
     case 'b':
-      bit_rate = strtoul(optarg, NULL, 10);
+      config.bit_rate = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'C':
+      config.coalescing_delay = strtoul(optarg, NULL, 10);
       break;
 
     case 'c':
-      ppm = strtof(optarg, NULL);
+      config.ppm = strtof(optarg, NULL);
+      break;
+
+    case 'D':
+      config.drop_duplicates = 1;
       break;
 
     case 'd':
-      dump = optarg;
+      config.dump = optarg;
+      break;
+
+    case 'E':
+      get_erasure_code(optarg,
+                       &config.erasure_data_frames,
+                       &config.erasure_parity_frames);
       break;
 
     case 'e':
       get_fec_schemes(optarg, inner_fec, outer_fec);
       break;
 
+    case 'F':
+      reverse_frequency = strtoul(optarg, NULL, 10);
+      break;
+
     case 'f':
-      frequency = strtoul(optarg, NULL, 10);
+      config.frequency = strtoul(optarg, NULL, 10);
       break;
 
     case 'g':
-      gain = optarg;
+      config.gain = optarg;
+      break;
+
+    case 'H':
+      hop_schedule = optarg;
       break;
 
     case 'h':
       usage();
       return(EXIT_SUCCESS);
 
+    case 'I':
+      if(id_count == MAX_IDS)
+      {
+        fprintf(stderr, _("Error: At most %u '-I' options\n"), MAX_IDS);
+        return(EXIT_FAILURE);
+      }
+      id_specs[id_count] = optarg;
+      id_count++;
+      break;
+
     case 'i':
-      id = optarg;
+      config.id = optarg;
+      break;
+
+    case 'K':
+      config.carousel_start = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'k':
+      config.checkpoint = optarg;
+      break;
+
+    case 'l':
+      config.latency = strtoul(optarg, NULL, 10);
       break;
 
     case 'm':
-      subcarrier_modulation = optarg;
+      config.subcarrier_modulation = optarg;
+      break;
+
+    case 'N':
+      get_tun_configuration(optarg, tun_name, &tun_mtu);
+      config.tun = tun_name;
       break;
 
     case 'n':
       get_ofdm_configuration(optarg,
-                             &subcarriers,
-                             &cyclic_prefix_length,
-                             &taper_length);
+                             &config.subcarriers,
+                             &config.cyclic_prefix_length,
+                             &config.taper_length);
+      break;
+
+    case 'O':
+      config.reorder_frames = strtoul(optarg, NULL, 10);
       break;
 
     case 'o':
-      frequency_offset = strtol(optarg, NULL, 10);
+      config.frequency_offset = strtol(optarg, NULL, 10);
+      break;
+
+    case 'p':
+      get_payload_size_bounds(optarg,
+                              &config.minimum_payload_size,
+                              &config.maximum_payload_size,
+                              &config.adaptive_payload_size);
+      break;
+
+    case 'q':
+      if(get_delivery_queue(optarg,
+                            &config.delivery_queue_size,
+                            &config.delivery_policy) != 0)
+      {
+        return(EXIT_FAILURE);
+      }
+      break;
+
+    case 'R':
+      config.carousel = 1;
+      config.carousel_cycles = strtoul(optarg, NULL, 10);
       break;
 
     case 'r':
-      radio_driver = optarg;
+      config.radio_driver = optarg;
+      break;
+
+    case 'S':
+      scan_schedule = optarg;
       break;
 
     case 's':
-      sample_rate = strtoul(optarg, NULL, 10);
+      config.sample_rate = strtoul(optarg, NULL, 10);
       break;
 
     case 't':
-      emit = 1;
+      config.emit = 1;
       break;
 
     case 'T':
-      timeout = strtoul(optarg, NULL, 10);
+      config.timeout = strtoul(optarg, NULL, 10);
       break;
 
     case 'v':
@@ -322,49 +741,174 @@ int main(int argc, char **argv)
       final_delay = strtof(optarg, NULL);
       break;
 
+    case 'X':
+      config.skip_other_ids = 1;
+      break;
+
+    case 'Z':
+      config.output_splice = 1;
+      break;
+
     default:
       fprintf(stderr, _("Error: Unknown parameter: '-%c %s'\n"), opt, optarg);
       return(EXIT_FAILURE);
     }
   }
+  config.tun_mtu = tun_mtu;
   if(optind < argc)
   {
-    file = argv[optind];
+    config.file = argv[optind];
   }
   else
   {
-    file = NULL;
+    config.file = NULL;
   }
 
   signal(SIGINT, &signal_handler);
   signal(SIGTERM, &signal_handler);
   signal(SIGABRT, &signal_handler);
 
-  transfer = ofdm_transfer_create(radio_driver,
-                                  emit,
-                                  file,
-                                  sample_rate,
-                                  bit_rate,
-                                  frequency,
-                                  frequency_offset,
-                                  gain,
-                                  ppm,
-                                  subcarrier_modulation,
-                                  subcarriers,
-                                  cyclic_prefix_length,
-                                  taper_length,
-                                  inner_fec,
-                                  outer_fec,
-                                  id,
-                                  dump,
-                                  timeout,
-                                  audio);
+  if(hop_schedule)
+  {
+    if(get_frequency_schedule(hop_schedule,
+                              config.frequency,
+                              &config.hop_frequencies,
+                              &config.hop_count) != 0)
+    {
+      return(EXIT_FAILURE);
+    }
+    config.hop_dwell = strtoul(hop_schedule, NULL, 10);
+  }
+  if(scan_schedule)
+  {
+    if(get_frequency_schedule(scan_schedule,
+                              config.frequency,
+                              &config.scan_frequencies,
+                              &config.scan_count) != 0)
+    {
+      free(config.hop_frequencies);
+      return(EXIT_FAILURE);
+    }
+    config.scan_dwell = strtoul(scan_schedule, &end, 10);
+    if(*end == ',')
+    {
+      config.scan_quiet = strtoul(end + 1, NULL, 10);
+    }
+  }
+
+  if(((config.carousel_start > 0) || config.checkpoint) && (!config.carousel))
+  {
+    fprintf(stderr,
+            _("Error: The '-K' and '-k' options require the '-R' option\n"));
+    free(config.hop_frequencies);
+    free(config.scan_frequencies);
+    return(EXIT_FAILURE);
+  }
+  if((id_count > 0) && config.emit)
+  {
+    fprintf(stderr,
+            _("Error: The '-I' option can only be used when receiving\n"));
+    free(config.hop_frequencies);
+    free(config.scan_frequencies);
+    return(EXIT_FAILURE);
+  }
+  if(config.adaptive_payload_size && (arq_window == 0))
+  {
+    fprintf(stderr,
+            _("Error: The adaptive payload size requires the '-A' option\n"));
+    free(config.hop_frequencies);
+    free(config.scan_frequencies);
+    return(EXIT_FAILURE);
+  }
+  if((arq_window > 0) && (reverse_frequency == 0))
+  {
+    fprintf(stderr, _("Error: The reliable mode requires the '-F' option\n"));
+    free(config.hop_frequencies);
+    free(config.scan_frequencies);
+    return(EXIT_FAILURE);
+  }
+
+  transfer = ofdm_transfer_create_with_config(&config);
+  free(config.hop_frequencies);
+  free(config.scan_frequencies);
   if(transfer == NULL)
   {
     fprintf(stderr, _("Error: Failed to initialize transfer\n"));
     return(EXIT_FAILURE);
   }
-  ofdm_transfer_start(transfer);
+  if(add_ids(transfer, id_specs, id_count, id_files) != 0)
+  {
+    ofdm_transfer_free(transfer);
+    return(EXIT_FAILURE);
+  }
+  if(reverse_frequency != 0)
+  {
+    reverse = ofdm_transfer_create_reverse(transfer,
+                                           NULL,
+                                           NULL,
+                                           reverse_frequency,
+                                           config.gain);
+    if(reverse == NULL)
+    {
+      fprintf(stderr, _("Error: Failed to initialize transfer\n"));
+      ofdm_transfer_free(transfer);
+      return(EXIT_FAILURE);
+    }
+    if(((arq_window > 0) &&
+        (ofdm_transfer_set_arq(transfer, reverse, arq_window) != 0)) ||
+       ((arq_window == 0) &&
+        ((ofdm_transfer_set_erasure_code(reverse,
+                                         config.erasure_data_frames,
+                                         config.erasure_parity_frames) != 0) ||
+         (ofdm_transfer_set_reorder_buffer(reverse,
+                                           config.reorder_frames) != 0))))
+    {
+      ofdm_transfer_free(reverse);
+      ofdm_transfer_free(transfer);
+      return(EXIT_FAILURE);
+    }
+    ofdm_transfer_set_drop_duplicates(reverse, config.drop_duplicates);
+    /* Begin here so that ofdm_transfer_stop() can't be missed by the thread */
+    if(ofdm_transfer_begin(reverse) != 0)
+    {
+      fprintf(stderr, _("Error: Failed to start the reverse transfer\n"));
+      ofdm_transfer_free(reverse);
+      ofdm_transfer_free(transfer);
+      return(EXIT_FAILURE);
+    }
+    if(pthread_create(&reverse_thread, NULL, run_reverse, reverse) != 0)
+    {
+      fprintf(stderr, _("Error: Failed to start the reverse transfer\n"));
+      ofdm_transfer_end(reverse);
+      ofdm_transfer_free(reverse);
+      ofdm_transfer_free(transfer);
+      return(EXIT_FAILURE);
+    }
+  }
+  r = ofdm_transfer_start(transfer);
+  if(reverse)
+  {
+    ofdm_transfer_stop(reverse);
+    pthread_join(reverse_thread, NULL);
+    if(reverse_result != 0)
+    {
+      r = reverse_result;
+    }
+  }
+  if(config.carousel && (!config.emit))
+  {
+    ofdm_transfer_get_stats(transfer, &stats);
+    if((stats.blocks_total == 0) || (stats.blocks_received < stats.blocks_total))
+    {
+      fprintf(stderr,
+              _("Error: Incomplete file, %u of %u blocks received, "
+                "first missing block %u\n"),
+              stats.blocks_received,
+              stats.blocks_total,
+              stats.first_missing_block);
+      r = -1;
+    }
+  }
   if(final_delay > 0)
   {
     /* Give enough time to the hardware to send the last samples */
@@ -379,12 +923,85 @@ int main(int argc, char **argv)
       usleep(final_delay_usec);
     }
   }
+  if(ofdm_transfer_is_verbose())
+  {
+    ofdm_transfer_get_stats(transfer, &stats);
+    fprintf(stderr,
+            _("\nRadio: %lu overflows, %lu underflows, %lu timeouts, "
+              "%lu time errors, %lu other errors, %lu samples lost\n"),
+            stats.radio_overflows,
+            stats.radio_underflows,
+            stats.radio_timeouts,
+            stats.radio_time_errors,
+            stats.radio_errors,
+            stats.samples_lost);
+    if(stats.radio_recoveries > 0)
+    {
+      fprintf(stderr,
+              _("Radio: %lu recoveries, the last one took %u ms\n"),
+              stats.radio_recoveries,
+              stats.radio_recovery_time);
+    }
+    if(arq_window > 0)
+    {
+      fprintf(stderr,
+              _("Reliable mode: %lu frames sent again, %lu duplicate frames, "
+                "round trip time %u ms\n"),
+              stats.frames_retransmitted,
+              stats.frames_duplicated,
+              stats.round_trip_time);
+    }
+    if(config.erasure_parity_frames > 0)
+    {
+      fprintf(stderr,
+              _("Erasure code: %lu frames rebuilt\n"),
+              stats.frames_recovered);
+    }
+    if((!config.emit) && (arq_window == 0))
+    {
+      fprintf(stderr,
+              _("Frames: %lu lost (%.1f%%), %lu duplicates, "
+                "%lu out of order\n"),
+              stats.frames_lost,
+              stats.loss_rate * 100,
+              stats.frames_duplicated,
+              stats.frames_reordered);
+    }
+    if(!config.emit)
+    {
+      fprintf(stderr,
+              _("Other ids: %lu frames (%lu bytes) ignored, %lu OFDM symbols "
+                "not demodulated\n"),
+              stats.frames_ignored,
+              stats.bytes_ignored,
+              stats.symbols_skipped);
+    }
+    for(i = 0; ofdm_transfer_get_id_stats(transfer, i, &id_stats) == 0; i++)
+    {
+      fprintf(stderr,
+              _("Id '%s': %lu frames, %lu bytes, %lu lost (%.1f%%), "
+                "%lu duplicates, %lu out of order, %lu corrupted\n"),
+              id_stats.id,
+              id_stats.frames_received,
+              id_stats.bytes_received,
+              id_stats.frames_lost,
+              id_stats.loss_rate * 100,
+              id_stats.frames_duplicated,
+              id_stats.frames_reordered,
+              id_stats.payloads_corrupted);
+    }
+  }
+  ofdm_transfer_free(reverse);
   ofdm_transfer_free(transfer);
+  for(i = 0; i < id_count; i++)
+  {
+    fclose(id_files[i]);
+  }
 
   if(ofdm_transfer_is_verbose())
   {
     fprintf(stderr, "\n");
   }
 
-  return(EXIT_SUCCESS);
+  return((r == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -0,0 +1,933 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include <liquid/liquid.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "gettext.h"
+#include "ofdm-modem.h"
+
+#define TAU (2 * M_PI)
+
+#define MIN(x, y) ((x < y) ? x : y)
+#define MAX(x, y) ((x > y) ? x : y)
+
+#define _(string) gettext(string)
+
+#ifndef HAVE_MODEMCF_CREATE
+/* Older versions of liquid-dsp name the modems without the type suffix */
+#define modemcf modem
+#define modemcf_create modem_create
+#define modemcf_destroy modem_destroy
+#define modemcf_get_bps modem_get_bps
+#define modemcf_demodulate modem_demodulate
+#endif
+
+/* liquid-dsp puts the protocol version, the payload length (2 bytes), the
+ * modulation and the FEC schemes after the header of the frames */
+#define MODEM_FRAME_INFO_SIZE 6
+
+/* OFDM symbols of the S0a, S0b and S1 preamble of a frame */
+#define MODEM_PREAMBLE_SYMBOLS 3
+
+/* OFDM symbols kept before the preamble of a frame when it is passed to the
+ * frame synchronizer after its header */
+#define MODEM_REPLAY_MARGIN 2
+
+struct ofdm_modem_s
+{
+  unsigned char emit;
+  unsigned long int sample_rate;
+  unsigned int bit_rate;
+  modulation_scheme subcarrier_modulation;
+  unsigned int subcarriers;
+  unsigned int cyclic_prefix_length;
+  unsigned int taper_length;
+  crc_scheme crc;
+  fec_scheme inner_fec;
+  fec_scheme outer_fec;
+  unsigned int latency;
+  ofdmflexframegen frame_generator;
+  ofdmflexframesync frame_synchronizer;
+  msresamp_crcf resampler;
+  nco_crcf oscillator;
+  long int frequency_offset;
+  unsigned int delay;
+  unsigned char header[OFDM_MODEM_HEADER_SIZE];
+  unsigned char frame_in_progress;
+  complex float *frame_samples;
+  unsigned int frame_samples_size;
+  complex float *samples;
+  unsigned int samples_size;
+  void (*frame_callback)(void *, struct ofdm_modem_frame_s *);
+  int (*header_callback)(void *, struct ofdm_modem_frame_s *);
+  void *callback_context;
+  unsigned int data_subcarriers;
+  ofdmframesync frame_detector;
+  modemcf header_demodulator;
+  packetizer header_decoder;
+  unsigned char *header_symbols;
+  unsigned int header_symbols_size;
+  unsigned int header_symbols_received;
+  unsigned char *header_encoded;
+  unsigned int header_encoded_size;
+  unsigned char header_decoded[OFDM_MODEM_HEADER_SIZE + MODEM_FRAME_INFO_SIZE];
+  unsigned char frame_kept;
+  unsigned char frame_decoding;
+  unsigned char frame_done;
+  unsigned int frame_decoding_samples;
+  complex float *history;
+  unsigned int history_size;
+  unsigned int history_index;
+  unsigned int history_length;
+};
+
+/* The creation of the FFT plans by the frame generators and synchronizers is
+ * not thread safe, so the modems used in several threads must be created one
+ * at a time */
+pthread_mutex_t modem_creation_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned int ofdm_modem_bits_per_symbol(modulation_scheme modulation)
+{
+  unsigned int n;
+
+  switch(modulation)
+  {
+  case LIQUID_MODEM_BPSK:
+    n = 1;
+    break;
+
+  case LIQUID_MODEM_QPSK:
+    n = 2;
+    break;
+
+  case LIQUID_MODEM_PSK8:
+    n = 3;
+    break;
+
+  case LIQUID_MODEM_APSK16:
+    n = 4;
+    break;
+
+  case LIQUID_MODEM_APSK32:
+    n = 5;
+    break;
+
+  case LIQUID_MODEM_APSK64:
+    n = 6;
+    break;
+
+  case LIQUID_MODEM_APSK128:
+    n = 7;
+    break;
+
+  case LIQUID_MODEM_APSK256:
+    n = 8;
+    break;
+
+  default:
+    n = 1;
+    break;
+  }
+  return(n);
+}
+
+void modem_set_counter(unsigned char *header, unsigned int counter)
+{
+  header[4] = (counter >> 24) & 255;
+  header[5] = (counter >> 16) & 255;
+  header[6] = (counter >> 8) & 255;
+  header[7] = counter & 255;
+}
+
+unsigned int modem_get_counter(unsigned char *header)
+{
+  return((header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]);
+}
+
+/* Number of OFDM symbols carrying a payload of 'payload_size' bytes */
+unsigned int modem_get_payload_symbols(ofdm_modem_t modem,
+                                       unsigned int payload_size)
+{
+  unsigned int bits_per_symbol;
+  unsigned int symbols;
+
+  bits_per_symbol = ofdm_modem_bits_per_symbol(modem->subcarrier_modulation);
+  symbols = ((packetizer_compute_enc_msg_len(payload_size,
+                                             modem->crc,
+                                             modem->inner_fec,
+                                             modem->outer_fec) * 8) +
+             bits_per_symbol - 1) / bits_per_symbol;
+
+  return((symbols + modem->data_subcarriers - 1) / modem->data_subcarriers);
+}
+
+/* Duration in seconds of the blocks of samples processed at once */
+float modem_get_block_duration(unsigned int latency)
+{
+  if(latency == 0)
+  {
+    /* Throughput mode */
+    return(1.0);
+  }
+  return(latency / 2000.0);
+}
+
+int modem_frame_found(unsigned char *header,
+                      int header_valid,
+                      unsigned char *payload,
+                      unsigned int payload_size,
+                      int payload_valid,
+                      framesyncstats_s stats,
+                      void *user_data)
+{
+  ofdm_modem_t modem = (ofdm_modem_t) user_data;
+  struct ofdm_modem_frame_s frame;
+
+  memcpy(frame.id, header, 4);
+  frame.id[4] = '\0';
+  frame.counter = modem_get_counter(header);
+  frame.header_valid = header_valid;
+  frame.payload_valid = payload_valid;
+  frame.payload = payload;
+  frame.payload_size = payload_size;
+  frame.payload_symbols = modem_get_payload_symbols(modem, payload_size);
+  modem->frame_done = 1;
+  if(modem->frame_callback)
+  {
+    modem->frame_callback(modem->callback_context, &frame);
+  }
+
+  return(0);
+}
+
+/* Decode the header of a frame found by the frame detector and ask the
+ * header callback whether the payload must be decoded */
+void modem_header_found(ofdm_modem_t modem)
+{
+  framesyncstats_s stats;
+  struct ofdm_modem_frame_s frame;
+  unsigned char *info = modem->header_decoded + OFDM_MODEM_HEADER_SIZE;
+  unsigned int n;
+
+  liquid_repack_bytes(modem->header_symbols,
+                      modemcf_get_bps(modem->header_demodulator),
+                      modem->header_symbols_size,
+                      modem->header_encoded,
+                      8,
+                      modem->header_encoded_size,
+                      &n);
+  unscramble_data(modem->header_encoded, modem->header_encoded_size);
+  if(!packetizer_decode(modem->header_decoder,
+                        modem->header_encoded,
+                        modem->header_decoded))
+  {
+    /* Report the corrupted header like the frame synchronizer does, there is
+     * nothing more to decode in this frame */
+    bzero(&stats, sizeof(framesyncstats_s));
+    modem_frame_found(modem->header_decoded, 0, NULL, 0, 0, stats, modem);
+    modem->history_length = 0;
+    return;
+  }
+
+  memcpy(frame.id, modem->header_decoded, 4);
+  frame.id[4] = '\0';
+  frame.counter = modem_get_counter(modem->header_decoded);
+  frame.header_valid = 1;
+  frame.payload_valid = 0;
+  frame.payload = NULL;
+  frame.payload_size = (info[1] << 8) | info[2];
+  frame.payload_symbols = modem_get_payload_symbols(modem,
+                                                    frame.payload_size);
+  modem->frame_kept = modem->header_callback(modem->callback_context, &frame);
+  if(!modem->frame_kept)
+  {
+    /* The samples of the frame are not needed anymore */
+    modem->history_length = 0;
+  }
+}
+
+/* Demodulate the header symbols received by the frame detector
+ * Return 1 when the header is complete to stop following the frame, 0
+ * otherwise. */
+int modem_symbol_received(complex float *symbols,
+                          unsigned char *subcarrier_types,
+                          unsigned int subcarriers,
+                          void *user_data)
+{
+  ofdm_modem_t modem = (ofdm_modem_t) user_data;
+  unsigned int symbol;
+  unsigned int i;
+
+  for(i = 0;
+      (i < subcarriers) &&
+        (modem->header_symbols_received < modem->header_symbols_size);
+      i++)
+  {
+    if(subcarrier_types[i] == OFDMFRAME_SCTYPE_DATA)
+    {
+      modemcf_demodulate(modem->header_demodulator, symbols[i], &symbol);
+      modem->header_symbols[modem->header_symbols_received] = symbol;
+      modem->header_symbols_received++;
+    }
+  }
+  if(modem->header_symbols_received < modem->header_symbols_size)
+  {
+    return(0);
+  }
+  modem->header_symbols_received = 0;
+  modem_header_found(modem);
+
+  return(1);
+}
+
+void ofdm_modem_config_init_default(struct ofdm_modem_config_s *config)
+{
+  bzero(config, sizeof(struct ofdm_modem_config_s));
+  config->emit = 0;
+  config->sample_rate = 2000000;
+  config->bit_rate = 38400;
+  config->frequency_offset = 0;
+  config->subcarrier_modulation = LIQUID_MODEM_QPSK;
+  config->subcarriers = 64;
+  config->cyclic_prefix_length = 16;
+  config->taper_length = 4;
+  config->inner_fec = LIQUID_FEC_HAMMING128;
+  config->outer_fec = LIQUID_FEC_NONE;
+  config->id = "";
+  config->latency = 100;
+  config->frame_callback = NULL;
+  config->header_callback = NULL;
+  config->callback_context = NULL;
+}
+
+ofdm_modem_t ofdm_modem_create(struct ofdm_modem_config_s *config)
+{
+  ofdm_modem_t modem;
+  unsigned int subcarrier_symbol_bits;
+  float samples_per_bit;
+  float resampling_ratio;
+  ofdmflexframegenprops_s frame_properties;
+  unsigned char *subcarrier_types;
+  unsigned int null_subcarriers;
+  unsigned int pilot_subcarriers;
+  unsigned int header_ofdm_symbols;
+
+  if(config->sample_rate == 0)
+  {
+    fprintf(stderr, _("Error: Invalid sample rate\n"));
+    return(NULL);
+  }
+  if(config->bit_rate == 0)
+  {
+    fprintf(stderr, _("Error: Invalid bit rate\n"));
+    return(NULL);
+  }
+  switch(config->subcarrier_modulation)
+  {
+  case LIQUID_MODEM_BPSK:
+  case LIQUID_MODEM_QPSK:
+  case LIQUID_MODEM_PSK8:
+  case LIQUID_MODEM_APSK16:
+  case LIQUID_MODEM_APSK32:
+  case LIQUID_MODEM_APSK64:
+  case LIQUID_MODEM_APSK128:
+  case LIQUID_MODEM_APSK256:
+    break;
+
+  default:
+    fprintf(stderr, _("Error: Invalid subcarrier modulation\n"));
+    return(NULL);
+  }
+  if(config->subcarriers == 0)
+  {
+    fprintf(stderr, _("Error: Invalid number of subcarriers\n"));
+    return(NULL);
+  }
+  if(config->inner_fec == LIQUID_FEC_UNKNOWN)
+  {
+    fprintf(stderr, _("Error: Invalid inner FEC\n"));
+    return(NULL);
+  }
+  if(config->outer_fec == LIQUID_FEC_UNKNOWN)
+  {
+    fprintf(stderr, _("Error: Invalid outer FEC\n"));
+    return(NULL);
+  }
+  if(strlen(config->id) > 4)
+  {
+    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
+    return(NULL);
+  }
+
+  modem = malloc(sizeof(struct ofdm_modem_s));
+  if(modem == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(NULL);
+  }
+  bzero(modem, sizeof(struct ofdm_modem_s));
+  modem->emit = config->emit;
+  modem->sample_rate = config->sample_rate;
+  modem->bit_rate = config->bit_rate;
+  modem->subcarrier_modulation = config->subcarrier_modulation;
+  modem->subcarriers = config->subcarriers;
+  modem->cyclic_prefix_length = config->cyclic_prefix_length;
+  modem->taper_length = config->taper_length;
+  modem->crc = LIQUID_CRC_32;
+  modem->inner_fec = config->inner_fec;
+  modem->outer_fec = config->outer_fec;
+  modem->latency = config->latency;
+  modem->frame_callback = config->frame_callback;
+  modem->header_callback = config->emit ? NULL : config->header_callback;
+  modem->callback_context = config->callback_context;
+  memcpy(modem->header, config->id, strlen(config->id));
+
+  subcarrier_symbol_bits = ofdm_modem_bits_per_symbol(modem->subcarrier_modulation);
+  samples_per_bit = 2.0 / subcarrier_symbol_bits;
+  if(modem->emit)
+  {
+    resampling_ratio = (float) modem->sample_rate / (modem->bit_rate *
+                                                     samples_per_bit);
+  }
+  else
+  {
+    resampling_ratio = (modem->bit_rate *
+                        samples_per_bit) / (float) modem->sample_rate;
+  }
+  modem->resampler = msresamp_crcf_create(resampling_ratio, 60);
+  modem->delay = ceilf(msresamp_crcf_get_delay(modem->resampler));
+  /* Process data by blocks of half the latency */
+  modem->frame_samples_size = MAX(ceilf(modem->bit_rate *
+                                        samples_per_bit *
+                                        modem_get_block_duration(modem->latency)),
+                                  16);
+  if(modem->emit)
+  {
+    modem->samples_size = ceilf((modem->frame_samples_size +
+                                 modem->delay) * resampling_ratio);
+    /* Room for the zeros pushing the samples out of the resampler at the
+     * end */
+    modem->frame_samples = malloc((modem->frame_samples_size +
+                                   modem->delay) *
+                                  sizeof(complex float));
+    modem->samples = malloc(modem->samples_size * sizeof(complex float));
+  }
+  else
+  {
+    modem->samples_size = floorf(modem->frame_samples_size /
+                                 resampling_ratio);
+    modem->frame_samples = malloc((modem->frame_samples_size +
+                                   modem->delay) *
+                                  sizeof(complex float));
+    modem->samples = malloc((modem->samples_size + modem->delay) *
+                            sizeof(complex float));
+  }
+  if((modem->frame_samples == NULL) || (modem->samples == NULL))
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    ofdm_modem_free(modem);
+    return(NULL);
+  }
+
+  if(!modem->emit)
+  {
+    subcarrier_types = malloc(modem->subcarriers);
+    if(subcarrier_types == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      ofdm_modem_free(modem);
+      return(NULL);
+    }
+    ofdmframe_init_default_sctype(modem->subcarriers, subcarrier_types);
+    ofdmframe_validate_sctype(subcarrier_types,
+                              modem->subcarriers,
+                              &null_subcarriers,
+                              &pilot_subcarriers,
+                              &modem->data_subcarriers);
+    free(subcarrier_types);
+    if(modem->data_subcarriers == 0)
+    {
+      fprintf(stderr, _("Error: Invalid number of subcarriers\n"));
+      ofdm_modem_free(modem);
+      return(NULL);
+    }
+  }
+  if(modem->header_callback)
+  {
+    /* The header is decoded the way ofdmflexframesync does it: symbols of
+     * the data subcarriers, bytes, unscrambling, then FEC and CRC */
+    modem->header_decoder = packetizer_create(OFDM_MODEM_HEADER_SIZE +
+                                              MODEM_FRAME_INFO_SIZE,
+                                              modem->crc,
+                                              modem->inner_fec,
+                                              modem->outer_fec);
+    modem->header_demodulator = modemcf_create(modem->subcarrier_modulation);
+    modem->header_encoded_size =
+      packetizer_get_enc_msg_len(modem->header_decoder);
+    modem->header_symbols_size = ((modem->header_encoded_size * 8) +
+                                  subcarrier_symbol_bits - 1) /
+      subcarrier_symbol_bits;
+    header_ofdm_symbols = (modem->header_symbols_size +
+                           modem->data_subcarriers - 1) /
+      modem->data_subcarriers;
+    /* Samples from a little before the preamble to the end of the header */
+    modem->history_size = (MODEM_REPLAY_MARGIN +
+                           MODEM_PREAMBLE_SYMBOLS +
+                           header_ofdm_symbols) *
+      (modem->subcarriers + modem->cyclic_prefix_length);
+    modem->header_symbols = malloc(modem->header_symbols_size);
+    modem->header_encoded = malloc(modem->header_encoded_size);
+    modem->history = malloc(modem->history_size * sizeof(complex float));
+    if((modem->header_symbols == NULL) ||
+       (modem->header_encoded == NULL) ||
+       (modem->history == NULL))
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      ofdm_modem_free(modem);
+      return(NULL);
+    }
+  }
+
+  modem->oscillator = nco_crcf_create(LIQUID_NCO);
+  ofdm_modem_set_frequency_offset(modem, config->frequency_offset);
+
+  ofdmflexframegenprops_init_default(&frame_properties);
+  frame_properties.check = modem->crc;
+  frame_properties.fec0 = modem->inner_fec;
+  frame_properties.fec1 = modem->outer_fec;
+  frame_properties.mod_scheme = modem->subcarrier_modulation;
+  pthread_mutex_lock(&modem_creation_mutex);
+  if(modem->emit)
+  {
+    modem->frame_generator = ofdmflexframegen_create(modem->subcarriers,
+                                                     modem->cyclic_prefix_length,
+                                                     modem->taper_length,
+                                                     NULL,
+                                                     &frame_properties);
+  }
+  else
+  {
+    modem->frame_synchronizer = ofdmflexframesync_create(modem->subcarriers,
+                                                         modem->cyclic_prefix_length,
+                                                         modem->taper_length,
+                                                         NULL,
+                                                         modem_frame_found,
+                                                         modem);
+    if(modem->header_callback)
+    {
+      modem->frame_detector = ofdmframesync_create(modem->subcarriers,
+                                                   modem->cyclic_prefix_length,
+                                                   modem->taper_length,
+                                                   NULL,
+                                                   modem_symbol_received,
+                                                   modem);
+    }
+  }
+  pthread_mutex_unlock(&modem_creation_mutex);
+  if(modem->emit)
+  {
+    ofdmflexframegen_set_header_props(modem->frame_generator,
+                                      &frame_properties);
+    ofdmflexframegen_set_header_len(modem->frame_generator,
+                                    OFDM_MODEM_HEADER_SIZE);
+  }
+  else
+  {
+    ofdmflexframesync_set_header_props(modem->frame_synchronizer,
+                                       &frame_properties);
+    ofdmflexframesync_set_header_len(modem->frame_synchronizer,
+                                     OFDM_MODEM_HEADER_SIZE);
+  }
+
+  return(modem);
+}
+
+void ofdm_modem_free(ofdm_modem_t modem)
+{
+  if(modem)
+  {
+    if(modem->frame_generator ||
+       modem->frame_synchronizer ||
+       modem->frame_detector)
+    {
+      pthread_mutex_lock(&modem_creation_mutex);
+      if(modem->frame_generator)
+      {
+        ofdmflexframegen_destroy(modem->frame_generator);
+      }
+      if(modem->frame_synchronizer)
+      {
+        ofdmflexframesync_destroy(modem->frame_synchronizer);
+      }
+      if(modem->frame_detector)
+      {
+        ofdmframesync_destroy(modem->frame_detector);
+      }
+      pthread_mutex_unlock(&modem_creation_mutex);
+    }
+    if(modem->header_decoder)
+    {
+      packetizer_destroy(modem->header_decoder);
+    }
+    if(modem->header_demodulator)
+    {
+      modemcf_destroy(modem->header_demodulator);
+    }
+    if(modem->resampler)
+    {
+      msresamp_crcf_destroy(modem->resampler);
+    }
+    if(modem->oscillator)
+    {
+      nco_crcf_destroy(modem->oscillator);
+    }
+    free(modem->frame_samples);
+    free(modem->samples);
+    free(modem->header_symbols);
+    free(modem->header_encoded);
+    free(modem->history);
+    free(modem);
+  }
+}
+
+void ofdm_modem_reset(ofdm_modem_t modem)
+{
+  if(modem->emit)
+  {
+    ofdmflexframegen_reset(modem->frame_generator);
+  }
+  else
+  {
+    ofdmflexframesync_reset(modem->frame_synchronizer);
+    if(modem->frame_detector)
+    {
+      ofdmframesync_reset(modem->frame_detector);
+    }
+    modem->header_symbols_received = 0;
+    modem->frame_kept = 0;
+    modem->frame_decoding = 0;
+    modem->frame_done = 0;
+    modem->history_length = 0;
+  }
+  msresamp_crcf_reset(modem->resampler);
+  nco_crcf_set_phase(modem->oscillator, 0);
+  modem->frame_in_progress = 0;
+}
+
+unsigned int ofdm_modem_get_block_size(ofdm_modem_t modem)
+{
+  return(modem->samples_size);
+}
+
+void ofdm_modem_set_frequency_offset(ofdm_modem_t modem,
+                                     long int frequency_offset)
+{
+  modem->frequency_offset = frequency_offset;
+  nco_crcf_set_frequency(modem->oscillator,
+                         TAU * ((float) frequency_offset / modem->sample_rate));
+}
+
+int ofdm_modem_set_id(ofdm_modem_t modem, char *id)
+{
+  if(strlen(id) > 4)
+  {
+    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
+    return(-1);
+  }
+  bzero(modem->header, 4);
+  memcpy(modem->header, id, strlen(id));
+
+  return(0);
+}
+
+void ofdm_modem_set_counter(ofdm_modem_t modem, unsigned int counter)
+{
+  modem_set_counter(modem->header, counter);
+}
+
+unsigned int ofdm_modem_get_counter(ofdm_modem_t modem)
+{
+  return(modem_get_counter(modem->header));
+}
+
+int ofdm_modem_is_frame_open(ofdm_modem_t modem)
+{
+  if(modem->emit)
+  {
+    return(modem->frame_in_progress);
+  }
+  else if(modem->header_callback && !modem->frame_decoding)
+  {
+    return(ofdmframesync_is_frame_open(modem->frame_detector));
+  }
+  else
+  {
+    return(ofdmflexframesync_is_frame_open(modem->frame_synchronizer));
+  }
+}
+
+int ofdm_modem_assemble(ofdm_modem_t modem,
+                        unsigned char *payload,
+                        unsigned int payload_size)
+{
+  if((!modem->emit) || (payload_size > OFDM_MODEM_MAX_PAYLOAD_SIZE))
+  {
+    return(-1);
+  }
+
+  ofdmflexframegen_assemble(modem->frame_generator,
+                            modem->header,
+                            payload,
+                            payload_size);
+  modem_set_counter(modem->header, modem_get_counter(modem->header) + 1);
+  modem->frame_in_progress = 1;
+
+  return(0);
+}
+
+/* Resample the samples of a block and move them to the frequency offset */
+unsigned int modem_modulate_block(ofdm_modem_t modem,
+                                  complex float *frame_samples,
+                                  unsigned int frame_samples_size,
+                                  complex float *samples)
+{
+  unsigned int n;
+
+  msresamp_crcf_execute(modem->resampler,
+                        frame_samples,
+                        frame_samples_size,
+                        samples,
+                        &n);
+  if(modem->frequency_offset != 0)
+  {
+    nco_crcf_mix_block_up(modem->oscillator, samples, samples, n);
+  }
+
+  return(n);
+}
+
+unsigned int ofdm_modem_modulate(ofdm_modem_t modem, complex float *samples)
+{
+  int frame_complete;
+  unsigned int n;
+  unsigned int i;
+  float maximum_amplitude;
+
+  if(!modem->frame_in_progress)
+  {
+    return(0);
+  }
+
+  frame_complete = ofdmflexframegen_write(modem->frame_generator,
+                                          modem->frame_samples,
+                                          modem->frame_samples_size);
+  n = modem->frame_samples_size;
+  if(frame_complete)
+  {
+    modem->frame_in_progress = 0;
+    /* Don't send the padding 0 bytes */
+    while((n > 0) && (modem->frame_samples[n - 1] == 0))
+    {
+      n--;
+    }
+  }
+  /* Reduce the amplitude of samples because the frame generator and
+   * the resampler may produce samples with an amplitude greater than
+   * 1.0 depending on the number of carriers and resampling ratio */
+  maximum_amplitude = 1;
+  for(i = 0; i < n; i++)
+  {
+    if(cabsf(modem->frame_samples[i]) > maximum_amplitude)
+    {
+      maximum_amplitude = cabsf(modem->frame_samples[i]);
+    }
+  }
+  liquid_vectorcf_mulscalar(modem->frame_samples,
+                            n,
+                            0.75 / maximum_amplitude,
+                            modem->frame_samples);
+
+  return(modem_modulate_block(modem, modem->frame_samples, n, samples));
+}
+
+unsigned int ofdm_modem_modulate_end(ofdm_modem_t modem,
+                                     complex float *samples)
+{
+  bzero(modem->frame_samples, modem->delay * sizeof(complex float));
+
+  return(modem_modulate_block(modem,
+                              modem->frame_samples,
+                              modem->delay,
+                              samples));
+}
+
+/* Pass a frame kept after its header to the frame synchronizer, from the
+ * samples preceding its preamble */
+void modem_decode_frame(ofdm_modem_t modem)
+{
+  unsigned int start;
+  unsigned int n;
+
+  start = (modem->history_index + modem->history_size -
+           modem->history_length) % modem->history_size;
+  n = MIN(modem->history_length, modem->history_size - start);
+  ofdmflexframesync_reset(modem->frame_synchronizer);
+  ofdmflexframesync_execute(modem->frame_synchronizer,
+                            modem->history + start,
+                            n);
+  ofdmflexframesync_execute(modem->frame_synchronizer,
+                            modem->history,
+                            modem->history_length - n);
+  modem->history_length = 0;
+  modem->frame_decoding = 1;
+  modem->frame_decoding_samples = 0;
+}
+
+/* Look for the headers of the frames with the frame detector, and decode
+ * the frames kept with the frame synchronizer
+ * The frames skipped are not demodulated further than their header. */
+void modem_synchronize(ofdm_modem_t modem,
+                       complex float *samples,
+                       unsigned int samples_size)
+{
+  unsigned int i;
+
+  for(i = 0; i < samples_size; i++)
+  {
+    if(modem->frame_decoding)
+    {
+      /* Give up if the frame synchronizer didn't find the frame */
+      if((!modem->frame_done) &&
+         ((modem->frame_decoding_samples < modem->history_size) ||
+          ofdmflexframesync_is_frame_open(modem->frame_synchronizer)))
+      {
+        ofdmflexframesync_execute(modem->frame_synchronizer,
+                                  &samples[i],
+                                  1);
+        modem->frame_decoding_samples++;
+        continue;
+      }
+      modem->frame_decoding = 0;
+      modem->frame_done = 0;
+      ofdmframesync_reset(modem->frame_detector);
+    }
+
+    modem->history[modem->history_index] = samples[i];
+    modem->history_index = (modem->history_index + 1) % modem->history_size;
+    if(modem->history_length < modem->history_size)
+    {
+      modem->history_length++;
+    }
+    ofdmframesync_execute(modem->frame_detector, &samples[i], 1);
+    if(modem->frame_kept)
+    {
+      modem->frame_kept = 0;
+      modem->frame_done = 0;
+      modem_decode_frame(modem);
+    }
+  }
+}
+
+/* Move a block of at most 'samples_size' samples to baseband, resample them
+ * and look for frames */
+void modem_demodulate_block(ofdm_modem_t modem,
+                            complex float *samples,
+                            unsigned int samples_size)
+{
+  unsigned int n;
+
+  if(modem->frequency_offset != 0)
+  {
+    nco_crcf_mix_block_down(modem->oscillator,
+                            samples,
+                            modem->samples,
+                            samples_size);
+  }
+  else
+  {
+    memcpy(modem->samples, samples, samples_size * sizeof(complex float));
+  }
+  msresamp_crcf_execute(modem->resampler,
+                        modem->samples,
+                        samples_size,
+                        modem->frame_samples,
+                        &n);
+  if(modem->header_callback)
+  {
+    modem_synchronize(modem, modem->frame_samples, n);
+  }
+  else
+  {
+    ofdmflexframesync_execute(modem->frame_synchronizer,
+                              modem->frame_samples,
+                              n);
+  }
+}
+
+void ofdm_modem_demodulate(ofdm_modem_t modem,
+                           complex float *samples,
+                           unsigned int samples_size)
+{
+  unsigned int n;
+
+  while(samples_size > 0)
+  {
+    n = MIN(samples_size, modem->samples_size);
+    modem_demodulate_block(modem, samples, n);
+    samples += n;
+    samples_size -= n;
+  }
+}
+
+void ofdm_modem_demodulate_end(ofdm_modem_t modem)
+{
+  unsigned int n;
+
+  bzero(modem->samples, modem->delay * sizeof(complex float));
+  msresamp_crcf_execute(modem->resampler,
+                        modem->samples,
+                        modem->delay,
+                        modem->frame_samples,
+                        &n);
+  if(modem->header_callback)
+  {
+    modem_synchronize(modem, modem->frame_samples, n);
+    while(ofdm_modem_is_frame_open(modem))
+    {
+      modem_synchronize(modem, modem->samples, 1);
+    }
+    return;
+  }
+  ofdmflexframesync_execute(modem->frame_synchronizer,
+                            modem->frame_samples,
+                            n);
+  while(ofdmflexframesync_is_frame_open(modem->frame_synchronizer))
+  {
+    ofdmflexframesync_execute(modem->frame_synchronizer,
+                              modem->samples,
+                              1);
+  }
+}
@@ -0,0 +1,169 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OFDM_MODEM_H
+#define OFDM_MODEM_H
+
+#include <complex.h>
+#include <liquid/liquid.h>
+
+typedef struct ofdm_modem_s *ofdm_modem_t;
+
+/* Size of the header of the frames: the id (4 bytes) and the frame counter
+ * (4 bytes) */
+#define OFDM_MODEM_HEADER_SIZE 8
+
+/* Maximum size of the payload of a frame */
+#define OFDM_MODEM_MAX_PAYLOAD_SIZE 65535
+
+/* Frame found by a demodulator */
+struct ofdm_modem_frame_s
+{
+  char id[5];
+  unsigned int counter;
+  unsigned char header_valid;
+  unsigned char payload_valid;
+  unsigned char *payload;
+  unsigned int payload_size;
+  unsigned int payload_symbols; /* OFDM symbols carrying the payload */
+};
+
+/* Configuration of a modem
+ *  - emit: 1 for a modulator, 0 for a demodulator
+ *  - sample_rate: samples per second of the IQ samples
+ *  - bit_rate: bits per second of the OFDM transmission
+ *  - frequency_offset: frequency of the OFDM signal in the IQ samples (Hz)
+ *  - subcarrier_modulation: modulation of the subcarriers (bpsk, qpsk, psk8,
+ *    apsk16, apsk32, apsk64, apsk128 or apsk256)
+ *  - subcarriers: number of OFDM subcarriers
+ *  - cyclic_prefix_length: cyclic prefix length
+ *  - taper_length: taper length
+ *  - inner_fec: inner forward error correction code
+ *  - outer_fec: outer forward error correction code
+ *  - id: id put in the header of the frames sent by a modulator
+ *  - latency: the samples are processed by blocks of 'latency / 2' ms; 0 means
+ *    blocks of 1 s
+ *  - frame_callback: function called by a demodulator for each frame found,
+ *    with 'callback_context' as first argument
+ *  - header_callback: if not NULL, function called by a demodulator with the
+ *    header of each frame before its payload, with 'callback_context' as
+ *    first argument; the frame has no payload yet, but 'payload_size' and
+ *    'payload_symbols' give its size; the payload is demodulated and decoded
+ *    only if the function returns 1, the frame callback is not called
+ *    otherwise (the frames with a corrupted header are passed directly to the
+ *    frame callback)
+ *
+ * The liquid-dsp functions liquid_getopt_str2mod() and liquid_getopt_str2fec()
+ * can be used to get the modulation and FEC codes from their names.
+ */
+struct ofdm_modem_config_s
+{
+  unsigned char emit;
+  unsigned long int sample_rate;
+  unsigned int bit_rate;
+  long int frequency_offset;
+  modulation_scheme subcarrier_modulation;
+  unsigned int subcarriers;
+  unsigned int cyclic_prefix_length;
+  unsigned int taper_length;
+  fec_scheme inner_fec;
+  fec_scheme outer_fec;
+  char *id;
+  unsigned int latency;
+  void (*frame_callback)(void *, struct ofdm_modem_frame_s *);
+  int (*header_callback)(void *, struct ofdm_modem_frame_s *);
+  void *callback_context;
+};
+
+/* Fill a modem configuration with the default values
+ * (demodulator, 2000000 S/s, 38400 b/s, no offset, qpsk, 64 subcarriers,
+ * cyclic prefix 16, taper 4, h128 and no outer FEC, empty id, latency
+ * 100 ms, no callbacks) */
+void ofdm_modem_config_init_default(struct ofdm_modem_config_s *config);
+
+/* Create a modulator or a demodulator
+ * The modem doesn't allocate memory after its creation.
+ * Return NULL if the configuration is invalid. */
+ofdm_modem_t ofdm_modem_create(struct ofdm_modem_config_s *config);
+
+/* Cleanup after a modem is not used anymore */
+void ofdm_modem_free(ofdm_modem_t modem);
+
+/* Reset the state of a modem (filters, oscillator, frame in progress) to
+ * start a new transmission */
+void ofdm_modem_reset(ofdm_modem_t modem);
+
+/* Size of the blocks of samples of a modem
+ *  - modulator: maximum number of samples written by one call to
+ *    ofdm_modem_modulate() or ofdm_modem_modulate_end()
+ *  - demodulator: number of samples processed at once by
+ *    ofdm_modem_demodulate() */
+unsigned int ofdm_modem_get_block_size(ofdm_modem_t modem);
+
+/* Change the frequency of the OFDM signal in the IQ samples */
+void ofdm_modem_set_frequency_offset(ofdm_modem_t modem,
+                                     long int frequency_offset);
+
+/* Change the id put in the header of the next frames (at most 4 bytes)
+ * Return 0 if successful, -1 otherwise. */
+int ofdm_modem_set_id(ofdm_modem_t modem, char *id);
+
+/* Set or get the counter put in the header of the next frame */
+void ofdm_modem_set_counter(ofdm_modem_t modem, unsigned int counter);
+unsigned int ofdm_modem_get_counter(ofdm_modem_t modem);
+
+/* Return 1 if a frame is in progress (not completely modulated yet for
+ * a modulator, or partially received for a demodulator), 0 otherwise */
+int ofdm_modem_is_frame_open(ofdm_modem_t modem);
+
+/* Start the modulation of a frame containing 'payload' and increment the
+ * frame counter
+ * The previous frame must have been completely modulated.
+ * Return 0 if successful, -1 otherwise. */
+int ofdm_modem_assemble(ofdm_modem_t modem,
+                        unsigned char *payload,
+                        unsigned int payload_size);
+
+/* Write the next block of samples of the frame in 'samples', which must be
+ * able to hold ofdm_modem_get_block_size() samples
+ * Return the number of samples written. */
+unsigned int ofdm_modem_modulate(ofdm_modem_t modem, complex float *samples);
+
+/* Write the samples still in the filters at the end of a transmission (or
+ * before a silence) in 'samples', which must be able to hold
+ * ofdm_modem_get_block_size() samples
+ * Return the number of samples written. */
+unsigned int ofdm_modem_modulate_end(ofdm_modem_t modem,
+                                     complex float *samples);
+
+/* Demodulate some samples, calling the frame callback for each frame found
+ * The samples are not modified. */
+void ofdm_modem_demodulate(ofdm_modem_t modem,
+                           complex float *samples,
+                           unsigned int samples_size);
+
+/* Demodulate the samples still in the filters at the end of a transmission,
+ * and the frame in progress */
+void ofdm_modem_demodulate_end(ofdm_modem_t modem);
+
+/* Number of bits carried by a symbol of a subcarrier modulation */
+unsigned int ofdm_modem_bits_per_symbol(modulation_scheme modulation);
+
+#endif
@@ -19,38 +19,168 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <complex.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <liquid/liquid.h>
 #include <math.h>
+#include <net/if.h>
+#include <pthread.h>
 #include <signal.h>
 #include <SoapySDR/Device.h>
 #include <SoapySDR/Formats.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_LINUX_IF_TUN_H
+#include <linux/if_tun.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
 #include "gettext.h"
+#include "ofdm-modem.h"
 #include "ofdm-transfer.h"
 
-#define TAU (2 * M_PI)
+/* The length of the payload is sent in 16 bits in the header of the frames */
+#define MAX_PAYLOAD_SIZE OFDM_MODEM_MAX_PAYLOAD_SIZE
+
+/* In datagram mode, each message (or fragment of message) in the payload of
+ * a frame is preceded by a 2 bytes sub-header:
+ *  - bit 15: the message continues in the next frame
+ *  - bit 14: the fragment is the continuation of a message started in the
+ *    previous frame
+ *  - bits 0 to 13: length of the fragment */
+#define DATAGRAM_HEADER_SIZE 2
+#define DATAGRAM_MORE_FRAGMENTS 0x8000
+#define DATAGRAM_CONTINUATION 0x4000
+#define DATAGRAM_MAX_FRAGMENT_SIZE 0x3fff
+
+/* In reliable mode, the counter of the frames is their sequence number, and
+ * the receiver sends acknowledgements on the reverse link. Their payload is
+ * the counter of the next frame expected (4 bytes), followed by a bitmap of
+ * the frames already received after it (bit 7 of the first byte for the
+ * next counter + 1, etc.). */
+#define ARQ_MAX_WINDOW 1024
+#define ARQ_ACK_HEADER_SIZE 4
+#define ARQ_INITIAL_RTO 1.0
+#define ARQ_MIN_RTO 0.05
+#define ARQ_MAX_RTO 10.0
+#define ARQ_MAX_RETRIES 20
+#define ARQ_SLOT_FREE 0
+#define ARQ_SLOT_SENT 1
+#define ARQ_SLOT_ACKED 2
+#define ARQ_SLOT_RECEIVED 3
+
+/* With the erasure code, the frames are sent by blocks of 'data_frames' frames
+ * followed by 'parity_frames' parity frames computed with a systematic Cauchy
+ * Reed-Solomon code over GF(256). The position of a frame in its block is
+ * given by its counter. The payload of the data frames starts with the length
+ * of the data (2 bytes), the payload of the parity frames starts with the
+ * number of data frames in the block (1 byte), which is lower than
+ * 'data_frames' when an incomplete block is sent because no more data is
+ * ready. */
+#define ERASURE_MAX_FRAMES 255
+#define ERASURE_DATA_HEADER_SIZE 2
+#define ERASURE_PARITY_HEADER_SIZE 1
+#define GF_POLYNOMIAL 0x11d
+
+/* In carousel mode, the payload of each frame starts with a header giving the
+ * number of the block of the file it contains (4 bytes), the size of the
+ * blocks (2 bytes) and the size of the file (4 bytes) */
+#define CAROUSEL_HEADER_SIZE 10
+#define CAROUSEL_MAX_FILE_SIZE 0xffffffff
+
+/* The receiver remembers which of the last SEQUENCE_HISTORY frame counters
+ * it has seen, to detect the duplicate and reordered frames. A counter going
+ * back further is taken as a restart of the sender. */
+#define SEQUENCE_HISTORY 1024
+#define REORDER_MAX_FRAMES SEQUENCE_HISTORY
+#define SEQUENCE_NEW 0
+#define SEQUENCE_DUPLICATE 1
+#define SEQUENCE_LATE 2
+
+/* The frames of the other ids received by a transfer are dispatched to their
+ * stations through a hash table on the 4 bytes of the id. A wildcard station
+ * creates at most STATIONS_MAX stations automatically. */
+#define STATIONS_HASH_BITS 6
+#define STATIONS_HASH_SIZE (1 << STATIONS_HASH_BITS)
+#define STATIONS_MAX 1024
+
+/* Maximum number of asynchronous events read from the radio at each block of
+ * samples sent */
+#define STREAM_STATUS_MAX_READS 16
+
+/* When receiving in carousel mode with a checkpoint, the list of the blocks
+ * received is saved at most every CHECKPOINT_INTERVAL s */
+#define CHECKPOINT_INTERVAL 1.0
+
+/* The payloads in the delivery queue, and the messages in the send queue in
+ * datagram mode, are preceded by their length (2 bytes) */
+#define QUEUE_ENTRY_HEADER_SIZE 2
+
+/* When the received data is written to a file or to the standard output, it
+ * is written in batches of at most OUTPUT_BUFFER_SIZE bytes, at the latest
+ * 'latency' ms (or OUTPUT_THROUGHPUT_DELAY s in throughput mode) after the
+ * first byte of the batch has been received */
+#define OUTPUT_BUFFER_SIZE 65536
+#define OUTPUT_THROUGHPUT_DELAY 1.0
+
+/* When the output buffer is spliced to a pipe, a ring of
+ * OUTPUT_SPLICE_BUFFERS buffers is used, a buffer being reused once the pipe
+ * has consumed its pages */
+#define OUTPUT_SPLICE_BUFFERS 4
+
+/* The timer returned by ofdm_transfer_get_fd() for SoapySDR radios expires
+ * at each block of samples, or every TIMER_DEFAULT_PERIOD s before the modem
+ * is created */
+#define TIMER_DEFAULT_PERIOD 0.01
+
+/* Settings changed while a transfer is running */
+#define SETTING_FREQUENCY 1
+#define SETTING_FREQUENCY_OFFSET 2
+#define SETTING_GAIN 4
+#define SETTING_ID 8
+#define SETTING_HOP 16
+#define SETTING_PAYLOAD_SIZE 32
 
 #define MIN(x, y) ((x < y) ? x : y)
 #define MAX(x, y) ((x > y) ? x : y)
 
 #define _(string) gettext(string)
 
+/* Report a SoapySDR error and return NULL from the calling function */
 #define SOAPYSDR_CHECK(funcall) \
 { \
   int e = funcall; \
   if(e != 0) \
   { \
     fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError()); \
-    exit(EXIT_FAILURE); \
+    return(NULL); \
   } \
 }
 
+/* Number of consecutive failed reads or writes (errors, or timeouts of
+ * 10 ms) after which the radio stream is considered broken */
+#define STREAM_MAX_FAILURES 100
+
+/* A broken stream is reactivated, then set up again, then the radio is
+ * opened again (up to STREAM_MAX_REOPENS times, waiting STREAM_REOPEN_DELAY
+ * microseconds between the attempts). If it is still broken after
+ * STREAM_MAX_RECOVERIES attempts, the transfer fails. */
+#define STREAM_MAX_RECOVERIES 5
+#define STREAM_MAX_REOPENS 20
+#define STREAM_REOPEN_DELAY 500000
+
 typedef enum
   {
     IO,
@@ -69,17 +199,159 @@ typedef union
   SoapySDRStream *soapysdr;
 } radio_stream_t;
 
+/* Bounded queue of bytes shared by two threads */
+typedef struct
+{
+  unsigned char *buffer;
+  unsigned int size;
+  unsigned int start;
+  unsigned int length;
+  unsigned char closed;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} queue_t;
+
+/* Frame of the window of the reliable mode */
+typedef struct
+{
+  unsigned char state;
+  unsigned char lost;
+  unsigned int retries;
+  unsigned int size;
+  double sent_time;
+  unsigned char *data;
+} arq_slot_t;
+
+/* State of the reliable mode, shared by the transfer carrying the data and
+ * the reverse transfer carrying the acknowledgements. The sender keeps the
+ * frames not acknowledged yet in the window, the receiver keeps the frames
+ * received out of order. */
+typedef struct
+{
+  pthread_mutex_t mutex;
+  unsigned int references;
+  unsigned int window;
+  arq_slot_t *slots;
+  unsigned char *buffer;
+  unsigned int slot_size;
+  unsigned int base;
+  unsigned int next;
+  unsigned char ack_pending;
+  unsigned char failed;
+  double srtt;
+  double rttvar;
+  double rto;
+} arq_t;
+
+/* State of the erasure code. The sender computes the parity frames while the
+ * data frames of a block are sent, the receiver keeps the frames of the current
+ * block until the missing ones can be rebuilt. */
+typedef struct
+{
+  unsigned int data_frames;
+  unsigned int parity_frames;
+  unsigned int slot_size;
+  unsigned char *buffer;
+  unsigned char **shards;
+  unsigned int *lengths;
+  unsigned char *received;
+  unsigned char *matrix;
+  unsigned char *inverse;
+  unsigned int *missing;
+  unsigned int *rows;
+  unsigned int block;
+  unsigned char block_valid;
+  unsigned int data_count;
+  unsigned int shard_size;
+  unsigned int parity_index;
+  unsigned char sending_parity;
+  unsigned int delivered;
+  unsigned int sequence;
+  double last_data_time;
+} erasure_t;
+
+/* State of the carousel mode. The sender reads the blocks of the file in
+ * turn, the receiver writes them at their offset and keeps a bitmap of the
+ * blocks received. */
+typedef struct
+{
+  int fd;
+  unsigned int cycles;
+  unsigned int cycle;
+  unsigned int file_size;
+  unsigned int block_size;
+  unsigned int blocks;
+  unsigned int block;
+  unsigned char *bitmap;
+  unsigned int blocks_received;
+  unsigned int first_missing;
+  unsigned int start;
+  unsigned char started;
+  unsigned char complete;
+  char *checkpoint;
+  unsigned char checkpoint_dirty;
+  double checkpoint_time;
+} carousel_t;
+
+/* Sequence of the frame counters received for an id */
+typedef struct
+{
+  unsigned char valid;
+  unsigned int highest;
+  unsigned char history[SEQUENCE_HISTORY / 8];
+} sequence_t;
+
+/* Frames held back until the frames before them arrive (reorder buffer).
+ * The frame with counter 'c' is kept in the slot 'c % frames'. */
+typedef struct
+{
+  unsigned int frames;
+  unsigned int slot_size;
+  unsigned char *buffer;
+  unsigned int *lengths;
+  unsigned char *used;
+  unsigned int held;
+  unsigned int next;
+  unsigned char next_valid;
+  double hold_time;
+} reorder_t;
+
+/* Receiver of the frames of another id (see ofdm_transfer_add_id()) */
+typedef struct station_s
+{
+  char id[5];
+  int (*data_callback)(void *, unsigned char *, unsigned int);
+  void *callback_context;
+  sequence_t sequence;
+  struct ofdm_transfer_stats_s stats;
+  struct station_s *next;
+} station_t;
+
+/* Radio device used by a transfer and its reverse transfer */
+typedef struct
+{
+  pthread_mutex_t mutex;
+  unsigned int references;
+} shared_device_t;
+
 struct ofdm_transfer_s
 {
   radio_type_t radio_type;
   radio_device_t radio_device;
   radio_stream_t radio_stream;
+  radio_stream_t other_radio_stream;
+  unsigned char radio_stream_active;
+  char *radio_filename;
+  shared_device_t *shared_device;
   unsigned char emit;
   FILE *file;
   unsigned long int sample_rate;
   unsigned int bit_rate;
   unsigned long int frequency;
   long int frequency_offset;
+  long int default_frequency_offset;
+  float ppm;
   modulation_scheme subcarrier_modulation;
   unsigned int subcarriers;
   unsigned int cyclic_prefix_length;
@@ -96,10 +368,103 @@ struct ofdm_transfer_s
   time_t timeout_start;
   firhilbf audio_converter;
   float audio_gain;
+  unsigned int latency;
+  unsigned int payload_size;
+  unsigned int minimum_payload_size;
+  unsigned int maximum_payload_size;
+  unsigned char adaptive_payload_size;
+  float corrupted_rate;
+  struct ofdm_transfer_stats_s stats;
+  unsigned int coalescing_delay;
+  unsigned char step_mode;
+  unsigned char *coalesce_buffer;
+  unsigned int coalesce_size;
+  double coalesce_deadline;
+  int timer_fd;
+  unsigned char input_finished;
+  unsigned char datagram;
+  unsigned char *message;
+  unsigned int message_size;
+  unsigned int message_offset;
+  unsigned char message_incomplete;
+  unsigned int message_next_counter;
+  ofdm_modem_t modulator;
+  ofdm_modem_t demodulator;
+  unsigned int counter;
+  unsigned char *payload;
+  complex float *samples;
+  unsigned int samples_size;
+  pthread_mutex_t settings_mutex;
+  unsigned char settings_changed;
+  unsigned long int new_frequency;
+  long int new_frequency_offset;
+  char *new_gain;
+  char new_id[5];
+  unsigned int reported_valid;
+  unsigned int reported_corrupted;
+  unsigned long int *hop_frequencies;
+  unsigned int hop_count;
+  unsigned int hop_dwell;
+  int hop_channel;
+  int new_hop_channel;
+  unsigned long int *scan_frequencies;
+  unsigned int scan_count;
+  unsigned long int scan_dwell;
+  unsigned long int scan_quiet;
+  unsigned int scan_channel;
+  unsigned long int scan_samples;
+  unsigned char scan_locked;
+  unsigned char scan_activity;
+  queue_t *send_queue;
+  queue_t *delivery_queue;
+  int delivery_policy;
+  pthread_t delivery_thread;
+  unsigned char delivery_thread_running;
+  unsigned char *delivery_buffer;
+  int output_fd;
+  unsigned char *output_buffer;
+  unsigned char *output_ring[OUTPUT_SPLICE_BUFFERS];
+  unsigned long long int output_ring_pages[OUTPUT_SPLICE_BUFFERS];
+  unsigned int output_ring_index;
+  unsigned long long int output_spliced_pages;
+  unsigned int output_size;
+  unsigned int output_length;
+  double output_deadline;
+  unsigned char output_splice;
+  pthread_mutex_t output_mutex;
+  long long int next_timestamp;
+  unsigned char next_timestamp_valid;
+  unsigned char resync_needed;
+  unsigned char stream_status_unsupported;
+  char *radio_args;
+  char *radio_gain[2];
+  unsigned int stream_failures;
+  unsigned int recovery_level;
+  double recovery_start;
+  unsigned char radio_failed;
+  unsigned char tun;
+  int tun_fd;
+  unsigned int tun_mtu;
+  unsigned char tun_owned;
+  arq_t *arq;
+  unsigned char arq_data;
+  erasure_t *erasure;
+  carousel_t *carousel;
+  unsigned char truncate_output;
+  sequence_t sequence;
+  reorder_t *reorder;
+  unsigned char drop_duplicates;
+  station_t *stations[STATIONS_HASH_SIZE];
+  unsigned int stations_count;
+  station_t *stations_wildcard;
+  unsigned char skip_other_ids;
 };
 
 unsigned char stop = 0;
 unsigned char verbose = 0;
+unsigned char gf_exp[512];
+unsigned char gf_log[256];
+pthread_once_t gf_tables_once = PTHREAD_ONCE_INIT;
 
 void ofdm_transfer_set_verbose(unsigned char v)
 {
@@ -111,6 +476,33 @@ unsigned char ofdm_transfer_is_verbose()
   return(verbose);
 }
 
+/* Serialize the calls changing the state of a device shared by a transfer and
+ * its reverse transfer */
+void lock_device(ofdm_transfer_t transfer)
+{
+  if(transfer->shared_device)
+  {
+    pthread_mutex_lock(&transfer->shared_device->mutex);
+  }
+}
+
+void unlock_device(ofdm_transfer_t transfer)
+{
+  if(transfer->shared_device)
+  {
+    pthread_mutex_unlock(&transfer->shared_device->mutex);
+  }
+}
+
+/* Time in seconds from a monotonic clock */
+double get_monotonic_time()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return(t.tv_sec + (t.tv_nsec / 1000000000.0));
+}
+
 void dump_samples(ofdm_transfer_t transfer,
                   complex float *samples,
                   unsigned int samples_size)
@@ -139,21 +531,484 @@ int read_data(void *context,
   return(n);
 }
 
+/* Write all the data described by 'iov', waiting when the file descriptor
+ * is not ready */
+int write_all(int fd, struct iovec *iov, unsigned int iov_count)
+{
+  ssize_t n;
+
+  while(iov_count > 0)
+  {
+    n = writev(fd, iov, iov_count);
+    if(n < 0)
+    {
+      if((errno == EINTR) || (errno == EAGAIN))
+      {
+        usleep(1000);
+        continue;
+      }
+      fprintf(stderr, _("Error: Failed to write data\n"));
+      return(-1);
+    }
+    while((iov_count > 0) && ((size_t) n >= iov->iov_len))
+    {
+      n -= iov->iov_len;
+      iov++;
+      iov_count--;
+    }
+    if(iov_count > 0)
+    {
+      iov->iov_base = (unsigned char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return(0);
+}
+
+/* The output buffer is allocated with mmap() when it is spliced to a pipe,
+ * so that its pages can be given to the pipe */
+unsigned char * output_buffer_create(unsigned int size, unsigned char splice)
+{
+  unsigned char *buffer;
+
+  if(splice)
+  {
+    buffer = mmap(NULL,
+                  size,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS,
+                  -1,
+                  0);
+    return((buffer == MAP_FAILED) ? NULL : buffer);
+  }
+
+  return(malloc(size));
+}
+
+void output_buffer_free(unsigned char *buffer,
+                        unsigned int size,
+                        unsigned char splice)
+{
+  if(buffer == NULL)
+  {
+    return;
+  }
+  if(splice)
+  {
+    munmap(buffer, size);
+  }
+  else
+  {
+    free(buffer);
+  }
+}
+
+/* Free the output buffer, and the other buffers of the ring when it is
+ * spliced to a pipe */
+void output_buffers_free(ofdm_transfer_t transfer)
+{
+  unsigned int i;
+
+  if(!transfer->output_splice)
+  {
+    output_buffer_free(transfer->output_buffer, transfer->output_size, 0);
+    transfer->output_buffer = NULL;
+    return;
+  }
+  for(i = 0; i < OUTPUT_SPLICE_BUFFERS; i++)
+  {
+    output_buffer_free(transfer->output_ring[i], transfer->output_size, 1);
+    transfer->output_ring[i] = NULL;
+  }
+  transfer->output_buffer = NULL;
+}
+
+#ifdef HAVE_VMSPLICE
+/* Give the pages of the output buffer to the pipe instead of copying them,
+ * and continue with the next buffer of the ring (the pipe keeps a reference
+ * to the pages of the old one until they have been read). The next buffer is
+ * reused if all its pages have left the pipe, which is the case when at least
+ * as many pages as the pipe can hold have been spliced after it; otherwise it
+ * is replaced by a new one. Return 1 if no buffer is available, in which case
+ * the data must be written normally. */
+int splice_output(ofdm_transfer_t transfer)
+{
+  unsigned int next = (transfer->output_ring_index + 1) % OUTPUT_SPLICE_BUFFERS;
+  unsigned char *buffer = NULL;
+  long int page_size = sysconf(_SC_PAGESIZE);
+  int pipe_size;
+  struct iovec iov;
+  ssize_t n;
+
+  pipe_size = fcntl(transfer->output_fd, F_GETPIPE_SZ);
+  if((transfer->output_ring[next] == NULL) ||
+     (pipe_size <= 0) ||
+     (transfer->output_spliced_pages - transfer->output_ring_pages[next] <
+      (unsigned long long int) pipe_size / page_size))
+  {
+    buffer = output_buffer_create(transfer->output_size, 1);
+    if(buffer == NULL)
+    {
+      return(1);
+    }
+  }
+
+  iov.iov_base = transfer->output_buffer;
+  iov.iov_len = transfer->output_length;
+  while(iov.iov_len > 0)
+  {
+    n = vmsplice(transfer->output_fd, &iov, 1, 0);
+    if(n < 0)
+    {
+      if((errno == EINTR) || (errno == EAGAIN))
+      {
+        usleep(1000);
+        continue;
+      }
+      fprintf(stderr, _("Error: Failed to write data\n"));
+      output_buffer_free(buffer, transfer->output_size, 1);
+      return(-1);
+    }
+    iov.iov_base = (unsigned char *) iov.iov_base + n;
+    iov.iov_len -= n;
+  }
+
+  /* The buffer is page aligned, each page takes a slot of the pipe */
+  transfer->output_spliced_pages +=
+    (transfer->output_length + page_size - 1) / page_size;
+  transfer->output_ring_pages[transfer->output_ring_index] =
+    transfer->output_spliced_pages;
+  if(buffer)
+  {
+    /* The pipe may still reference the pages of the old buffer */
+    output_buffer_free(transfer->output_ring[next], transfer->output_size, 1);
+    transfer->output_ring[next] = buffer;
+  }
+  transfer->output_ring_index = next;
+  transfer->output_buffer = transfer->output_ring[next];
+
+  return(0);
+}
+#endif
+
+/* Write the buffered output data followed by 'size' bytes of 'data'. The
+ * output mutex must be held. */
+int flush_output(ofdm_transfer_t transfer,
+                 unsigned char *data,
+                 unsigned int size)
+{
+  struct iovec iov[2];
+  int r = 1;
+
+  if((transfer->output_length == 0) && (size == 0))
+  {
+    return(0);
+  }
+  iov[0].iov_base = transfer->output_buffer;
+  iov[0].iov_len = transfer->output_length;
+#ifdef HAVE_VMSPLICE
+  if(transfer->output_splice && (transfer->output_length > 0))
+  {
+    r = splice_output(transfer);
+    if(r == 0)
+    {
+      iov[0].iov_len = 0;
+    }
+  }
+#endif
+  iov[1].iov_base = data;
+  iov[1].iov_len = size;
+  if(r >= 0)
+  {
+    r = write_all(transfer->output_fd, iov, 2);
+  }
+  transfer->output_length = 0;
+
+  return(r);
+}
+
+/* Write the buffered output data if its deadline has passed */
+void flush_output_if_due(ofdm_transfer_t transfer)
+{
+  pthread_mutex_lock(&transfer->output_mutex);
+  if((transfer->output_length > 0) &&
+     (get_monotonic_time() >= transfer->output_deadline))
+  {
+    flush_output(transfer, NULL, 0);
+  }
+  pthread_mutex_unlock(&transfer->output_mutex);
+}
+
 int write_data(void *context,
                unsigned char *payload,
                unsigned int payload_size)
 {
   ofdm_transfer_t transfer = (ofdm_transfer_t) context;
 
-  fwrite(payload, 1, payload_size, transfer->file);
-  if(transfer->file == stdout)
+  pthread_mutex_lock(&transfer->output_mutex);
+  if(transfer->output_length + payload_size > transfer->output_size)
+  {
+    /* Write the batch and the payload together */
+    flush_output(transfer, payload, payload_size);
+  }
+  else
+  {
+    if(transfer->output_length == 0)
+    {
+      transfer->output_deadline = get_monotonic_time();
+      if(transfer->latency > 0)
+      {
+        transfer->output_deadline += transfer->latency / 1000.0;
+      }
+      else
+      {
+        transfer->output_deadline += OUTPUT_THROUGHPUT_DELAY;
+      }
+    }
+    memcpy(&transfer->output_buffer[transfer->output_length],
+           payload,
+           payload_size);
+    transfer->output_length += payload_size;
+    if(transfer->output_length == transfer->output_size)
+    {
+      flush_output(transfer, NULL, 0);
+    }
+  }
+  pthread_mutex_unlock(&transfer->output_mutex);
+
+  return(payload_size);
+}
+
+/* Data callback taking the packets to send from a TUN interface, one packet
+ * per message */
+int read_tun(void *context,
+             unsigned char *payload,
+             unsigned int payload_size)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+  int n;
+
+  n = read(transfer->tun_fd, payload, payload_size);
+  if(n < 0)
+  {
+    if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+    {
+      return(0);
+    }
+    fprintf(stderr, _("Error: Failed to read from the network interface\n"));
+    return(-1);
+  }
+  else if(n == 0)
+  {
+    /* The other end of the packet socket has been closed */
+    return(-1);
+  }
+
+  return(n);
+}
+
+/* Data callback giving each received message to a TUN interface */
+int write_tun(void *context,
+              unsigned char *payload,
+              unsigned int payload_size)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+
+  /* The packets refused by the kernel are dropped, like on a real link */
+  if((write(transfer->tun_fd, payload, payload_size) < 0) && verbose)
   {
-    fflush(transfer->file);
+    fprintf(stderr, _("Info: Packet of %u bytes dropped by the network interface\n"),
+            payload_size);
   }
 
   return(payload_size);
 }
 
+/* Time 'timeout' ms from now for pthread_cond_timedwait() */
+void get_deadline(struct timespec *deadline, double timeout)
+{
+  clock_gettime(CLOCK_REALTIME, deadline);
+  deadline->tv_sec += timeout / 1000;
+  deadline->tv_nsec += fmod(timeout, 1000) * 1000000;
+  if(deadline->tv_nsec >= 1000000000)
+  {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+queue_t * queue_create(unsigned int size)
+{
+  queue_t *queue = malloc(sizeof(queue_t));
+
+  if(queue == NULL)
+  {
+    return(NULL);
+  }
+  queue->buffer = malloc(size);
+  if(queue->buffer == NULL)
+  {
+    free(queue);
+    return(NULL);
+  }
+  queue->size = size;
+  queue->start = 0;
+  queue->length = 0;
+  queue->closed = 0;
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+
+  return(queue);
+}
+
+void queue_free(queue_t *queue)
+{
+  if(queue)
+  {
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->buffer);
+    free(queue);
+  }
+}
+
+/* Copy data into the ring buffer of a queue (the caller must hold the lock
+ * and check that there is enough space) */
+void queue_write(queue_t *queue, unsigned char *data, unsigned int size)
+{
+  unsigned int end = (queue->start + queue->length) % queue->size;
+  unsigned int n = MIN(size, queue->size - end);
+
+  memcpy(&queue->buffer[end], data, n);
+  memcpy(queue->buffer, data + n, size - n);
+  queue->length += size;
+}
+
+/* Take data from the ring buffer of a queue, or discard it if 'data' is NULL
+ * (the caller must hold the lock and check that there is enough data) */
+void queue_read(queue_t *queue, unsigned char *data, unsigned int size)
+{
+  unsigned int n = MIN(size, queue->size - queue->start);
+
+  if(data)
+  {
+    memcpy(data, &queue->buffer[queue->start], n);
+    memcpy(data + n, queue->buffer, size - n);
+  }
+  queue->start = (queue->start + size) % queue->size;
+  queue->length -= size;
+}
+
+/* Write an entry preceded by its length in a queue (the caller must hold the
+ * lock and check that there is enough space) */
+void queue_write_entry(queue_t *queue, unsigned char *data, unsigned int size)
+{
+  unsigned char header[QUEUE_ENTRY_HEADER_SIZE];
+
+  header[0] = size >> 8;
+  header[1] = size & 255;
+  queue_write(queue, header, QUEUE_ENTRY_HEADER_SIZE);
+  queue_write(queue, data, size);
+}
+
+/* Take the next entry of a queue, or discard it if 'data' is NULL, and return
+ * its length (the caller must hold the lock and check that the queue is not
+ * empty) */
+unsigned int queue_read_entry(queue_t *queue, unsigned char *data)
+{
+  unsigned char header[QUEUE_ENTRY_HEADER_SIZE];
+  unsigned int size;
+
+  queue_read(queue, header, QUEUE_ENTRY_HEADER_SIZE);
+  size = (header[0] << 8) | header[1];
+  queue_read(queue, data, size);
+
+  return(size);
+}
+
+/* Signal that no more data will be put in a queue */
+void queue_close(queue_t *queue)
+{
+  pthread_mutex_lock(&queue->mutex);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/* Data callback taking the data queued by ofdm_transfer_send() */
+int read_queue(void *context,
+               unsigned char *payload,
+               unsigned int payload_size)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+  queue_t *queue = transfer->send_queue;
+  int n;
+
+  pthread_mutex_lock(&queue->mutex);
+  if(queue->length == 0)
+  {
+    n = queue->closed ? -1 : 0;
+  }
+  else if(transfer->datagram)
+  {
+    n = queue_read_entry(queue, payload);
+  }
+  else
+  {
+    n = MIN(queue->length, payload_size);
+    queue_read(queue, payload, n);
+  }
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->mutex);
+
+  return(n);
+}
+
+/* Wait at most 'timeout' seconds for more data to send. With the send queue
+ * or a TUN interface, the transmitter is woken up as soon as data is ready,
+ * otherwise the data callback has to be polled. */
+void wait_for_data(ofdm_transfer_t transfer, double timeout)
+{
+  struct timespec deadline;
+  struct timeval delay;
+  fd_set fds;
+
+  if(transfer->data_callback == read_tun)
+  {
+    FD_ZERO(&fds);
+    FD_SET(transfer->tun_fd, &fds);
+    delay.tv_sec = floor(timeout);
+    delay.tv_usec = (timeout - delay.tv_sec) * 1000000;
+    select(transfer->tun_fd + 1, &fds, NULL, NULL, &delay);
+    return;
+  }
+  if(transfer->data_callback != read_queue)
+  {
+    usleep(MIN(timeout * 1000000, 1000));
+    return;
+  }
+
+  get_deadline(&deadline, timeout * 1000);
+  pthread_mutex_lock(&transfer->send_queue->mutex);
+  while((transfer->send_queue->length == 0) &&
+        (!transfer->send_queue->closed) &&
+        (!stop) &&
+        (!transfer->stop))
+  {
+    if(pthread_cond_timedwait(&transfer->send_queue->not_empty,
+                              &transfer->send_queue->mutex,
+                              &deadline) == ETIMEDOUT)
+    {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&transfer->send_queue->mutex);
+}
+
 void write_audio(ofdm_transfer_t transfer,
                  complex float *samples,
                  unsigned int samples_size,
@@ -198,13 +1053,386 @@ unsigned int read_audio(ofdm_transfer_t transfer,
   return(n);
 }
 
-void send_to_radio(ofdm_transfer_t transfer,
-                   complex float *samples,
-                   unsigned int samples_size,
-                   int last)
+/* Set the global gain, or the gains of some elements if 'gain' is a list of
+ * keys and values; return 0 or the first SoapySDR error code */
+int set_soapysdr_gain(ofdm_transfer_t transfer, int direction, char *gain)
 {
+  SoapySDRKwargs kwargs;
   unsigned int n;
-  unsigned int size;
+  char *gain_name;
+  int gain_value;
+  int r = 0;
+
+  if(strchr(gain, '='))
+  {
+    kwargs = SoapySDRKwargs_fromString(gain);
+    for(n = 0; (n < kwargs.size) && (r == 0); n++)
+    {
+      gain_name = kwargs.keys[n];
+      gain_value = strtoul(kwargs.vals[n], NULL, 10);
+      r = SoapySDRDevice_setGainElement(transfer->radio_device.soapysdr,
+                                        direction,
+                                        0,
+                                        gain_name,
+                                        gain_value);
+    }
+    SoapySDRKwargs_clear(&kwargs);
+  }
+  else
+  {
+    gain_value = strtoul(gain, NULL, 10);
+    r = SoapySDRDevice_setGain(transfer->radio_device.soapysdr,
+                               direction,
+                               0,
+                               gain_value);
+  }
+
+  return(r);
+}
+
+/* Set the sample rate, frequency and gain of the radio for the transmit or
+ * receive direction, and get a stream for this direction */
+SoapySDRStream * setup_soapysdr_stream(ofdm_transfer_t transfer,
+                                       unsigned char emit,
+                                       char *gain)
+{
+  int direction = emit ? SOAPY_SDR_TX : SOAPY_SDR_RX;
+  SoapySDRStream *stream;
+
+  /* Keep the gain to set it again if the radio has to be reopened */
+  if(gain != transfer->radio_gain[direction])
+  {
+    free(transfer->radio_gain[direction]);
+    transfer->radio_gain[direction] = strdup(gain);
+    if(transfer->radio_gain[direction] == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(NULL);
+    }
+  }
+  SOAPYSDR_CHECK(SoapySDRDevice_setSampleRate(transfer->radio_device.soapysdr,
+                                              direction,
+                                              0,
+                                              transfer->sample_rate));
+  SOAPYSDR_CHECK(SoapySDRDevice_setFrequency(transfer->radio_device.soapysdr,
+                                             direction,
+                                             0,
+                                             transfer->frequency - transfer->frequency_offset,
+                                             NULL));
+  SOAPYSDR_CHECK(set_soapysdr_gain(transfer, direction, gain));
+  stream = SoapySDRDevice_setupStream(transfer->radio_device.soapysdr,
+                                      direction,
+                                      SOAPY_SDR_CF32,
+                                      NULL,
+                                      0,
+                                      NULL);
+  if(stream == NULL)
+  {
+    fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
+  }
+
+  return(stream);
+}
+
+/* Close the stream of the current direction, then set it up and activate it
+ * again. The device lock must be held. */
+int restart_stream(ofdm_transfer_t transfer)
+{
+  int direction = transfer->emit ? SOAPY_SDR_TX : SOAPY_SDR_RX;
+  SoapySDRStream *stream;
+
+  if(transfer->radio_stream.soapysdr)
+  {
+    SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                               transfer->radio_stream.soapysdr);
+    transfer->radio_stream.soapysdr = NULL;
+  }
+  stream = setup_soapysdr_stream(transfer,
+                                 transfer->emit,
+                                 transfer->radio_gain[direction]);
+  if(stream == NULL)
+  {
+    return(-1);
+  }
+  transfer->radio_stream.soapysdr = stream;
+  if(SoapySDRDevice_activateStream(transfer->radio_device.soapysdr,
+                                   stream,
+                                   0,
+                                   0,
+                                   0) != 0)
+  {
+    return(-1);
+  }
+  transfer->radio_stream_active = 1;
+
+  return(0);
+}
+
+/* Open the radio again, and set up and activate the stream of the current
+ * direction. The device lock must be held. */
+int reopen_radio(ofdm_transfer_t transfer)
+{
+  unsigned int n;
+
+  if(transfer->radio_stream.soapysdr)
+  {
+    SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                               transfer->radio_stream.soapysdr);
+    transfer->radio_stream.soapysdr = NULL;
+  }
+  if(transfer->other_radio_stream.soapysdr)
+  {
+    /* Set up again by the next ofdm_transfer_set_direction() */
+    SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                               transfer->other_radio_stream.soapysdr);
+    transfer->other_radio_stream.soapysdr = NULL;
+  }
+  SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
+  transfer->radio_device.soapysdr = NULL;
+
+  for(n = 0; (n < STREAM_MAX_REOPENS) && (!stop) && (!transfer->stop); n++)
+  {
+    usleep(STREAM_REOPEN_DELAY);
+    transfer->radio_device.soapysdr = SoapySDRDevice_makeStrArgs(transfer->radio_args);
+    if(transfer->radio_device.soapysdr == NULL)
+    {
+      continue;
+    }
+    if(restart_stream(transfer) == 0)
+    {
+      return(0);
+    }
+    if(transfer->radio_stream.soapysdr)
+    {
+      SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                                 transfer->radio_stream.soapysdr);
+      transfer->radio_stream.soapysdr = NULL;
+    }
+    SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
+    transfer->radio_device.soapysdr = NULL;
+  }
+
+  return(-1);
+}
+
+/* Try to make a broken radio stream work again, by reactivating it, then by
+ * setting it up again, then by opening the radio again (only if the radio is
+ * not shared with a reverse transfer). Each new attempt without samples
+ * going through in between starts one step further. The modems and the
+ * counters are kept.
+ * Return -1 if the radio can't be recovered. */
+int recover_stream(ofdm_transfer_t transfer)
+{
+  int r = -1;
+
+  if(transfer->recovery_level == 0)
+  {
+    transfer->recovery_start = get_monotonic_time();
+    if(verbose)
+    {
+      fprintf(stderr, _("Info: Radio stream broken, recovering\n"));
+    }
+  }
+  transfer->recovery_level++;
+  if(transfer->recovery_level > STREAM_MAX_RECOVERIES)
+  {
+    fprintf(stderr, _("Error: The radio stream can't be recovered\n"));
+    return(-1);
+  }
+
+  lock_device(transfer);
+  if(transfer->radio_stream_active)
+  {
+    SoapySDRDevice_deactivateStream(transfer->radio_device.soapysdr,
+                                    transfer->radio_stream.soapysdr,
+                                    0,
+                                    0);
+    transfer->radio_stream_active = 0;
+  }
+  if(transfer->recovery_level == 1)
+  {
+    r = SoapySDRDevice_activateStream(transfer->radio_device.soapysdr,
+                                      transfer->radio_stream.soapysdr,
+                                      0,
+                                      0,
+                                      0);
+    if(r == 0)
+    {
+      transfer->radio_stream_active = 1;
+    }
+  }
+  if((r != 0) &&
+     ((transfer->recovery_level <= 2) || transfer->shared_device))
+  {
+    r = restart_stream(transfer);
+  }
+  if((r != 0) && (transfer->shared_device == NULL))
+  {
+    r = reopen_radio(transfer);
+  }
+  unlock_device(transfer);
+
+  if(r != 0)
+  {
+    fprintf(stderr, _("Error: The radio stream can't be recovered\n"));
+    return(-1);
+  }
+  if(!transfer->emit)
+  {
+    transfer->next_timestamp_valid = 0;
+    transfer->resync_needed = 1;
+  }
+
+  return(0);
+}
+
+/* Count a result of a read or write of the radio stream, and try to recover
+ * the stream when it has failed too many times in a row. Return -1 if the
+ * stream is broken and can't be recovered. */
+int check_stream(ofdm_transfer_t transfer, int r)
+{
+  if(r > 0)
+  {
+    if(transfer->recovery_level > 0)
+    {
+      transfer->stats.radio_recoveries++;
+      transfer->stats.radio_recovery_time = 1000 * (get_monotonic_time() -
+                                                    transfer->recovery_start);
+      if(verbose)
+      {
+        fprintf(stderr,
+                _("Info: Radio stream recovered in %u ms\n"),
+                transfer->stats.radio_recovery_time);
+      }
+      transfer->recovery_level = 0;
+    }
+    transfer->stream_failures = 0;
+    return(0);
+  }
+  if((r == SOAPY_SDR_OVERFLOW) ||
+     (r == SOAPY_SDR_UNDERFLOW) ||
+     (r == SOAPY_SDR_TIME_ERROR))
+  {
+    /* Samples lost, but the stream works */
+    return(0);
+  }
+
+  transfer->stream_failures++;
+  if(transfer->stream_failures < STREAM_MAX_FAILURES)
+  {
+    return(0);
+  }
+  transfer->stream_failures = 0;
+  if(recover_stream(transfer) != 0)
+  {
+    transfer->radio_failed = 1;
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* Count an error returned by the radio */
+void count_radio_error(ofdm_transfer_t transfer, int error)
+{
+  switch(error)
+  {
+  case SOAPY_SDR_OVERFLOW:
+    transfer->stats.radio_overflows++;
+    break;
+
+  case SOAPY_SDR_UNDERFLOW:
+    transfer->stats.radio_underflows++;
+    break;
+
+  case SOAPY_SDR_TIMEOUT:
+    transfer->stats.radio_timeouts++;
+    break;
+
+  case SOAPY_SDR_TIME_ERROR:
+    transfer->stats.radio_time_errors++;
+    break;
+
+  default:
+    transfer->stats.radio_errors++;
+    break;
+  }
+}
+
+/* Count the underflows and other asynchronous errors reported by the radio
+ * while sending, without waiting. At most STREAM_STATUS_MAX_READS events are
+ * read at each call, and any other error stops the reading. */
+void check_stream_status(ofdm_transfer_t transfer)
+{
+  size_t mask = 0;
+  int flags = 0;
+  long long int timestamp = 0;
+  unsigned int i;
+  int r;
+
+  for(i = 0;
+      (i < STREAM_STATUS_MAX_READS) && (!transfer->stream_status_unsupported);
+      i++)
+  {
+    r = SoapySDRDevice_readStreamStatus(transfer->radio_device.soapysdr,
+                                        transfer->radio_stream.soapysdr,
+                                        &mask,
+                                        &flags,
+                                        &timestamp,
+                                        0);
+    switch(r)
+    {
+    case SOAPY_SDR_NOT_SUPPORTED:
+      transfer->stream_status_unsupported = 1;
+      break;
+
+    case SOAPY_SDR_UNDERFLOW:
+    case SOAPY_SDR_OVERFLOW:
+    case SOAPY_SDR_TIME_ERROR:
+      count_radio_error(transfer, r);
+      break;
+
+    case 0:
+    case SOAPY_SDR_TIMEOUT:
+      return;
+
+    default:
+      count_radio_error(transfer, r);
+      return;
+    }
+  }
+}
+
+/* Estimate the number of samples lost since the previous read using the
+ * timestamps of the samples */
+void check_timestamp(ofdm_transfer_t transfer,
+                     long long int timestamp,
+                     unsigned int samples_size)
+{
+  double ns_per_sample = 1000000000.0 / transfer->sample_rate;
+  long long int lost;
+
+  if(transfer->next_timestamp_valid &&
+     (timestamp > transfer->next_timestamp))
+  {
+    lost = llround((timestamp - transfer->next_timestamp) / ns_per_sample);
+    if(lost > 0)
+    {
+      transfer->stats.samples_lost += lost;
+      transfer->resync_needed = 1;
+    }
+  }
+  transfer->next_timestamp = timestamp + llround(samples_size * ns_per_sample);
+  transfer->next_timestamp_valid = 1;
+}
+
+void send_to_radio(ofdm_transfer_t transfer,
+                   complex float *samples,
+                   unsigned int samples_size,
+                   int last)
+{
+  unsigned int n;
+  unsigned int size;
   int flags = 0;
   size_t mask = 0;
   long long int timestamp = 0;
@@ -227,6 +1455,12 @@ void send_to_radio(ofdm_transfer_t transfer,
     {
       fwrite(samples, sizeof(complex float), samples_size, stdout);
     }
+    if(transfer->latency > 0)
+    {
+      /* Don't keep the samples in the buffer of stdout longer than the
+       * duration of a block */
+      fflush(stdout);
+    }
     break;
 
   case FILENAME:
@@ -245,7 +1479,10 @@ void send_to_radio(ofdm_transfer_t transfer,
 
   case SOAPYSDR:
     n = 0;
-    while((n < samples_size) && (!stop) && (!transfer->stop))
+    while((n < samples_size) &&
+          (!stop) &&
+          (!transfer->stop) &&
+          (!transfer->radio_failed))
     {
       buffers[0] = &samples[n];
       size = samples_size - n;
@@ -260,7 +1497,17 @@ void send_to_radio(ofdm_transfer_t transfer,
       {
         n += r;
       }
+      else if(r < 0)
+      {
+        count_radio_error(transfer, r);
+      }
+      check_stream(transfer, r);
+    }
+    if(transfer->radio_failed)
+    {
+      break;
     }
+    check_stream_status(transfer);
     if(last)
     {
       /* Complete the remaining buffer to ensure that SoapySDR
@@ -270,7 +1517,10 @@ void send_to_radio(ofdm_transfer_t transfer,
                                          transfer->radio_stream.soapysdr);
       bzero(samples, samples_size * sizeof(complex float));
       buffers[0] = samples;
-      while((size > 0) && (!stop) && (!transfer->stop))
+      while((size > 0) &&
+            (!stop) &&
+            (!transfer->stop) &&
+            (!transfer->radio_failed))
       {
         n = (samples_size < size) ? samples_size : size;
         r = SoapySDRDevice_writeStream(transfer->radio_device.soapysdr,
@@ -284,6 +1534,15 @@ void send_to_radio(ofdm_transfer_t transfer,
         {
           size -= r;
         }
+        else if(r < 0)
+        {
+          count_radio_error(transfer, r);
+        }
+        check_stream(transfer, r);
+      }
+      if(transfer->radio_failed)
+      {
+        break;
       }
       do
       {
@@ -341,6 +1600,10 @@ unsigned int receive_from_radio(ofdm_transfer_t transfer,
     break;
 
   case SOAPYSDR:
+    if(transfer->radio_failed)
+    {
+      break;
+    }
     buffers[0] = samples;
     r = SoapySDRDevice_readStream(transfer->radio_device.soapysdr,
                                   transfer->radio_stream.soapysdr,
@@ -352,789 +1615,4997 @@ unsigned int receive_from_radio(ofdm_transfer_t transfer,
     if(r >= 0)
     {
       n = r;
+      if(flags & SOAPY_SDR_END_ABRUPT)
+      {
+        /* Overflow reported with the samples before it */
+        transfer->stats.radio_overflows++;
+        transfer->resync_needed = 1;
+      }
+      if(flags & SOAPY_SDR_HAS_TIME)
+      {
+        check_timestamp(transfer, timestamp, n);
+      }
     }
+    else
+    {
+      count_radio_error(transfer, r);
+      if(r == SOAPY_SDR_OVERFLOW)
+      {
+        transfer->resync_needed = 1;
+      }
+    }
+    check_stream(transfer, r);
     break;
   }
   return(n);
 }
 
-unsigned int bits_per_symbol(modulation_scheme modulation)
+/* Initial size in bytes of the payload of the frames */
+unsigned int get_payload_size(ofdm_transfer_t transfer)
 {
-  unsigned int n;
+  unsigned int byte_rate = transfer->bit_rate / 8;
 
-  switch(modulation)
+  if(transfer->latency == 0)
   {
-  case LIQUID_MODEM_BPSK:
-    n = 1;
-    break;
-
-  case LIQUID_MODEM_QPSK:
-    n = 2;
-    break;
-
-  case LIQUID_MODEM_PSK8:
-    n = 3;
-    break;
-
-  case LIQUID_MODEM_APSK16:
-    n = 4;
-    break;
+    /* Throughput mode */
+    return(transfer->maximum_payload_size);
+  }
+  /* Try to make frames lasting approximately the latency, but respecting the
+   * payload size bounds */
+  return(MIN(MAX((byte_rate * transfer->latency) / 1000,
+                 transfer->minimum_payload_size),
+             transfer->maximum_payload_size));
+}
 
-  case LIQUID_MODEM_APSK32:
-    n = 5;
-    break;
+void send_dummy_samples(ofdm_transfer_t transfer, int last)
+{
+  unsigned int n;
 
-  case LIQUID_MODEM_APSK64:
-    n = 6;
-    break;
+  n = ofdm_modem_modulate_end(transfer->modulator, transfer->samples);
+  send_to_radio(transfer, transfer->samples, n, last);
+}
 
-  case LIQUID_MODEM_APSK128:
-    n = 7;
-    break;
+/* Fill the configuration of a modem for the settings of a transfer */
+void get_modem_config(ofdm_transfer_t transfer,
+                      struct ofdm_modem_config_s *config)
+{
+  ofdm_modem_config_init_default(config);
+  config->emit = transfer->emit;
+  config->sample_rate = transfer->sample_rate;
+  config->bit_rate = transfer->bit_rate;
+  config->frequency_offset = transfer->frequency_offset;
+  config->subcarrier_modulation = transfer->subcarrier_modulation;
+  config->subcarriers = transfer->subcarriers;
+  config->cyclic_prefix_length = transfer->cyclic_prefix_length;
+  config->taper_length = transfer->taper_length;
+  config->inner_fec = transfer->inner_fec;
+  config->outer_fec = transfer->outer_fec;
+  config->id = transfer->id;
+  config->latency = transfer->latency;
+}
 
-  case LIQUID_MODEM_APSK256:
-    n = 8;
-    break;
+/* Make sure that the buffer used to exchange samples with the radio can hold
+ * a block of samples of a modem */
+int get_samples_buffer(ofdm_transfer_t transfer, ofdm_modem_t modem)
+{
+  unsigned int size = ofdm_modem_get_block_size(modem);
+  complex float *samples;
 
-  default:
-    n = 1;
-    break;
+  if(size > transfer->samples_size)
+  {
+    samples = realloc(transfer->samples, size * sizeof(complex float));
+    if(samples == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+    transfer->samples = samples;
+    transfer->samples_size = size;
   }
-  return(n);
-}
 
-void set_counter(unsigned char *header, unsigned int counter)
-{
-  header[4] = (counter >> 24) & 255;
-  header[5] = (counter >> 16) & 255;
-  header[6] = (counter >> 8) & 255;
-  header[7] = counter & 255;
+  return(0);
 }
 
-unsigned int get_counter(unsigned char *header)
+void modulator_free(ofdm_transfer_t transfer)
 {
-  return((header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]);
+  if(transfer->modulator)
+  {
+    /* Keep numbering the frames if the modulator is created again */
+    transfer->counter = ofdm_modem_get_counter(transfer->modulator);
+    ofdm_modem_free(transfer->modulator);
+    transfer->modulator = NULL;
+  }
 }
 
-void send_dummy_samples(ofdm_transfer_t transfer,
-                        msresamp_crcf resampler,
-                        nco_crcf oscillator,
-                        complex float *samples,
-                        unsigned int delay,
-                        int last)
+/* Create the modem used to send frames, or only reset it if it was already
+ * created by a previous transfer */
+int modulator_prepare(ofdm_transfer_t transfer)
 {
-  unsigned int i;
-  unsigned int n;
-  complex float zero_sample = 0;
+  struct ofdm_modem_config_s config;
+  unsigned char *payload;
 
-  for(i = 0; i < delay; i++)
+  payload = realloc(transfer->payload, transfer->maximum_payload_size);
+  if(payload == NULL)
   {
-    msresamp_crcf_execute(resampler, &zero_sample, 1, samples, &n);
-    if(transfer->frequency_offset != 0)
-    {
-      nco_crcf_mix_block_up(oscillator, samples, samples, n);
-    }
-    if(i + 1 < delay)
-    {
-      send_to_radio(transfer, samples, n, 0);
-    }
-    else
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  transfer->payload = payload;
+  if(transfer->step_mode)
+  {
+    payload = realloc(transfer->coalesce_buffer,
+                      transfer->maximum_payload_size);
+    if(payload == NULL)
     {
-      send_to_radio(transfer, samples, n, last);
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
     }
+    transfer->coalesce_buffer = payload;
+  }
+  transfer->coalesce_size = 0;
+
+  if(transfer->modulator)
+  {
+    ofdm_modem_reset(transfer->modulator);
+    ofdm_modem_set_frequency_offset(transfer->modulator,
+                                    transfer->frequency_offset);
+    ofdm_modem_set_id(transfer->modulator, transfer->id);
+    return(0);
+  }
+
+  get_modem_config(transfer, &config);
+  transfer->modulator = ofdm_modem_create(&config);
+  if(transfer->modulator == NULL)
+  {
+    return(-1);
   }
+  ofdm_modem_set_counter(transfer->modulator, transfer->counter);
+
+  return(get_samples_buffer(transfer, transfer->modulator));
 }
 
-void send_frames(ofdm_transfer_t transfer)
+/* Get the data to put in the payload of the next frame when the transfer is
+ * driven with ofdm_transfer_process(). The step must not block, so instead of
+ * waiting for more data, the data received so far is kept in the coalescing
+ * buffer and 0 is returned until the payload is full or the coalescing delay
+ * has elapsed. */
+int get_payload_step(ofdm_transfer_t transfer,
+                     unsigned char *payload,
+                     unsigned int payload_size)
 {
-  unsigned int subcarrier_symbol_bits = bits_per_symbol(transfer->subcarrier_modulation);
-  float samples_per_bit = 2.0 / subcarrier_symbol_bits;
-  ofdmflexframegenprops_s frame_properties;
-  ofdmflexframegen frame_generator;
-  float resampling_ratio = (float) transfer->sample_rate / (transfer->bit_rate *
-                                                            samples_per_bit);
-  msresamp_crcf resampler = msresamp_crcf_create(resampling_ratio, 60);
-  unsigned int delay = ceilf(msresamp_crcf_get_delay(resampler));
-  unsigned int header_size = 8;
-  unsigned char header[header_size];
-  /* Try to make frames of approximately 100 ms, but containing at least
-   * 16 bytes and at most 8000 bytes of payload */
-  unsigned int byte_rate = transfer->bit_rate / 8;
-  unsigned int payload_size = MIN(MAX(byte_rate * 0.1, 16), 8000);
+  unsigned char *buffer = transfer->coalesce_buffer;
+  unsigned int n = transfer->coalesce_size;
+  unsigned int size;
   int r;
-  unsigned int n;
-  unsigned int i;
-  /* Process data by blocks of 50 ms */
-  unsigned int frame_samples_size = ceilf((transfer->bit_rate *
-                                           samples_per_bit) / 20.0);
-  unsigned int samples_size = ceilf((frame_samples_size + delay) * resampling_ratio);
-  int frame_complete;
-  float center_frequency = (float) transfer->frequency_offset / transfer->sample_rate;
-  nco_crcf oscillator = nco_crcf_create(LIQUID_NCO);
-  float maximum_amplitude = 1;
-  unsigned int counter = 0;
-  unsigned char *payload = malloc(payload_size);
-  complex float *frame_samples = malloc(frame_samples_size * sizeof(complex float));
-  complex float *samples = malloc(samples_size * sizeof(complex float));
-
-  if((payload == NULL) || (frame_samples == NULL) || (samples == NULL))
+
+  while(n < payload_size)
   {
-    fprintf(stderr, _("Error: Memory allocation failed\n"));
-    exit(EXIT_FAILURE);
-  }
-
-  nco_crcf_set_phase(oscillator, 0);
-  nco_crcf_set_frequency(oscillator, TAU * center_frequency);
-
-  ofdmflexframegenprops_init_default(&frame_properties);
-  frame_properties.check = transfer->crc;
-  frame_properties.fec0 = transfer->inner_fec;
-  frame_properties.fec1 = transfer->outer_fec;
-  frame_properties.mod_scheme = transfer->subcarrier_modulation;
-  frame_generator = ofdmflexframegen_create(transfer->subcarriers,
-                                            transfer->cyclic_prefix_length,
-                                            transfer->taper_length,
-                                            NULL,
-                                            &frame_properties);
-  ofdmflexframegen_set_header_props(frame_generator, &frame_properties);
-  ofdmflexframegen_set_header_len(frame_generator, header_size);
-  memcpy(header, transfer->id, 4);
-  set_counter(header, counter);
-
-  while((!stop) && (!transfer->stop))
-  {
-    r = transfer->data_callback(transfer->callback_context, payload, payload_size);
+    r = transfer->data_callback(transfer->callback_context,
+                                buffer + n,
+                                payload_size - n);
     if(r < 0)
     {
-      break;
+      if(n == 0)
+      {
+        return(r);
+      }
+      /* Send the data we already have, the end of the stream will be
+       * signalled at the next call */
+      transfer->input_finished = 1;
+      break;
     }
-    n = r;
-    if(n > 0)
+    else if(r == 0)
     {
-      ofdmflexframegen_assemble(frame_generator, header, payload, n);
-      frame_complete = 0;
-      while(!frame_complete)
+      if((n == 0) || (get_monotonic_time() < transfer->coalesce_deadline))
       {
-        frame_complete = ofdmflexframegen_write(frame_generator,
-                                                frame_samples,
-                                                frame_samples_size);
-        n = frame_samples_size;
-        if(frame_complete)
-        {
-          /* Don't send the padding 0 bytes */
-          while((n > 0) && (frame_samples[n - 1] == 0))
-          {
-            n--;
-          }
-        }
-        /* Reduce the amplitude of samples because the frame generator and
-         * the resampler may produce samples with an amplitude greater than
-         * 1.0 depending on the number of carriers and resampling ratio */
-        maximum_amplitude = 1;
-        for(i = 0; i < n; i++)
-        {
-          if(cabsf(frame_samples[i]) > maximum_amplitude)
-          {
-            maximum_amplitude = cabsf(frame_samples[i]);
-          }
-        }
-        liquid_vectorcf_mulscalar(frame_samples,
-                                  n,
-                                  0.75 / maximum_amplitude,
-                                  frame_samples);
-        msresamp_crcf_execute(resampler, frame_samples, n, samples, &n);
-        if(transfer->frequency_offset != 0)
-        {
-          nco_crcf_mix_block_up(oscillator, samples, samples, n);
-        }
-        send_to_radio(transfer, samples, n, 0);
+        transfer->coalesce_size = n;
+        return(0);
       }
-      counter++;
-      set_counter(header, counter);
+      break;
     }
-    else
+    if(n == 0)
     {
-      /* Underrun when reading from stdin. Send some dummy samples to get the
-       * remaining output samples for the end of current frame (because of
-       * resampler and filter delays) and send them */
-      send_dummy_samples(transfer,
-                         resampler,
-                         oscillator,
-                         samples,
-                         delay,
-                         0);
+      transfer->coalesce_deadline = get_monotonic_time() +
+        (transfer->coalescing_delay / 1000.0);
     }
+    n += r;
   }
 
-  /* Send some dummy samples to get the remaining output samples (because of
-   * resampler and filter delays) */
-  send_dummy_samples(transfer,
-                     resampler,
-                     oscillator,
-                     samples,
-                     delay,
-                     1);
-
-  free(samples);
-  free(frame_samples);
-  free(payload);
-  nco_crcf_destroy(oscillator);
-  msresamp_crcf_destroy(resampler);
-  ofdmflexframegen_destroy(frame_generator);
+  /* The payload size may have been reduced since the data was received */
+  size = MIN(n, payload_size);
+  memcpy(payload, buffer, size);
+  memmove(buffer, buffer + size, n - size);
+  transfer->coalesce_size = n - size;
+  return(size);
 }
 
-int frame_received(unsigned char *header,
-                   int header_valid,
-                   unsigned char *payload,
-                   unsigned int payload_size,
-                   int payload_valid,
-                   framesyncstats_s stats,
-                   void *user_data)
+/* Get the data to put in the payload of the next frame.
+ * When coalescing is enabled, the data callback is called until the payload
+ * is full or until the coalescing delay has elapsed since some data was
+ * received, to avoid sending many small frames for a stream of small
+ * writes. */
+int get_payload(ofdm_transfer_t transfer,
+                unsigned char *payload,
+                unsigned int payload_size)
 {
-  ofdm_transfer_t transfer = (ofdm_transfer_t) user_data;
-  char id[5];
-  unsigned int counter;
+  int r;
+  unsigned int n;
+  double deadline;
+  double remaining;
 
-  transfer->timeout_start = time(NULL);
-  memcpy(id, header, 4);
-  id[4] = '\0';
-  counter = get_counter(header);
+  if(transfer->input_finished)
+  {
+    return(-1);
+  }
+  if(transfer->step_mode)
+  {
+    return(get_payload_step(transfer, payload, payload_size));
+  }
 
-  if(!header_valid || !payload_valid)
+  r = transfer->data_callback(transfer->callback_context, payload, payload_size);
+  if((r <= 0) || (transfer->coalescing_delay == 0))
   {
-    if(verbose)
-    {
-      if(!header_valid)
-      {
-        fprintf(stderr, _("Frame %u for '%s': corrupted header\n"), counter, id);
-      }
-      if(!payload_valid)
-      {
-        fprintf(stderr, _("Frame %u for '%s': corrupted payload\n"), counter, id);
-      }
-      fflush(stderr);
-    }
+    return(r);
   }
-  else if(memcmp(id, transfer->id, 4) != 0)
+
+  n = r;
+  deadline = get_monotonic_time() + (transfer->coalescing_delay / 1000.0);
+  while((n < payload_size) && (!stop) && (!transfer->stop))
   {
-    if(verbose)
+    remaining = deadline - get_monotonic_time();
+    if(remaining <= 0)
     {
-      fprintf(stderr, _("Frame %u for '%s': ignored\n"), counter, id);
-      fflush(stderr);
+      break;
     }
+    r = transfer->data_callback(transfer->callback_context,
+                                payload + n,
+                                payload_size - n);
+    if(r < 0)
+    {
+      /* Send the data we already have, the end of the stream will be
+       * signalled at the next call */
+      transfer->input_finished = 1;
+      break;
+    }
+    else if(r == 0)
+    {
+      wait_for_data(transfer, remaining);
+    }
+    n += r;
   }
-  else
-  {
-    transfer->data_callback(transfer->callback_context, payload, payload_size);
-  }
-  return(0);
+
+  return(n);
 }
 
-void receive_frames(ofdm_transfer_t transfer)
+/* Pack messages into the payload of the next frame (datagram mode).
+ * The messages that don't fit in the remaining space are sent in the next
+ * frame, and the messages that don't fit in a whole frame are
+ * fragmented. */
+int get_datagram_payload(ofdm_transfer_t transfer,
+                         unsigned char *payload,
+                         unsigned int payload_size)
 {
-  unsigned int subcarrier_symbol_bits = bits_per_symbol(transfer->subcarrier_modulation);
-  float samples_per_bit = 2.0 / subcarrier_symbol_bits;
-  ofdmflexframegenprops_s frame_properties;
-  ofdmflexframesync frame_synchronizer;
-  float resampling_ratio = (transfer->bit_rate *
-                            samples_per_bit) / (float) transfer->sample_rate;
-  msresamp_crcf resampler = msresamp_crcf_create(resampling_ratio, 60);
-  unsigned int delay = ceilf(msresamp_crcf_get_delay(resampler));
-  unsigned int header_size = 8;
-  unsigned int n;
-  /* Process data by blocks of 50 ms */
-  unsigned int frame_samples_size = ceilf((transfer->bit_rate *
-                                           samples_per_bit) / 20.0);
-  unsigned int samples_size = floorf(frame_samples_size / resampling_ratio);
-  nco_crcf oscillator = nco_crcf_create(LIQUID_NCO);
-  complex float *frame_samples = malloc((frame_samples_size + delay) *
-                                        sizeof(complex float));
-  complex float *samples = malloc((samples_size + delay) *
-                                  sizeof(complex float));
-
-  if((frame_samples == NULL) || (samples == NULL))
+  unsigned char *frame = payload;
+  int r;
+  unsigned int n = 0;
+  unsigned int space;
+  unsigned int size;
+  unsigned int fragment_header;
+  double deadline = 0;
+  double remaining;
+
+  if(transfer->step_mode)
   {
-    fprintf(stderr, _("Error: Memory allocation failed\n"));
-    exit(EXIT_FAILURE);
+    /* Continue the frame started at the previous step */
+    payload = transfer->coalesce_buffer;
+    n = transfer->coalesce_size;
+    deadline = transfer->coalesce_deadline;
   }
 
-  nco_crcf_set_phase(oscillator, 0);
-  nco_crcf_set_frequency(oscillator, TAU * ((float) transfer->frequency_offset /
-                                            transfer->sample_rate));
+  while((n + DATAGRAM_HEADER_SIZE < payload_size) &&
+        (!stop) &&
+        (!transfer->stop))
+  {
+    space = payload_size - n - DATAGRAM_HEADER_SIZE;
 
-  frame_synchronizer = ofdmflexframesync_create(transfer->subcarriers,
-                                                transfer->cyclic_prefix_length,
-                                                transfer->taper_length,
-                                                NULL,
-                                                frame_received,
-                                                transfer);
-  frame_properties.check = transfer->crc;
-  frame_properties.fec0 = transfer->inner_fec;
-  frame_properties.fec1 = transfer->outer_fec;
-  frame_properties.mod_scheme = transfer->subcarrier_modulation;
-  ofdmflexframesync_set_header_props(frame_synchronizer, &frame_properties);
-  ofdmflexframesync_set_header_len(frame_synchronizer, header_size);
+    if(transfer->message_offset < transfer->message_size)
+    {
+      /* Pending message */
+      size = transfer->message_size - transfer->message_offset;
+      if((n > 0) && (size > space) &&
+         (size <= payload_size - DATAGRAM_HEADER_SIZE))
+      {
+        /* Don't fragment a message that fits in the next frame */
+        break;
+      }
+      size = MIN(MIN(size, space), DATAGRAM_MAX_FRAGMENT_SIZE);
+      fragment_header = size;
+      if(transfer->message_offset > 0)
+      {
+        fragment_header |= DATAGRAM_CONTINUATION;
+      }
+      if(transfer->message_offset + size < transfer->message_size)
+      {
+        fragment_header |= DATAGRAM_MORE_FRAGMENTS;
+      }
+      payload[n] = fragment_header >> 8;
+      payload[n + 1] = fragment_header & 255;
+      memcpy(&payload[n + DATAGRAM_HEADER_SIZE],
+             &transfer->message[transfer->message_offset],
+             size);
+      n += DATAGRAM_HEADER_SIZE + size;
+      transfer->message_offset += size;
+      if(fragment_header & DATAGRAM_MORE_FRAGMENTS)
+      {
+        break;
+      }
+      continue;
+    }
 
-  while((!stop) && (!transfer->stop))
-  {
-    n = receive_from_radio(transfer, samples, samples_size);
-    if((n == 0) &&
-       ((transfer->radio_type == IO) || (transfer->radio_type == FILENAME)))
+    /* Get a new message */
+    if(transfer->input_finished)
     {
       break;
     }
-    if((transfer->timeout > 0) &&
-       (time(NULL) > transfer->timeout_start + transfer->timeout))
+    r = transfer->data_callback(transfer->callback_context,
+                                transfer->message,
+                                OFDM_TRANSFER_MAX_MESSAGE_SIZE);
+    if(r < 0)
     {
-      if(verbose)
-      {
-        fprintf(stderr, _("Timeout: %d s without frames\n"), transfer->timeout);
-      }
+      transfer->input_finished = 1;
       break;
     }
-    if(transfer->dump)
+    else if(r == 0)
     {
-      dump_samples(transfer, samples, n);
+      /* No message ready. When coalescing is enabled, wait a little for more
+       * messages before sending the frame. */
+      if((n == 0) || (transfer->coalescing_delay == 0))
+      {
+        break;
+      }
+      if(deadline == 0)
+      {
+        deadline = get_monotonic_time() + (transfer->coalescing_delay / 1000.0);
+      }
+      remaining = deadline - get_monotonic_time();
+      if(remaining <= 0)
+      {
+        break;
+      }
+      if(transfer->step_mode)
+      {
+        /* Don't block in ofdm_transfer_process(), the frame will be
+         * completed at the next step */
+        transfer->coalesce_size = n;
+        transfer->coalesce_deadline = deadline;
+        return(0);
+      }
+      wait_for_data(transfer, remaining);
     }
-    if(transfer->frequency_offset != 0)
+    else
     {
-      nco_crcf_mix_block_down(oscillator, samples, samples, n);
+      transfer->message_size = MIN(r, OFDM_TRANSFER_MAX_MESSAGE_SIZE);
+      transfer->message_offset = 0;
+      transfer->stats.messages_sent++;
     }
-    msresamp_crcf_execute(resampler, samples, n, frame_samples, &n);
-    ofdmflexframesync_execute(frame_synchronizer, frame_samples, n);
   }
 
-  for(n = 0; n < delay; n++)
+  if(transfer->step_mode)
   {
-    samples[n] = 0;
+    memcpy(frame, payload, n);
+    transfer->coalesce_size = 0;
+    transfer->coalesce_deadline = 0;
   }
-  msresamp_crcf_execute(resampler, samples, delay, frame_samples, &n);
-  ofdmflexframesync_execute(frame_synchronizer, frame_samples, n);
-  while(ofdmflexframesync_is_frame_open(frame_synchronizer))
+  if((n == 0) && transfer->input_finished)
   {
-    ofdmflexframesync_execute(frame_synchronizer, samples, 1);
+    return(-1);
+  }
+  return(n);
+}
+
+/* Start sending the file from its beginning in carousel mode */
+int carousel_start_sending(ofdm_transfer_t transfer)
+{
+  carousel_t *carousel = transfer->carousel;
+  struct stat file_stat;
+
+  if((fstat(carousel->fd, &file_stat) != 0) ||
+     (file_stat.st_size > CAROUSEL_MAX_FILE_SIZE))
+  {
+    fprintf(stderr, _("Error: Invalid file for the carousel mode\n"));
+    return(-1);
   }
+  carousel->file_size = file_stat.st_size;
+  carousel->block_size = 0;
+  carousel->block = carousel->start;
+  carousel->cycle = 0;
 
-  free(samples);
-  free(frame_samples);
-  nco_crcf_destroy(oscillator);
-  msresamp_crcf_destroy(resampler);
-  ofdmflexframesync_destroy(frame_synchronizer);
+  return(0);
 }
 
-ofdm_transfer_t ofdm_transfer_create_callback(char *radio_driver,
-                                              unsigned char emit,
-                                              int (*data_callback)(void *,
-                                                                   unsigned char *,
-                                                                   unsigned int),
-                                              void *callback_context,
-                                              unsigned long int sample_rate,
-                                              unsigned int bit_rate,
-                                              unsigned long int frequency,
-                                              long int frequency_offset,
-                                              char *gain,
-                                              float ppm,
-                                              char *subcarrier_modulation,
-                                              unsigned int subcarriers,
-                                              unsigned int cyclic_prefix_length,
-                                              unsigned int taper_length,
-                                              char *inner_fec,
-                                              char *outer_fec,
-                                              char *id,
-                                              char *dump,
-                                              unsigned int timeout,
-                                              unsigned char audio)
+/* Put the next block of the file in the payload (carousel mode). The block
+ * size is set by the first frame, and the file is sent again from the
+ * beginning until 'cycles' cycles have been sent. */
+int get_carousel_payload(ofdm_transfer_t transfer,
+                         unsigned char *payload,
+                         unsigned int payload_size)
 {
-  int direction;
-  SoapySDRKwargs kwargs;
-  unsigned int n;
-  char *gain_name;
-  int gain_value;
-  ofdm_transfer_t transfer = malloc(sizeof(struct ofdm_transfer_s));
+  carousel_t *carousel = transfer->carousel;
+  unsigned long int offset;
+  unsigned int size;
+  ssize_t r;
 
-  if(transfer == NULL)
+  if(carousel->block_size == 0)
   {
-    fprintf(stderr, _("Error: Memory allocation failed\n"));
-    return(NULL);
+    if(payload_size <= CAROUSEL_HEADER_SIZE)
+    {
+      fprintf(stderr, _("Error: Payload too small for the carousel mode\n"));
+      return(-1);
+    }
+    carousel->block_size = MIN(payload_size - CAROUSEL_HEADER_SIZE, 65535);
+    carousel->blocks = carousel->file_size / carousel->block_size;
+    if((carousel->file_size % carousel->block_size) || (carousel->blocks == 0))
+    {
+      /* Incomplete last block, or single empty block for an empty file */
+      carousel->blocks++;
+    }
+    if(verbose)
+    {
+      fprintf(stderr,
+              _("Info: Sending a file of %u bytes in %u blocks\n"),
+              carousel->file_size,
+              carousel->blocks);
+    }
   }
-  bzero(transfer, sizeof(struct ofdm_transfer_s));
 
-  if(strcasecmp(radio_driver, "io") == 0)
+  if(carousel->block >= carousel->blocks)
   {
-    transfer->radio_type = IO;
+    carousel->cycle++;
+    carousel->block = 0;
   }
-  else if(strncasecmp(radio_driver, "file=", 5) == 0)
+  if(((carousel->cycles > 0) && (carousel->cycle >= carousel->cycles)) ||
+     stop ||
+     transfer->stop)
   {
-    transfer->radio_type = FILENAME;
+    return(-1);
   }
-  else
+
+  offset = (unsigned long int) carousel->block * carousel->block_size;
+  size = MIN(carousel->block_size, carousel->file_size - offset);
+  r = pread(carousel->fd, &payload[CAROUSEL_HEADER_SIZE], size, offset);
+  if(r != size)
   {
-    transfer->radio_type = SOAPYSDR;
+    fprintf(stderr, _("Error: Failed to read the file\n"));
+    return(-1);
   }
+  payload[0] = (carousel->block >> 24) & 255;
+  payload[1] = (carousel->block >> 16) & 255;
+  payload[2] = (carousel->block >> 8) & 255;
+  payload[3] = carousel->block & 255;
+  payload[4] = (carousel->block_size >> 8) & 255;
+  payload[5] = carousel->block_size & 255;
+  payload[6] = (carousel->file_size >> 24) & 255;
+  payload[7] = (carousel->file_size >> 16) & 255;
+  payload[8] = (carousel->file_size >> 8) & 255;
+  payload[9] = carousel->file_size & 255;
+  carousel->block++;
 
-  transfer->stop = 0;
-  transfer->emit = emit;
-  transfer->file = NULL;
-  transfer->data_callback = data_callback;
-  transfer->callback_context = callback_context;
+  return(CAROUSEL_HEADER_SIZE + size);
+}
 
-  if(sample_rate != 0)
+/* Get the data for the payload of the next frame in the mode of the
+ * transfer */
+int get_data_payload(ofdm_transfer_t transfer,
+                     unsigned char *payload,
+                     unsigned int payload_size)
+{
+  if(transfer->carousel)
   {
-    transfer->sample_rate = sample_rate * ((1000000.0 - ppm) / 1000000.0);
+    return(get_carousel_payload(transfer, payload, payload_size));
+  }
+  else if(transfer->datagram)
+  {
+    return(get_datagram_payload(transfer, payload, payload_size));
   }
   else
   {
-    fprintf(stderr, _("Error: Invalid sample rate\n"));
-    free(transfer);
-    return(NULL);
+    return(get_payload(transfer, payload, payload_size));
   }
+}
 
-  if(frequency != 0)
+/* Start a new session of the reliable mode */
+void arq_reset(arq_t *arq)
+{
+  unsigned int i;
+
+  pthread_mutex_lock(&arq->mutex);
+  for(i = 0; i < arq->window; i++)
   {
-    transfer->frequency = frequency * ((1000000.0 - ppm) / 1000000.0);
+    arq->slots[i].state = ARQ_SLOT_FREE;
   }
-  else
+  arq->base = 0;
+  arq->next = 0;
+  arq->ack_pending = 0;
+  arq->failed = 0;
+  arq->srtt = 0;
+  arq->rttvar = 0;
+  arq->rto = ARQ_INITIAL_RTO;
+  pthread_mutex_unlock(&arq->mutex);
+}
+
+void arq_release(arq_t *arq)
+{
+  unsigned int references;
+
+  pthread_mutex_lock(&arq->mutex);
+  arq->references--;
+  references = arq->references;
+  pthread_mutex_unlock(&arq->mutex);
+  if(references == 0)
   {
-    fprintf(stderr, _("Error: Invalid frequency\n"));
-    free(transfer);
-    return(NULL);
+    pthread_mutex_destroy(&arq->mutex);
+    free(arq->slots);
+    free(arq->buffer);
+    free(arq);
   }
+}
 
-  transfer->frequency_offset = frequency_offset;
+/* Get the payload of the next frame to send in reliable mode and put its
+ * counter in the modulator. The frames reported lost by the receiver or whose
+ * timer has expired are sent again first, then new frames are sent while the
+ * window is not full. */
+int arq_get_payload(ofdm_transfer_t transfer)
+{
+  arq_t *arq = transfer->arq;
+  arq_slot_t *slot = NULL;
+  unsigned int counter;
+  double now = get_monotonic_time();
+  int expired = 0;
+  int finished;
+  int r;
 
-  if(audio)
+  pthread_mutex_lock(&arq->mutex);
+  for(counter = arq->base; counter != arq->next; counter++)
   {
-    if((transfer->radio_type == IO) || (transfer->radio_type == FILENAME))
+    slot = &arq->slots[counter % arq->window];
+    if((slot->state == ARQ_SLOT_SENT) &&
+       (slot->lost || (now >= slot->sent_time + arq->rto)))
     {
-      transfer->audio_converter = firhilbf_create(25, 60);
-      /* The rate of audio samples is twice the rate of IQ samples */
-      transfer->sample_rate = transfer->sample_rate / 2;
-      /* -(sample_rate / 2) Hz IQ <=> 0 Hz audio
-       * (sample_rate / 2) Hz IQ <=> (sample_rate * 2) Hz audio */
-      transfer->frequency_offset = transfer->frequency - (transfer->sample_rate / 2);
-      transfer->frequency = 0;
-      gain_value = strtol(gain, NULL, 10);
-      transfer->audio_gain = powf(10, gain_value / 20.0);
+      break;
     }
-    else
+    slot = NULL;
+  }
+  if(slot)
+  {
+    if(slot->retries == ARQ_MAX_RETRIES)
     {
-      fprintf(stderr, _("Error: This radio type only supports IQ samples\n"));
-      free(transfer);
-      return(NULL);
+      fprintf(stderr,
+              _("Error: Frame %u not acknowledged after %u retries\n"),
+              counter,
+              ARQ_MAX_RETRIES);
+      arq->failed = 1;
+      pthread_mutex_unlock(&arq->mutex);
+      return(-1);
+    }
+    if(!slot->lost)
+    {
+      /* The timer has expired, the link may be slower than estimated */
+      arq->rto = MIN(arq->rto * 2, ARQ_MAX_RTO);
+      expired = 1;
     }
+    slot->lost = 0;
+    slot->retries++;
+    slot->sent_time = now;
+    memcpy(transfer->payload, slot->data, slot->size);
+    r = slot->size;
+    pthread_mutex_unlock(&arq->mutex);
+    if(expired)
+    {
+      ofdm_transfer_report_frames(transfer, 0, 1);
+    }
+    transfer->stats.frames_retransmitted++;
+    ofdm_modem_set_counter(transfer->modulator, counter);
+    return(r);
   }
-  else
+  if(arq->next - arq->base >= arq->window)
   {
-    transfer->audio_converter = NULL;
-    transfer->audio_gain = 0;
+    /* Wait for some acknowledgements */
+    pthread_mutex_unlock(&arq->mutex);
+    return(0);
   }
+  pthread_mutex_unlock(&arq->mutex);
 
-  if(bit_rate != 0)
+  if(transfer->datagram)
   {
-    transfer->bit_rate = bit_rate;
+    r = get_datagram_payload(transfer,
+                             transfer->payload,
+                             transfer->payload_size);
   }
   else
   {
-    fprintf(stderr, _("Error: Invalid bit rate\n"));
-    free(transfer);
-    return(NULL);
+    r = get_payload(transfer, transfer->payload, transfer->payload_size);
   }
-
-  transfer->subcarrier_modulation = liquid_getopt_str2mod(subcarrier_modulation);
-  switch(transfer->subcarrier_modulation)
+  if(r == 0)
   {
-  case LIQUID_MODEM_BPSK:
-  case LIQUID_MODEM_QPSK:
-  case LIQUID_MODEM_PSK8:
-  case LIQUID_MODEM_APSK16:
-  case LIQUID_MODEM_APSK32:
-  case LIQUID_MODEM_APSK64:
-  case LIQUID_MODEM_APSK128:
-  case LIQUID_MODEM_APSK256:
-    break;
-
-  default:
-    fprintf(stderr, _("Error: Invalid subcarrier modulation\n"));
-    free(transfer);
-    return(NULL);
+    return(0);
+  }
+  else if(r < 0)
+  {
+    /* The transfer is finished when all the frames have been
+     * acknowledged */
+    pthread_mutex_lock(&arq->mutex);
+    finished = (arq->base == arq->next);
+    pthread_mutex_unlock(&arq->mutex);
+    return(finished ? -1 : 0);
   }
 
-  if(subcarriers != 0)
+  pthread_mutex_lock(&arq->mutex);
+  counter = arq->next;
+  slot = &arq->slots[counter % arq->window];
+  slot->state = ARQ_SLOT_SENT;
+  slot->lost = 0;
+  slot->retries = 0;
+  slot->size = r;
+  slot->sent_time = get_monotonic_time();
+  memcpy(slot->data, transfer->payload, r);
+  arq->next++;
+  pthread_mutex_unlock(&arq->mutex);
+  ofdm_modem_set_counter(transfer->modulator, counter);
+
+  return(r);
+}
+
+/* Update the estimation of the round trip time, and the timeout after which
+ * the frames are sent again */
+void arq_update_rtt(arq_t *arq, double rtt)
+{
+  if(arq->srtt == 0)
   {
-    transfer->subcarriers = subcarriers;
+    arq->srtt = rtt;
+    arq->rttvar = rtt / 2;
   }
   else
   {
-    fprintf(stderr, _("Error: Invalid number of subcarriers\n"));
-    free(transfer);
-    return(NULL);
+    arq->rttvar = (0.75 * arq->rttvar) + (0.25 * fabs(arq->srtt - rtt));
+    arq->srtt = (0.875 * arq->srtt) + (0.125 * rtt);
   }
+  arq->rto = MIN(MAX(arq->srtt + (4 * arq->rttvar), ARQ_MIN_RTO), ARQ_MAX_RTO);
+}
 
-  transfer->cyclic_prefix_length = cyclic_prefix_length;
-  transfer->taper_length = taper_length;
-  transfer->crc = LIQUID_CRC_32;
-
-  transfer->inner_fec = liquid_getopt_str2fec(inner_fec);
-  if(transfer->inner_fec == LIQUID_FEC_UNKNOWN)
+/* Mark a frame as acknowledged, return 1 if it was not acknowledged yet */
+int arq_acknowledge(arq_t *arq, arq_slot_t *slot, double now)
+{
+  if(slot->state != ARQ_SLOT_SENT)
   {
-    fprintf(stderr, _("Error: Invalid inner FEC\n"));
-    free(transfer);
-    return(NULL);
+    return(0);
+  }
+  slot->state = ARQ_SLOT_ACKED;
+  if(slot->retries == 0)
+  {
+    /* The round trip time of a frame sent again is ambiguous */
+    arq_update_rtt(arq, now - slot->sent_time);
   }
+  return(1);
+}
 
-  transfer->outer_fec = liquid_getopt_str2fec(outer_fec);
-  if(transfer->outer_fec == LIQUID_FEC_UNKNOWN)
+/* Data callback of the reverse transfer of a sender in reliable mode, taking
+ * the acknowledgements. The context is the transfer sending the data, whose
+ * adaptive payload size follows the frames acknowledged and lost. */
+int write_arq_ack(void *context,
+                  unsigned char *payload,
+                  unsigned int payload_size)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+  arq_t *arq = transfer->arq;
+  arq_slot_t *slot;
+  unsigned int ack_base;
+  unsigned int counter;
+  unsigned int i;
+  unsigned int acked = 0;
+  unsigned int lost = 0;
+  double now = get_monotonic_time();
+  double latest = 0;
+
+  if(payload_size < ARQ_ACK_HEADER_SIZE)
   {
-    fprintf(stderr, _("Error: Invalid outer FEC\n"));
-    free(transfer);
-    return(NULL);
+    return(payload_size);
   }
+  ack_base = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) |
+    payload[3];
 
-  if(strlen(id) <= 4)
+  pthread_mutex_lock(&arq->mutex);
+  /* All the frames before 'ack_base' have been received */
+  for(counter = arq->base;
+      (counter != arq->next) && ((int) (ack_base - counter) > 0);
+      counter++)
   {
-    strcpy(transfer->id, id);
+    acked += arq_acknowledge(arq, &arq->slots[counter % arq->window], now);
   }
-  else
+
+  /* The frames received out of order */
+  for(i = 0; i < (payload_size - ARQ_ACK_HEADER_SIZE) * 8; i++)
   {
-    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
-    free(transfer);
-    return(NULL);
+    if(!(payload[ARQ_ACK_HEADER_SIZE + (i / 8)] & (0x80 >> (i % 8))))
+    {
+      continue;
+    }
+    counter = ack_base + 1 + i;
+    if(((int) (counter - arq->base) < 0) || ((int) (counter - arq->next) >= 0))
+    {
+      continue;
+    }
+    slot = &arq->slots[counter % arq->window];
+    acked += arq_acknowledge(arq, slot, now);
+    latest = MAX(latest, slot->sent_time);
   }
 
-  if(dump)
+  /* The frames missing before a frame that has been received are lost, send
+   * them again without waiting for their timer */
+  counter = ((int) (ack_base - arq->base) > 0) ? ack_base : arq->base;
+  for(; (int) (counter - arq->next) < 0; counter++)
   {
-    transfer->dump = fopen(dump, "wb");
-    if(transfer->dump == NULL)
+    slot = &arq->slots[counter % arq->window];
+    if((slot->state == ARQ_SLOT_SENT) &&
+       (slot->sent_time < latest) &&
+       (!slot->lost))
     {
-      fprintf(stderr, _("Error: Failed to open '%s'\n"), dump);
-      free(transfer);
-      return(NULL);
+      slot->lost = 1;
+      lost++;
     }
   }
-  else
+
+  /* Slide the window */
+  while((arq->base != arq->next) &&
+        (arq->slots[arq->base % arq->window].state == ARQ_SLOT_ACKED))
   {
-    transfer->dump = NULL;
+    arq->slots[arq->base % arq->window].state = ARQ_SLOT_FREE;
+    arq->base++;
   }
+  pthread_mutex_unlock(&arq->mutex);
+  ofdm_transfer_report_frames(transfer, acked, lost);
 
-  transfer->timeout = timeout;
+  return(payload_size);
+}
 
-  switch(transfer->radio_type)
+void gf_init_tables()
+{
+  unsigned int x = 1;
+  unsigned int i;
+
+  for(i = 0; i < 255; i++)
   {
-  case IO:
-    break;
+    gf_exp[i] = x;
+    gf_exp[i + 255] = x;
+    gf_log[x] = i;
+    x <<= 1;
+    if(x & 0x100)
+    {
+      x ^= GF_POLYNOMIAL;
+    }
+  }
+  gf_exp[510] = gf_exp[0];
+  gf_exp[511] = gf_exp[1];
+  gf_log[0] = 0;
+}
 
-  case FILENAME:
-    if(emit)
+unsigned char gf_mul(unsigned char a, unsigned char b)
+{
+  if((a == 0) || (b == 0))
+  {
+    return(0);
+  }
+  return(gf_exp[gf_log[a] + gf_log[b]]);
+}
+
+unsigned char gf_inv(unsigned char a)
+{
+  return(gf_exp[255 - gf_log[a]]);
+}
+
+/* Add 'coefficient' * 'source' to 'destination' */
+void gf_mul_add(unsigned char *destination,
+                unsigned char *source,
+                unsigned char coefficient,
+                unsigned int size)
+{
+  unsigned int log_coefficient;
+  unsigned int i;
+
+  if(coefficient == 0)
+  {
+    return;
+  }
+  log_coefficient = gf_log[coefficient];
+  for(i = 0; i < size; i++)
+  {
+    if(source[i])
     {
-      transfer->radio_device.file = fopen(radio_driver + 5, "wb");
+      destination[i] ^= gf_exp[log_coefficient + gf_log[source[i]]];
     }
-    else
+  }
+}
+
+/* Coefficient of the data frame 'data' in the parity frame 'parity' */
+unsigned char erasure_coefficient(erasure_t *erasure,
+                                  unsigned int parity,
+                                  unsigned int data)
+{
+  return(gf_inv((erasure->data_frames + parity) ^ data));
+}
+
+void erasure_free(erasure_t *erasure)
+{
+  if(erasure)
+  {
+    free(erasure->buffer);
+    free(erasure->shards);
+    free(erasure->lengths);
+    free(erasure->received);
+    free(erasure->matrix);
+    free(erasure->inverse);
+    free(erasure->missing);
+    free(erasure->rows);
+    free(erasure);
+  }
+}
+
+/* Allocate the frames of a block, large enough for the maximum payload
+ * size */
+int erasure_prepare(ofdm_transfer_t transfer)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned int frames = erasure->data_frames + erasure->parity_frames;
+  unsigned char *buffer;
+  unsigned int i;
+
+  if(transfer->maximum_payload_size <=
+     ERASURE_DATA_HEADER_SIZE + ERASURE_PARITY_HEADER_SIZE)
+  {
+    fprintf(stderr, _("Error: Payload too small for the erasure code\n"));
+    return(-1);
+  }
+  if(erasure->slot_size == transfer->maximum_payload_size)
+  {
+    return(0);
+  }
+
+  buffer = realloc(erasure->buffer, frames * transfer->maximum_payload_size);
+  if(buffer == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  erasure->buffer = buffer;
+  erasure->slot_size = transfer->maximum_payload_size;
+  for(i = 0; i < frames; i++)
+  {
+    erasure->shards[i] = &buffer[i * erasure->slot_size];
+  }
+
+  return(0);
+}
+
+/* Start a new block. When sending, 'block' is the counter of its first frame,
+ * when receiving it is the number of the block. */
+void erasure_start_block(erasure_t *erasure, unsigned int block)
+{
+  unsigned int i;
+
+  erasure->block = block;
+  erasure->block_valid = 1;
+  erasure->data_count = erasure->data_frames;
+  erasure->shard_size = 0;
+  erasure->parity_index = 0;
+  erasure->sending_parity = 0;
+  erasure->delivered = 0;
+  for(i = 0; i < erasure->data_frames + erasure->parity_frames; i++)
+  {
+    erasure->received[i] = 0;
+    erasure->lengths[i] = 0;
+  }
+}
+
+/* Start sending a new block at the first counter multiple of the block size
+ * not lower than 'counter', so that the receiver finds the position of a
+ * frame in its block from its counter */
+void erasure_start_sending(erasure_t *erasure, unsigned long long int counter)
+{
+  unsigned long long int frames = erasure->data_frames + erasure->parity_frames;
+  unsigned long long int block;
+  unsigned int i;
+
+  block = ((counter + frames - 1) / frames) * frames;
+  if(block + frames - 1 > 0xffffffff)
+  {
+    /* The counter wraps around */
+    block = 0;
+  }
+  erasure_start_block(erasure, block);
+  erasure->data_count = 0;
+  for(i = 0; i < erasure->parity_frames; i++)
+  {
+    bzero(erasure->shards[i], erasure->slot_size);
+  }
+}
+
+/* Get the payload of the next frame to send with the erasure code and put its
+ * counter in the modulator. The parity frames of a block are sent after its
+ * data frames, or earlier if no data has been ready for 'latency' ms. */
+int erasure_get_payload(ofdm_transfer_t transfer)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned char *payload = transfer->payload;
+  unsigned int size;
+  unsigned int i;
+  double delay;
+  double now;
+  int r;
+
+  if(!erasure->sending_parity)
+  {
+    size = MAX(transfer->payload_size,
+               ERASURE_DATA_HEADER_SIZE + ERASURE_PARITY_HEADER_SIZE + 1);
+    /* Leave room for the header of the parity frames */
+    size -= ERASURE_DATA_HEADER_SIZE + ERASURE_PARITY_HEADER_SIZE;
+    r = get_data_payload(transfer, &payload[ERASURE_DATA_HEADER_SIZE], size);
+    now = get_monotonic_time();
+    if(r > 0)
     {
-      transfer->radio_device.file = fopen(radio_driver + 5, "rb");
+      payload[0] = r >> 8;
+      payload[1] = r & 255;
+      size = ERASURE_DATA_HEADER_SIZE + r;
+      for(i = 0; i < erasure->parity_frames; i++)
+      {
+        gf_mul_add(erasure->shards[i],
+                   payload,
+                   erasure_coefficient(erasure, i, erasure->data_count),
+                   size);
+      }
+      erasure->shard_size = MAX(erasure->shard_size, size);
+      ofdm_modem_set_counter(transfer->modulator,
+                             erasure->block + erasure->data_count);
+      erasure->data_count++;
+      erasure->last_data_time = now;
+      if(erasure->data_count == erasure->data_frames)
+      {
+        erasure->sending_parity = 1;
+      }
+      return(size);
     }
-    if(transfer->radio_device.file == NULL)
+    if(erasure->data_count == 0)
     {
-      fprintf(stderr, _("Error: Failed to open '%s'\n"), radio_driver + 5);
-      free(transfer);
-      return(NULL);
+      return(r);
     }
-    break;
+    delay = (transfer->latency > 0) ?
+      transfer->latency / 1000.0 :
+      OUTPUT_THROUGHPUT_DELAY;
+    if((r == 0) && (now - erasure->last_data_time < delay))
+    {
+      return(0);
+    }
+    /* Send an incomplete block */
+    erasure->sending_parity = 1;
+  }
 
-  case SOAPYSDR:
-    transfer->radio_device.soapysdr = SoapySDRDevice_makeStrArgs(radio_driver);
-    if(transfer->radio_device.soapysdr == NULL)
+  payload[0] = erasure->data_count;
+  memcpy(&payload[ERASURE_PARITY_HEADER_SIZE],
+         erasure->shards[erasure->parity_index],
+         erasure->shard_size);
+  size = ERASURE_PARITY_HEADER_SIZE + erasure->shard_size;
+  ofdm_modem_set_counter(transfer->modulator,
+                         erasure->block +
+                         erasure->data_frames +
+                         erasure->parity_index);
+  erasure->parity_index++;
+  if(erasure->parity_index == erasure->parity_frames)
+  {
+    erasure_start_sending(erasure,
+                          (unsigned long long int) erasure->block +
+                          erasure->data_frames +
+                          erasure->parity_frames);
+  }
+
+  return(size);
+}
+
+/* Move the signal to 'frequency', with the center frequency of the radio
+ * 'frequency_offset' Hz lower */
+void retune(ofdm_transfer_t transfer,
+            unsigned long int frequency,
+            long int frequency_offset)
+{
+  long int radio_frequency = transfer->frequency - transfer->frequency_offset;
+  long int new_radio_frequency = frequency - frequency_offset;
+
+  if((transfer->radio_type == SOAPYSDR) &&
+     (new_radio_frequency != radio_frequency))
+  {
+    lock_device(transfer);
+    if(SoapySDRDevice_setFrequency(transfer->radio_device.soapysdr,
+                                   transfer->emit ? SOAPY_SDR_TX : SOAPY_SDR_RX,
+                                   0,
+                                   new_radio_frequency,
+                                   NULL) != 0)
     {
       fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
-      free(transfer);
-      return(NULL);
+      unlock_device(transfer);
+      return;
     }
-    direction = emit ? SOAPY_SDR_TX : SOAPY_SDR_RX;
-    SOAPYSDR_CHECK(SoapySDRDevice_setSampleRate(transfer->radio_device.soapysdr,
-                                                direction,
-                                                0,
-                                                transfer->sample_rate));
-    SOAPYSDR_CHECK(SoapySDRDevice_setFrequency(transfer->radio_device.soapysdr,
-                                               direction,
-                                               0,
-                                               transfer->frequency - transfer->frequency_offset,
-                                               NULL));
-    if(strchr(gain, '='))
-    {
-      kwargs = SoapySDRKwargs_fromString(gain);
-      for(n = 0; n < kwargs.size; n++)
-      {
-        gain_name = kwargs.keys[n];
-        gain_value = strtoul(kwargs.vals[n], NULL, 10);
-        SOAPYSDR_CHECK(SoapySDRDevice_setGainElement(transfer->radio_device.soapysdr,
-                                                     direction,
-                                                     0,
-                                                     gain_name,
-                                                     gain_value));
-      }
-      SoapySDRKwargs_clear(&kwargs);
+    unlock_device(transfer);
+  }
+
+  transfer->frequency = frequency;
+  transfer->frequency_offset = frequency_offset;
+  if(transfer->modulator)
+  {
+    ofdm_modem_set_frequency_offset(transfer->modulator, frequency_offset);
+  }
+  if(transfer->demodulator)
+  {
+    ofdm_modem_set_frequency_offset(transfer->demodulator, frequency_offset);
+  }
+  if(verbose)
+  {
+    fprintf(stderr,
+            _("Info: Frequency %lu Hz, offset %ld Hz\n"),
+            frequency,
+            frequency_offset);
+  }
+}
+
+/* Move the signal to 'frequency'. If the signal stays in the band received or
+ * sent by the radio, only the oscillator is retuned, otherwise the radio has
+ * to move */
+void move_to_frequency(ofdm_transfer_t transfer, unsigned long int frequency)
+{
+  unsigned int subcarrier_symbol_bits;
+  long int radio_frequency;
+  long int offset;
+  float bandwidth;
+
+  if(transfer->audio_converter)
+  {
+    /* 0 Hz audio <=> -(sample_rate / 2) Hz IQ */
+    retune(transfer, 0, frequency - (transfer->sample_rate / 2));
+    return;
+  }
+
+  subcarrier_symbol_bits = ofdm_modem_bits_per_symbol(transfer->subcarrier_modulation);
+  bandwidth = transfer->bit_rate * (2.0 / subcarrier_symbol_bits);
+  radio_frequency = transfer->frequency - transfer->frequency_offset;
+  offset = frequency - radio_frequency;
+  if((transfer->radio_type != SOAPYSDR) ||
+     (labs(offset) + (bandwidth / 2) < transfer->sample_rate / 2))
+  {
+    retune(transfer, frequency, offset);
+  }
+  else
+  {
+    retune(transfer, frequency, transfer->default_frequency_offset);
+  }
+}
+
+/* Change the payload size according to the quality of the link reported by
+ * ofdm_transfer_report_frames() */
+void adapt_payload_size(ofdm_transfer_t transfer,
+                        unsigned int valid,
+                        unsigned int corrupted)
+{
+  unsigned int size = transfer->payload_size;
+
+  if((!transfer->adaptive_payload_size) || (valid + corrupted == 0))
+  {
+    return;
+  }
+
+  transfer->corrupted_rate = (0.75 * transfer->corrupted_rate) +
+    (0.25 * corrupted / (valid + corrupted));
+  if(transfer->corrupted_rate < 0.01)
+  {
+    /* Clean link, use longer frames to reduce the overhead of the preamble
+     * and header */
+    size += MAX(size / 8, 16);
+  }
+  else if(transfer->corrupted_rate > 0.1)
+  {
+    /* Many frames are lost, use shorter frames */
+    size /= 2;
+  }
+  transfer->payload_size = MIN(MAX(size, transfer->minimum_payload_size),
+                               transfer->maximum_payload_size);
+}
+
+/* Apply the settings changed by ofdm_transfer_set_frequency(),
+ * ofdm_transfer_set_frequency_offset(), ofdm_transfer_set_gain() and
+ * ofdm_transfer_set_id() while the transfer is running */
+void apply_settings(ofdm_transfer_t transfer)
+{
+  int direction;
+
+  /* The setters change the settings from other threads */
+  pthread_mutex_lock(&transfer->settings_mutex);
+  if(!transfer->settings_changed)
+  {
+    pthread_mutex_unlock(&transfer->settings_mutex);
+    return;
+  }
+
+  if(transfer->settings_changed & SETTING_FREQUENCY_OFFSET)
+  {
+    transfer->default_frequency_offset = transfer->new_frequency_offset;
+    retune(transfer, transfer->frequency, transfer->new_frequency_offset);
+  }
+
+  if(transfer->settings_changed & SETTING_FREQUENCY)
+  {
+    move_to_frequency(transfer, transfer->new_frequency);
+  }
+
+  if(transfer->settings_changed & SETTING_HOP)
+  {
+    transfer->hop_channel = transfer->new_hop_channel;
+    move_to_frequency(transfer, transfer->hop_frequencies[transfer->hop_channel]);
+  }
+
+  if(transfer->settings_changed & SETTING_GAIN)
+  {
+    if(transfer->audio_converter)
+    {
+      transfer->audio_gain = powf(10, strtol(transfer->new_gain, NULL, 10) / 20.0);
     }
-    else
+    else if(transfer->radio_type == SOAPYSDR)
     {
-      gain_value = strtoul(gain, NULL, 10);
-      SOAPYSDR_CHECK(SoapySDRDevice_setGain(transfer->radio_device.soapysdr,
-                                            direction,
-                                            0,
-                                            gain_value));
-    }
-    transfer->radio_stream.soapysdr = SoapySDRDevice_setupStream(transfer->radio_device.soapysdr,
-                                                                 direction,
-                                                                 SOAPY_SDR_CF32,
-                                                                 NULL,
-                                                                 0,
-                                                                 NULL);
-    if(transfer->radio_stream.soapysdr == NULL)
+      direction = transfer->emit ? SOAPY_SDR_TX : SOAPY_SDR_RX;
+      lock_device(transfer);
+      if(set_soapysdr_gain(transfer, direction, transfer->new_gain) != 0)
+      {
+        fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
+      }
+      unlock_device(transfer);
+      /* Keep the gain to set it again if the radio has to be reopened */
+      free(transfer->radio_gain[direction]);
+      transfer->radio_gain[direction] = transfer->new_gain;
+      transfer->new_gain = NULL;
+    }
+    free(transfer->new_gain);
+    transfer->new_gain = NULL;
+  }
+
+  if(transfer->settings_changed & SETTING_ID)
+  {
+    strcpy(transfer->id, transfer->new_id);
+    if(transfer->modulator)
     {
-      fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
-      SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
-      free(transfer);
-      return(NULL);
+      ofdm_modem_set_id(transfer->modulator, transfer->id);
     }
-    break;
+  }
 
-  default:
-    fprintf(stderr, _("Error: Unknown radio type\n"));
-    free(transfer);
-    return(NULL);
-    break;
+  if(transfer->settings_changed & SETTING_PAYLOAD_SIZE)
+  {
+    adapt_payload_size(transfer,
+                       transfer->reported_valid,
+                       transfer->reported_corrupted);
+    transfer->reported_valid = 0;
+    transfer->reported_corrupted = 0;
+  }
+
+  transfer->settings_changed = 0;
+  pthread_mutex_unlock(&transfer->settings_mutex);
+}
+
+/* Channel of the hop schedule used for a frame */
+int get_hop_channel(ofdm_transfer_t transfer, unsigned int counter)
+{
+  return((counter / transfer->hop_dwell) % transfer->hop_count);
+}
+
+/* When sending, change channel before the frame that starts a new dwell */
+void hop_before_frame(ofdm_transfer_t transfer)
+{
+  int channel;
+
+  if(transfer->hop_count == 0)
+  {
+    return;
+  }
+
+  channel = get_hop_channel(transfer,
+                            ofdm_modem_get_counter(transfer->modulator));
+  if(channel == transfer->hop_channel)
+  {
+    return;
+  }
+  if(transfer->hop_channel >= 0)
+  {
+    /* Send the end of the previous frame (because of resampler delay) on the
+     * previous channel */
+    send_dummy_samples(transfer, 0);
+  }
+  transfer->hop_channel = channel;
+  move_to_frequency(transfer, transfer->hop_frequencies[channel]);
+  /* Leave a block of silence to let the receivers follow the hop before the
+   * preamble of the next frame */
+  bzero(transfer->samples, transfer->samples_size * sizeof(complex float));
+  send_to_radio(transfer, transfer->samples, transfer->samples_size, 0);
+}
+
+/* When receiving, follow the hop schedule of the sender after each frame.
+ * The channel is changed by apply_settings() before the next block of
+ * samples. */
+void hop_after_frame(ofdm_transfer_t transfer, unsigned int counter)
+{
+  int channel;
+
+  if(transfer->hop_count == 0)
+  {
+    return;
+  }
+
+  channel = get_hop_channel(transfer, counter + 1);
+  if(channel != transfer->hop_channel)
+  {
+    pthread_mutex_lock(&transfer->settings_mutex);
+    transfer->new_hop_channel = channel;
+    transfer->settings_changed |= SETTING_HOP;
+    pthread_mutex_unlock(&transfer->settings_mutex);
+  }
+}
+
+int send_frames_begin(ofdm_transfer_t transfer)
+{
+  if(modulator_prepare(transfer) != 0)
+  {
+    return(-1);
+  }
+
+  transfer->payload_size = get_payload_size(transfer);
+  transfer->corrupted_rate = 0;
+  transfer->input_finished = 0;
+  transfer->hop_channel = -1;
+  if(transfer->arq_data)
+  {
+    arq_reset(transfer->arq);
+  }
+  if(transfer->erasure)
+  {
+    if(erasure_prepare(transfer) != 0)
+    {
+      return(-1);
+    }
+    erasure_start_sending(transfer->erasure,
+                          ofdm_modem_get_counter(transfer->modulator));
+  }
+  if(transfer->carousel && (carousel_start_sending(transfer) != 0))
+  {
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* Send the next block of samples, getting the payload of a new frame first if
+ * necessary. Return 0 when there is no more data to send, -1 if the radio has
+ * failed, 1 otherwise. */
+int send_frames_step(ofdm_transfer_t transfer)
+{
+  int r;
+  unsigned int n;
+
+  if(!ofdm_modem_is_frame_open(transfer->modulator))
+  {
+    apply_settings(transfer);
+    if(((transfer->data_callback == read_queue) ||
+        (transfer->data_callback == read_tun)) &&
+       (transfer->message_offset >= transfer->message_size))
+    {
+      /* Sleep until some data is ready, but not longer than a block of
+       * samples to keep the end of the previous frame flowing */
+      wait_for_data(transfer,
+                    (double) ofdm_modem_get_block_size(transfer->modulator) /
+                    transfer->sample_rate);
+    }
+    if(transfer->arq_data)
+    {
+      r = arq_get_payload(transfer);
+    }
+    else if(transfer->erasure)
+    {
+      r = erasure_get_payload(transfer);
+    }
+    else
+    {
+      r = get_data_payload(transfer, transfer->payload, transfer->payload_size);
+    }
+    if(r < 0)
+    {
+      return((transfer->arq_data && transfer->arq->failed) ? -1 : 0);
+    }
+    n = r;
+    if(n == 0)
+    {
+      /* Underrun when reading from stdin. Send some dummy samples to get the
+       * remaining output samples for the end of current frame (because of
+       * resampler and filter delays) and send them */
+      send_dummy_samples(transfer, 0);
+      return(transfer->radio_failed ? -1 : 1);
+    }
+    hop_before_frame(transfer);
+    ofdm_modem_assemble(transfer->modulator, transfer->payload, n);
+    transfer->stats.frames_sent++;
+    transfer->stats.bytes_sent += n;
+  }
+
+  n = ofdm_modem_modulate(transfer->modulator, transfer->samples);
+  send_to_radio(transfer, transfer->samples, n, 0);
+
+  return(transfer->radio_failed ? -1 : 1);
+}
+
+void send_frames_end(ofdm_transfer_t transfer)
+{
+  /* Send some dummy samples to get the remaining output samples (because of
+   * resampler and filter delays) */
+  send_dummy_samples(transfer, 1);
+}
+
+/* Pass the received data to the consumer, in the delivery thread when the
+ * delivery queue is used, calling the data callback again later while it
+ * returns a negative value (the consumer is busy) */
+void * delivery_thread(void *arg)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) arg;
+  queue_t *queue = transfer->delivery_queue;
+  unsigned int size;
+
+  pthread_mutex_lock(&queue->mutex);
+  while(1)
+  {
+    while((queue->length == 0) && (!queue->closed))
+    {
+      pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    if(queue->length == 0)
+    {
+      break;
+    }
+    size = queue_read_entry(queue, transfer->delivery_buffer);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+
+    while((transfer->data_callback(transfer->callback_context,
+                                   transfer->delivery_buffer,
+                                   size) < 0) &&
+          (!stop) &&
+          (!transfer->stop))
+    {
+      usleep(1000);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+
+  return(NULL);
+}
+
+/* Pass some received data to the data callback, or to the delivery thread
+ * when the delivery queue is used */
+void deliver(ofdm_transfer_t transfer,
+             unsigned char *payload,
+             unsigned int payload_size)
+{
+  queue_t *queue = transfer->delivery_queue;
+
+  if(!transfer->delivery_thread_running)
+  {
+    transfer->data_callback(transfer->callback_context, payload, payload_size);
+    return;
+  }
+
+  pthread_mutex_lock(&queue->mutex);
+  if(payload_size + QUEUE_ENTRY_HEADER_SIZE > queue->size)
+  {
+    transfer->stats.payloads_dropped++;
+    pthread_mutex_unlock(&queue->mutex);
+    return;
+  }
+  while(queue->size - queue->length < payload_size + QUEUE_ENTRY_HEADER_SIZE)
+  {
+    if(transfer->delivery_policy == OFDM_TRANSFER_DELIVERY_DROP_NEWEST)
+    {
+      transfer->stats.payloads_dropped++;
+      pthread_mutex_unlock(&queue->mutex);
+      return;
+    }
+    else if(transfer->delivery_policy == OFDM_TRANSFER_DELIVERY_DROP_OLDEST)
+    {
+      queue_read_entry(queue, NULL);
+      transfer->stats.payloads_dropped++;
+    }
+    else
+    {
+      pthread_cond_wait(&queue->not_full, &queue->mutex);
+    }
+  }
+  queue_write_entry(queue, payload, payload_size);
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+void start_delivery_thread(ofdm_transfer_t transfer)
+{
+  if((transfer->delivery_queue == NULL) || transfer->delivery_thread_running)
+  {
+    return;
+  }
+
+  transfer->delivery_queue->start = 0;
+  transfer->delivery_queue->length = 0;
+  transfer->delivery_queue->closed = 0;
+  if(pthread_create(&transfer->delivery_thread,
+                    NULL,
+                    delivery_thread,
+                    transfer) != 0)
+  {
+    /* Call the data callback directly instead */
+    fprintf(stderr, _("Error: Failed to start the delivery thread\n"));
+    return;
+  }
+  transfer->delivery_thread_running = 1;
+}
+
+/* Wait until the data in the delivery queue has been passed to the data
+ * callback */
+void stop_delivery_thread(ofdm_transfer_t transfer)
+{
+  if(!transfer->delivery_thread_running)
+  {
+    return;
+  }
+
+  queue_close(transfer->delivery_queue);
+  pthread_join(transfer->delivery_thread, NULL);
+  transfer->delivery_thread_running = 0;
+}
+
+/* Unpack the messages contained in the payload of a frame (datagram mode)
+ * and pass them to the data callback */
+void receive_datagrams(ofdm_transfer_t transfer,
+                       unsigned int counter,
+                       unsigned char *payload,
+                       unsigned int payload_size)
+{
+  unsigned int n = 0;
+  unsigned int size;
+  unsigned int fragment_header;
+
+  while(n + DATAGRAM_HEADER_SIZE <= payload_size)
+  {
+    fragment_header = (payload[n] << 8) | payload[n + 1];
+    size = fragment_header & DATAGRAM_MAX_FRAGMENT_SIZE;
+    n += DATAGRAM_HEADER_SIZE;
+    if(n + size > payload_size)
+    {
+      break;
+    }
+
+    if(fragment_header & DATAGRAM_CONTINUATION)
+    {
+      if((!transfer->message_incomplete) ||
+         (counter != transfer->message_next_counter) ||
+         (n != DATAGRAM_HEADER_SIZE) ||
+         (transfer->message_size + size > OFDM_TRANSFER_MAX_MESSAGE_SIZE))
+      {
+        /* The beginning of the message was lost */
+        if(transfer->message_incomplete)
+        {
+          transfer->stats.messages_dropped++;
+        }
+        transfer->message_incomplete = 0;
+        transfer->message_size = 0;
+        n += size;
+        continue;
+      }
+    }
+    else
+    {
+      if(transfer->message_incomplete)
+      {
+        /* The end of the previous message was lost */
+        transfer->stats.messages_dropped++;
+      }
+      transfer->message_size = 0;
+    }
+
+    memcpy(&transfer->message[transfer->message_size], &payload[n], size);
+    transfer->message_size += size;
+    n += size;
+
+    if(fragment_header & DATAGRAM_MORE_FRAGMENTS)
+    {
+      transfer->message_incomplete = 1;
+      transfer->message_next_counter = counter + 1;
+    }
+    else
+    {
+      transfer->message_incomplete = 0;
+      transfer->stats.messages_received++;
+      deliver(transfer, transfer->message, transfer->message_size);
+      transfer->message_size = 0;
+    }
+  }
+}
+
+/* Set the size of the file being received in carousel mode, and prepare the
+ * bitmap of the blocks received */
+int carousel_set_file(ofdm_transfer_t transfer,
+                      unsigned int file_size,
+                      unsigned int block_size)
+{
+  carousel_t *carousel = transfer->carousel;
+  unsigned int blocks;
+
+  blocks = file_size / block_size;
+  if((file_size % block_size) || (blocks == 0))
+  {
+    blocks++;
+  }
+  free(carousel->bitmap);
+  carousel->bitmap = calloc((blocks / 8) + 1, 1);
+  if(carousel->bitmap == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  carousel->file_size = file_size;
+  carousel->block_size = block_size;
+  carousel->blocks = blocks;
+  carousel->blocks_received = 0;
+  carousel->first_missing = 0;
+  carousel->started = 1;
+  transfer->stats.blocks_total = blocks;
+  transfer->stats.blocks_received = 0;
+  transfer->stats.first_missing_block = 0;
+
+  return(0);
+}
+
+void carousel_mark_block(ofdm_transfer_t transfer, unsigned int block)
+{
+  carousel_t *carousel = transfer->carousel;
+
+  carousel->bitmap[block / 8] |= 1 << (block % 8);
+  carousel->blocks_received++;
+  while((carousel->first_missing < carousel->blocks) &&
+        (carousel->bitmap[carousel->first_missing / 8] &
+         (1 << (carousel->first_missing % 8))))
+  {
+    carousel->first_missing++;
+  }
+  transfer->stats.blocks_received = carousel->blocks_received;
+  transfer->stats.first_missing_block = carousel->first_missing;
+}
+
+/* Save the list of the blocks received in the checkpoint file, after making
+ * sure that these blocks are on the disk. The file is written under another
+ * name and renamed, so that an interruption leaves the previous checkpoint
+ * intact. */
+void carousel_save_checkpoint(ofdm_transfer_t transfer)
+{
+  carousel_t *carousel = transfer->carousel;
+  unsigned int size = strlen(carousel->checkpoint);
+  char name[size + 5];
+  FILE *file;
+  unsigned int i;
+  int r;
+
+  carousel->checkpoint_dirty = 0;
+  carousel->checkpoint_time = get_monotonic_time();
+  sprintf(name, "%s.tmp", carousel->checkpoint);
+  file = fopen(name, "w");
+  if(file == NULL)
+  {
+    fprintf(stderr, _("Error: Failed to write '%s'\n"), name);
+    return;
+  }
+  fsync(carousel->fd);
+  fprintf(file, "ofdm-transfer checkpoint\n");
+  fprintf(file, "id ");
+  for(i = 0; i < 4; i++)
+  {
+    fprintf(file, "%02x", (unsigned char) transfer->id[i]);
+  }
+  fprintf(file, "\nfile_size %u\n", carousel->file_size);
+  fprintf(file, "block_size %u\n", carousel->block_size);
+  fprintf(file, "blocks_received %u\n", carousel->blocks_received);
+  fprintf(file, "bitmap ");
+  for(i = 0; i < (carousel->blocks / 8) + 1; i++)
+  {
+    fprintf(file, "%02x", carousel->bitmap[i]);
+  }
+  fprintf(file, "\n");
+  r = ((fflush(file) == 0) && (fsync(fileno(file)) == 0)) ? 0 : -1;
+  if((fclose(file) != 0) ||
+     (r != 0) ||
+     (rename(name, carousel->checkpoint) != 0))
+  {
+    fprintf(stderr, _("Error: Failed to write '%s'\n"), name);
+    return;
+  }
+  if(verbose)
+  {
+    fprintf(stderr,
+            _("Info: Checkpoint saved, %u of %u blocks received, "
+              "first missing block %u\n"),
+            carousel->blocks_received,
+            carousel->blocks,
+            carousel->first_missing);
+  }
+}
+
+/* Restore the list of the blocks received from the checkpoint file if it
+ * exists. Return 0 if successful or if there is no checkpoint, -1 if the
+ * checkpoint is invalid or is for another transfer. */
+int carousel_load_checkpoint(ofdm_transfer_t transfer)
+{
+  carousel_t *carousel = transfer->carousel;
+  FILE *file;
+  unsigned int file_size;
+  unsigned int block_size;
+  unsigned int blocks;
+  unsigned int byte;
+  unsigned int i;
+  char id[4];
+  int n = 0;
+  int r = 0;
+
+  file = fopen(carousel->checkpoint, "r");
+  if(file == NULL)
+  {
+    return(0);
+  }
+  if((fscanf(file, "ofdm-transfer checkpoint id %n", &n) != 0) || (n == 0))
+  {
+    r = -1;
+  }
+  for(i = 0; (r == 0) && (i < 4); i++)
+  {
+    if(fscanf(file, "%2x", &byte) != 1)
+    {
+      r = -1;
+    }
+    id[i] = byte;
+  }
+  if((r == 0) &&
+     ((fscanf(file,
+              " file_size %u block_size %u blocks_received %u bitmap ",
+              &file_size,
+              &block_size,
+              &blocks) != 3) ||
+      (block_size == 0) ||
+      (carousel_set_file(transfer, file_size, block_size) != 0)))
+  {
+    r = -1;
+  }
+  for(i = 0; (r == 0) && (i < (carousel->blocks / 8) + 1); i++)
+  {
+    if(fscanf(file, "%2x", &byte) != 1)
+    {
+      r = -1;
+    }
+    carousel->bitmap[i] = byte;
+  }
+  fclose(file);
+  if(r != 0)
+  {
+    fprintf(stderr,
+            _("Error: Invalid checkpoint '%s'\n"),
+            carousel->checkpoint);
+    carousel->started = 0;
+    return(-1);
+  }
+  if(memcmp(id, transfer->id, 4) != 0)
+  {
+    fprintf(stderr,
+            _("Error: The checkpoint '%s' is for another transfer\n"),
+            carousel->checkpoint);
+    carousel->started = 0;
+    return(-1);
+  }
+
+  for(i = 0; i < carousel->blocks; i++)
+  {
+    if(carousel->bitmap[i / 8] & (1 << (i % 8)))
+    {
+      carousel->bitmap[i / 8] &= ~(1 << (i % 8));
+      carousel_mark_block(transfer, i);
+    }
+  }
+  if(carousel->blocks_received != blocks)
+  {
+    /* The bitmap doesn't match the count saved with it */
+    fprintf(stderr,
+            _("Error: Invalid checkpoint '%s'\n"),
+            carousel->checkpoint);
+    carousel->started = 0;
+    return(-1);
+  }
+  if(verbose)
+  {
+    fprintf(stderr,
+            _("Info: Resuming the reception of a file of %u bytes, "
+              "%u of %u blocks already received\n"),
+            carousel->file_size,
+            carousel->blocks_received,
+            carousel->blocks);
+  }
+
+  return(0);
+}
+
+/* Write the block of the file contained in the payload of a frame at its
+ * offset (carousel mode). The first frame gives the size of the file. */
+void receive_carousel_block(ofdm_transfer_t transfer,
+                            unsigned char *payload,
+                            unsigned int payload_size)
+{
+  carousel_t *carousel = transfer->carousel;
+  unsigned int block;
+  unsigned int block_size;
+  unsigned int file_size;
+  unsigned long int offset;
+  unsigned int size;
+
+  if(payload_size < CAROUSEL_HEADER_SIZE)
+  {
+    return;
+  }
+  block = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) |
+    payload[3];
+  block_size = (payload[4] << 8) | payload[5];
+  file_size = (payload[6] << 24) | (payload[7] << 16) | (payload[8] << 8) |
+    payload[9];
+  size = payload_size - CAROUSEL_HEADER_SIZE;
+  if(block_size == 0)
+  {
+    return;
+  }
+
+  if(!carousel->started)
+  {
+    if(carousel_set_file(transfer, file_size, block_size) != 0)
+    {
+      return;
+    }
+    if(ftruncate(carousel->fd, file_size) != 0)
+    {
+      fprintf(stderr, _("Error: Failed to write the file\n"));
+    }
+    if(verbose)
+    {
+      fprintf(stderr,
+              _("Info: Receiving a file of %u bytes in %u blocks\n"),
+              file_size,
+              carousel->blocks);
+    }
+  }
+  else if((file_size != carousel->file_size) ||
+          (block_size != carousel->block_size))
+  {
+    /* Frame of another file */
+    return;
+  }
+
+  offset = (unsigned long int) block * block_size;
+  if((block >= carousel->blocks) ||
+     (offset > file_size) ||
+     (size != MIN(block_size, file_size - offset)) ||
+     (carousel->bitmap[block / 8] & (1 << (block % 8))))
+  {
+    return;
+  }
+  if(pwrite(carousel->fd,
+            &payload[CAROUSEL_HEADER_SIZE],
+            size,
+            offset) != size)
+  {
+    fprintf(stderr, _("Error: Failed to write the file\n"));
+    return;
+  }
+  carousel_mark_block(transfer, block);
+  carousel->checkpoint_dirty = 1;
+  if(carousel->blocks_received == carousel->blocks)
+  {
+    carousel->complete = 1;
+    if(carousel->checkpoint)
+    {
+      /* Nothing to resume anymore */
+      fsync(carousel->fd);
+      unlink(carousel->checkpoint);
+      carousel->checkpoint_dirty = 0;
+    }
+    if(verbose)
+    {
+      fprintf(stderr, _("Info: File complete\n"));
+    }
+  }
+}
+
+/* Give the payload of a frame to the data callback, or the messages it
+ * contains in datagram mode */
+void receive_payload(ofdm_transfer_t transfer,
+                     unsigned int counter,
+                     unsigned char *payload,
+                     unsigned int payload_size)
+{
+  if(transfer->carousel)
+  {
+    receive_carousel_block(transfer, payload, payload_size);
+  }
+  else if(transfer->datagram)
+  {
+    receive_datagrams(transfer, counter, payload, payload_size);
+  }
+  else
+  {
+    deliver(transfer, payload, payload_size);
+  }
+}
+
+/* Deliver the data frames of the current block that are in order. When
+ * 'finished' is set, the missing frames are skipped instead of waiting for
+ * them. The data frames are numbered with a sequence counter which skips the
+ * lost frames, to detect the incomplete messages in datagram mode. */
+void erasure_deliver(ofdm_transfer_t transfer, unsigned char finished)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned char *shard;
+  unsigned int size;
+
+  while(erasure->delivered < erasure->data_count)
+  {
+    if(erasure->received[erasure->delivered])
+    {
+      shard = erasure->shards[erasure->delivered];
+      size = (shard[0] << 8) | shard[1];
+      receive_payload(transfer,
+                      erasure->sequence,
+                      &shard[ERASURE_DATA_HEADER_SIZE],
+                      size);
+    }
+    else if(!finished)
+    {
+      break;
+    }
+    erasure->delivered++;
+    erasure->sequence++;
+  }
+}
+
+/* Invert the 'size' x 'size' matrix in 'erasure->matrix' into
+ * 'erasure->inverse' by Gauss-Jordan elimination; return -1 if it is
+ * singular */
+int erasure_invert_matrix(erasure_t *erasure, unsigned int size)
+{
+  unsigned char *a = erasure->matrix;
+  unsigned char *b = erasure->inverse;
+  unsigned char tmp;
+  unsigned char c;
+  unsigned int pivot;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+
+  for(i = 0; i < size; i++)
+  {
+    for(j = 0; j < size; j++)
+    {
+      b[(i * size) + j] = (i == j) ? 1 : 0;
+    }
+  }
+
+  for(i = 0; i < size; i++)
+  {
+    for(pivot = i; (pivot < size) && (a[(pivot * size) + i] == 0); pivot++);
+    if(pivot == size)
+    {
+      return(-1);
+    }
+    if(pivot != i)
+    {
+      for(j = 0; j < size; j++)
+      {
+        tmp = a[(i * size) + j];
+        a[(i * size) + j] = a[(pivot * size) + j];
+        a[(pivot * size) + j] = tmp;
+        tmp = b[(i * size) + j];
+        b[(i * size) + j] = b[(pivot * size) + j];
+        b[(pivot * size) + j] = tmp;
+      }
+    }
+    c = gf_inv(a[(i * size) + i]);
+    for(j = 0; j < size; j++)
+    {
+      a[(i * size) + j] = gf_mul(a[(i * size) + j], c);
+      b[(i * size) + j] = gf_mul(b[(i * size) + j], c);
+    }
+    for(k = 0; k < size; k++)
+    {
+      c = a[(k * size) + i];
+      if((k == i) || (c == 0))
+      {
+        continue;
+      }
+      for(j = 0; j < size; j++)
+      {
+        a[(k * size) + j] ^= gf_mul(a[(i * size) + j], c);
+        b[(k * size) + j] ^= gf_mul(b[(i * size) + j], c);
+      }
+    }
+  }
+
+  return(0);
+}
+
+/* Rebuild the missing data frames of the current block when enough frames
+ * have been received */
+void erasure_decode(ofdm_transfer_t transfer)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned int k = erasure->data_frames;
+  unsigned int missing_count = 0;
+  unsigned int rows_count = 0;
+  unsigned int size = erasure->shard_size;
+  unsigned char *shard;
+  unsigned int length;
+  unsigned int i;
+  unsigned int j;
+
+  for(i = 0; i < erasure->data_count; i++)
+  {
+    if(!erasure->received[i])
+    {
+      erasure->missing[missing_count] = i;
+      missing_count++;
+    }
+  }
+  for(i = 0; (i < erasure->parity_frames) && (rows_count < missing_count); i++)
+  {
+    if(erasure->received[k + i])
+    {
+      erasure->rows[rows_count] = i;
+      rows_count++;
+    }
+  }
+  if((missing_count == 0) || (rows_count < missing_count))
+  {
+    return;
+  }
+
+  /* Remove the contribution of the received data frames from the parity
+   * frames, and solve the system for the missing ones */
+  for(i = 0; i < rows_count; i++)
+  {
+    shard = erasure->shards[k + erasure->rows[i]];
+    for(j = 0; j < erasure->data_count; j++)
+    {
+      if(erasure->received[j])
+      {
+        gf_mul_add(shard,
+                   erasure->shards[j],
+                   erasure_coefficient(erasure, erasure->rows[i], j),
+                   erasure->lengths[j]);
+      }
+    }
+    for(j = 0; j < missing_count; j++)
+    {
+      erasure->matrix[(i * missing_count) + j] =
+        erasure_coefficient(erasure, erasure->rows[i], erasure->missing[j]);
+    }
+  }
+  if(erasure_invert_matrix(erasure, missing_count) != 0)
+  {
+    return;
+  }
+  for(i = 0; i < missing_count; i++)
+  {
+    shard = erasure->shards[erasure->missing[i]];
+    bzero(shard, size);
+    for(j = 0; j < rows_count; j++)
+    {
+      gf_mul_add(shard,
+                 erasure->shards[k + erasure->rows[j]],
+                 erasure->inverse[(i * missing_count) + j],
+                 size);
+    }
+    length = (shard[0] << 8) | shard[1];
+    if(ERASURE_DATA_HEADER_SIZE + length > size)
+    {
+      continue;
+    }
+    erasure->lengths[erasure->missing[i]] = ERASURE_DATA_HEADER_SIZE + length;
+    erasure->received[erasure->missing[i]] = 1;
+    transfer->stats.frames_recovered++;
+  }
+  /* The parity frames have been used */
+  for(i = 0; i < rows_count; i++)
+  {
+    erasure->received[k + erasure->rows[i]] = 0;
+  }
+}
+
+/* Keep a frame received with the erasure code, deliver the data frames that
+ * are in order, and rebuild the missing ones when possible */
+void erasure_receive(ofdm_transfer_t transfer,
+                     unsigned int counter,
+                     unsigned char *payload,
+                     unsigned int payload_size)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned int frames = erasure->data_frames + erasure->parity_frames;
+  unsigned int block = counter / frames;
+  unsigned int index = counter % frames;
+  int d = counter - (erasure->block * frames);
+  unsigned int received = 0;
+  unsigned int length;
+  unsigned int i;
+
+  if(erasure->block_valid && (d < 0) && (d > -SEQUENCE_HISTORY))
+  {
+    /* Late frame of a block that has already been delivered (a frame further
+     * behind means that the sender has restarted) */
+    return;
+  }
+  if(!erasure->block_valid || (block != erasure->block))
+  {
+    if(erasure->block_valid)
+    {
+      erasure_deliver(transfer, 1);
+      if(block != erasure->block + 1)
+      {
+        /* Whole blocks were lost */
+        erasure->sequence++;
+      }
+    }
+    erasure_start_block(erasure, block);
+  }
+  if(erasure->received[index] || (payload_size > erasure->slot_size))
+  {
+    return;
+  }
+
+  if(index < erasure->data_frames)
+  {
+    if(payload_size < ERASURE_DATA_HEADER_SIZE)
+    {
+      return;
+    }
+    length = (payload[0] << 8) | payload[1];
+    if(length != payload_size - ERASURE_DATA_HEADER_SIZE)
+    {
+      return;
+    }
+    memcpy(erasure->shards[index], payload, payload_size);
+    erasure->lengths[index] = payload_size;
+  }
+  else
+  {
+    if((payload_size <= ERASURE_PARITY_HEADER_SIZE) ||
+       (payload[0] == 0) ||
+       (payload[0] > erasure->data_frames))
+    {
+      return;
+    }
+    erasure->data_count = payload[0];
+    erasure->shard_size = payload_size - ERASURE_PARITY_HEADER_SIZE;
+    memcpy(erasure->shards[index],
+           &payload[ERASURE_PARITY_HEADER_SIZE],
+           erasure->shard_size);
+  }
+  erasure->received[index] = 1;
+
+  erasure_deliver(transfer, 0);
+  if((erasure->delivered < erasure->data_count) && (erasure->shard_size > 0))
+  {
+    for(i = 0; i < frames; i++)
+    {
+      if(erasure->received[i] &&
+         ((i < erasure->data_count) || (i >= erasure->data_frames)))
+      {
+        received++;
+      }
+    }
+    if(received >= erasure->data_count)
+    {
+      erasure_decode(transfer);
+      erasure_deliver(transfer, 0);
+    }
+  }
+}
+
+/* Keep a frame received in reliable mode, deliver the frames that are in
+ * order, and request an acknowledgement */
+void arq_receive(ofdm_transfer_t transfer,
+                 unsigned int counter,
+                 unsigned char *payload,
+                 unsigned int payload_size)
+{
+  arq_t *arq = transfer->arq;
+  arq_slot_t *slot;
+  unsigned int offset;
+
+  pthread_mutex_lock(&arq->mutex);
+  offset = counter - arq->base;
+  slot = &arq->slots[counter % arq->window];
+  if(((int) offset < 0) ||
+     ((offset < arq->window) && (slot->state == ARQ_SLOT_RECEIVED)))
+  {
+    /* The acknowledgement of this frame was lost */
+    transfer->stats.frames_duplicated++;
+    arq->ack_pending = 1;
+    pthread_mutex_unlock(&arq->mutex);
+    return;
+  }
+  if((offset >= arq->window) || (payload_size > arq->slot_size))
+  {
+    /* It can't be kept, the sender will send it again */
+    arq->ack_pending = 1;
+    pthread_mutex_unlock(&arq->mutex);
+    return;
+  }
+  if(offset == 0)
+  {
+    pthread_mutex_unlock(&arq->mutex);
+    receive_payload(transfer, counter, payload, payload_size);
+    pthread_mutex_lock(&arq->mutex);
+    arq->base++;
+  }
+  else
+  {
+    slot->state = ARQ_SLOT_RECEIVED;
+    slot->size = payload_size;
+    memcpy(slot->data, payload, payload_size);
+  }
+
+  /* The frames that were waiting for this one */
+  slot = &arq->slots[arq->base % arq->window];
+  while(slot->state == ARQ_SLOT_RECEIVED)
+  {
+    counter = arq->base;
+    pthread_mutex_unlock(&arq->mutex);
+    receive_payload(transfer, counter, slot->data, slot->size);
+    pthread_mutex_lock(&arq->mutex);
+    slot->state = ARQ_SLOT_FREE;
+    arq->base++;
+    slot = &arq->slots[arq->base % arq->window];
+  }
+  arq->ack_pending = 1;
+  pthread_mutex_unlock(&arq->mutex);
+}
+
+/* Request an acknowledgement after a corrupted frame in reliable mode, so that
+ * the sender knows sooner that it has been lost */
+void arq_request_ack(ofdm_transfer_t transfer)
+{
+  pthread_mutex_lock(&transfer->arq->mutex);
+  transfer->arq->ack_pending = 1;
+  pthread_mutex_unlock(&transfer->arq->mutex);
+}
+
+/* Data callback of the reverse transfer of a receiver in reliable mode, giving
+ * an acknowledgement when frames have been received */
+int read_arq_ack(void *context,
+                 unsigned char *payload,
+                 unsigned int payload_size)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+  arq_t *arq = transfer->arq;
+  unsigned int bits;
+  unsigned int size = ARQ_ACK_HEADER_SIZE;
+  unsigned int counter;
+  unsigned int i;
+
+  pthread_mutex_lock(&arq->mutex);
+  if((!arq->ack_pending) || (payload_size < ARQ_ACK_HEADER_SIZE))
+  {
+    pthread_mutex_unlock(&arq->mutex);
+    return(0);
+  }
+  payload[0] = (arq->base >> 24) & 255;
+  payload[1] = (arq->base >> 16) & 255;
+  payload[2] = (arq->base >> 8) & 255;
+  payload[3] = arq->base & 255;
+  bits = MIN(arq->window - 1, (payload_size - ARQ_ACK_HEADER_SIZE) * 8);
+  bzero(&payload[ARQ_ACK_HEADER_SIZE], (bits + 7) / 8);
+  for(i = 0; i < bits; i++)
+  {
+    counter = arq->base + 1 + i;
+    if(arq->slots[counter % arq->window].state == ARQ_SLOT_RECEIVED)
+    {
+      payload[ARQ_ACK_HEADER_SIZE + (i / 8)] |= 0x80 >> (i % 8);
+      size = ARQ_ACK_HEADER_SIZE + (i / 8) + 1;
+    }
+  }
+  arq->ack_pending = 0;
+  pthread_mutex_unlock(&arq->mutex);
+
+  return(size);
+}
+
+/* Give a valid frame to the receiver of the mode of the transfer */
+void receive_frame(ofdm_transfer_t transfer,
+                   unsigned int counter,
+                   unsigned char *payload,
+                   unsigned int payload_size)
+{
+  if(transfer->arq_data)
+  {
+    arq_receive(transfer, counter, payload, payload_size);
+  }
+  else if(transfer->erasure)
+  {
+    erasure_receive(transfer, counter, payload, payload_size);
+  }
+  else
+  {
+    receive_payload(transfer, counter, payload, payload_size);
+  }
+}
+
+/* Update the sequence of counters of an id with the counter of a new frame,
+ * counting the frames lost, received again or out of order. Return
+ * SEQUENCE_DUPLICATE if the counter had already been seen, SEQUENCE_LATE if
+ * it arrives after a higher counter, SEQUENCE_NEW otherwise. */
+int sequence_update(struct ofdm_transfer_stats_s *stats,
+                    sequence_t *sequence,
+                    unsigned int counter)
+{
+  int d = counter - sequence->highest;
+  unsigned int bit = counter % SEQUENCE_HISTORY;
+  unsigned int i;
+
+  if((!sequence->valid) || (d <= -SEQUENCE_HISTORY))
+  {
+    /* First frame, or the sender has restarted */
+    bzero(sequence->history, SEQUENCE_HISTORY / 8);
+    sequence->valid = 1;
+    sequence->highest = counter;
+    sequence->history[bit / 8] |= 1 << (bit % 8);
+    return(SEQUENCE_NEW);
+  }
+
+  if(d > 0)
+  {
+    for(i = 1; (i <= (unsigned int) d) && (i <= SEQUENCE_HISTORY); i++)
+    {
+      bit = (sequence->highest + i) % SEQUENCE_HISTORY;
+      sequence->history[bit / 8] &= ~(1 << (bit % 8));
+    }
+    bit = counter % SEQUENCE_HISTORY;
+    sequence->history[bit / 8] |= 1 << (bit % 8);
+    sequence->highest = counter;
+    stats->frames_lost += d - 1;
+    return(SEQUENCE_NEW);
+  }
+
+  if(sequence->history[bit / 8] & (1 << (bit % 8)))
+  {
+    stats->frames_duplicated++;
+    return(SEQUENCE_DUPLICATE);
+  }
+
+  /* Frame that was counted as lost */
+  sequence->history[bit / 8] |= 1 << (bit % 8);
+  if(stats->frames_lost > 0)
+  {
+    stats->frames_lost--;
+  }
+  stats->frames_reordered++;
+  return(SEQUENCE_LATE);
+}
+
+/* Mark the counters from 'first' to 'end' (excluded) as received when they
+ * were counted as lost, because they were not used by the sender */
+void sequence_skip(struct ofdm_transfer_stats_s *stats,
+                   sequence_t *sequence,
+                   unsigned int first,
+                   unsigned int end)
+{
+  unsigned int counter;
+  unsigned int bit;
+  int d;
+
+  for(counter = first; counter != end; counter++)
+  {
+    d = counter - sequence->highest;
+    bit = counter % SEQUENCE_HISTORY;
+    if((d < 0) &&
+       (d > -SEQUENCE_HISTORY) &&
+       (!(sequence->history[bit / 8] & (1 << (bit % 8)))))
+    {
+      sequence->history[bit / 8] |= 1 << (bit % 8);
+      if(stats->frames_lost > 0)
+      {
+        stats->frames_lost--;
+      }
+    }
+  }
+}
+
+/* A parity frame of the erasure code gives the number of data frames of its
+ * block. The counters of the data frames not sent because the block was
+ * incomplete must not be counted as lost. */
+void erasure_skip_unsent(ofdm_transfer_t transfer,
+                         unsigned int counter,
+                         unsigned char *payload,
+                         unsigned int payload_size)
+{
+  erasure_t *erasure = transfer->erasure;
+  unsigned int frames = erasure->data_frames + erasure->parity_frames;
+  unsigned int first = counter - (counter % frames);
+
+  if(((counter % frames) < erasure->data_frames) ||
+     (payload_size <= ERASURE_PARITY_HEADER_SIZE) ||
+     (payload[0] >= erasure->data_frames))
+  {
+    return;
+  }
+  sequence_skip(&transfer->stats,
+                &transfer->sequence,
+                first + payload[0],
+                first + erasure->data_frames);
+}
+
+void reorder_free(reorder_t *reorder)
+{
+  if(reorder)
+  {
+    free(reorder->buffer);
+    free(reorder->lengths);
+    free(reorder->used);
+    free(reorder);
+  }
+}
+
+/* Allocate the slots of the reorder buffer, large enough for the maximum
+ * payload size, and empty it */
+int reorder_prepare(ofdm_transfer_t transfer)
+{
+  reorder_t *reorder = transfer->reorder;
+  unsigned char *buffer;
+
+  if(reorder->slot_size != transfer->maximum_payload_size)
+  {
+    buffer = realloc(reorder->buffer,
+                     reorder->frames * transfer->maximum_payload_size);
+    if(buffer == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+    reorder->buffer = buffer;
+    reorder->slot_size = transfer->maximum_payload_size;
+  }
+  bzero(reorder->used, reorder->frames);
+  reorder->held = 0;
+  reorder->next_valid = 0;
+
+  return(0);
+}
+
+/* Deliver the frames held back that are now in order. If 'all' is set, the
+ * missing frames are not waited for anymore and all the frames held back are
+ * delivered. */
+void reorder_deliver(ofdm_transfer_t transfer, unsigned char all)
+{
+  reorder_t *reorder = transfer->reorder;
+  unsigned int slot;
+
+  while(reorder->held > 0)
+  {
+    slot = reorder->next % reorder->frames;
+    if(reorder->used[slot])
+    {
+      receive_frame(transfer,
+                    reorder->next,
+                    &reorder->buffer[slot * reorder->slot_size],
+                    reorder->lengths[slot]);
+      reorder->used[slot] = 0;
+      reorder->held--;
+    }
+    else if(!all)
+    {
+      break;
+    }
+    reorder->next++;
+  }
+}
+
+/* Put a frame in the reorder buffer and deliver the frames that are in
+ * order. The frames arriving too late to be put in order are delivered
+ * immediately. */
+void reorder_push(ofdm_transfer_t transfer,
+                  unsigned int counter,
+                  unsigned char *payload,
+                  unsigned int payload_size)
+{
+  reorder_t *reorder = transfer->reorder;
+  unsigned int slot;
+  int d;
+
+  if(!reorder->next_valid)
+  {
+    reorder->next = counter;
+    reorder->next_valid = 1;
+  }
+  d = counter - reorder->next;
+  if(d <= -SEQUENCE_HISTORY)
+  {
+    /* The sender has restarted */
+    reorder_deliver(transfer, 1);
+    reorder->next = counter;
+    d = 0;
+  }
+  if((d < 0) || (payload_size > reorder->slot_size))
+  {
+    receive_frame(transfer, counter, payload, payload_size);
+    return;
+  }
+
+  /* Make room for the frame, giving up on the missing frames that are too
+   * old */
+  while((reorder->held > 0) &&
+        ((int) (counter - reorder->next) >= (int) reorder->frames))
+  {
+    slot = reorder->next % reorder->frames;
+    if(reorder->used[slot])
+    {
+      receive_frame(transfer,
+                    reorder->next,
+                    &reorder->buffer[slot * reorder->slot_size],
+                    reorder->lengths[slot]);
+      reorder->used[slot] = 0;
+      reorder->held--;
+    }
+    reorder->next++;
+  }
+  if((int) (counter - reorder->next) >= (int) reorder->frames)
+  {
+    reorder->next = counter;
+  }
+
+  slot = counter % reorder->frames;
+  if(reorder->used[slot])
+  {
+    return;
+  }
+  memcpy(&reorder->buffer[slot * reorder->slot_size], payload, payload_size);
+  reorder->lengths[slot] = payload_size;
+  reorder->used[slot] = 1;
+  if(reorder->held == 0)
+  {
+    reorder->hold_time = get_monotonic_time();
+  }
+  reorder->held++;
+  reorder_deliver(transfer, 0);
+}
+
+/* Index of the bucket of an id in the table of the stations */
+unsigned int station_hash(char *id)
+{
+  unsigned int key = ((unsigned char) id[0] << 24) |
+    ((unsigned char) id[1] << 16) |
+    ((unsigned char) id[2] << 8) |
+    (unsigned char) id[3];
+
+  /* Multiplicative hashing, keeping the high bits */
+  return((key * 2654435761U) >> (32 - STATIONS_HASH_BITS));
+}
+
+/* Find the station receiving the frames of an id. If the id is not
+ * registered and there is a wildcard station, a station using the callback
+ * of the wildcard is created for the id. */
+station_t * station_find(ofdm_transfer_t transfer, char *id)
+{
+  unsigned int hash = station_hash(id);
+  station_t *station;
+
+  for(station = transfer->stations[hash];
+      station != NULL;
+      station = station->next)
+  {
+    if(memcmp(station->id, id, 4) == 0)
+    {
+      return(station);
+    }
+  }
+  if((transfer->stations_wildcard == NULL) ||
+     (transfer->stations_count >= STATIONS_MAX))
+  {
+    return(NULL);
+  }
+
+  station = malloc(sizeof(station_t));
+  if(station == NULL)
+  {
+    return(NULL);
+  }
+  bzero(station, sizeof(station_t));
+  memcpy(station->id, id, 4);
+  station->data_callback = transfer->stations_wildcard->data_callback;
+  station->callback_context = transfer->stations_wildcard->callback_context;
+  station->next = transfer->stations[hash];
+  transfer->stations[hash] = station;
+  transfer->stations_count++;
+  if(verbose)
+  {
+    fprintf(stderr, _("Info: New station '%s'\n"), station->id);
+  }
+
+  return(station);
+}
+
+/* Pass the payload of a frame to the callback of its station */
+void station_receive(ofdm_transfer_t transfer,
+                     station_t *station,
+                     unsigned int counter,
+                     unsigned char *payload,
+                     unsigned int payload_size)
+{
+  station->stats.frames_received++;
+  station->stats.bytes_received += payload_size;
+  if((sequence_update(&station->stats, &station->sequence, counter) ==
+      SEQUENCE_DUPLICATE) &&
+     transfer->drop_duplicates)
+  {
+    if(verbose)
+    {
+      fprintf(stderr,
+              _("Frame %u for '%s': duplicate\n"),
+              counter,
+              station->id);
+      fflush(stderr);
+    }
+    return;
+  }
+  station->data_callback(station->callback_context, payload, payload_size);
+}
+
+void stations_free(ofdm_transfer_t transfer)
+{
+  station_t *station;
+  unsigned int i;
+
+  for(i = 0; i < STATIONS_HASH_SIZE; i++)
+  {
+    while(transfer->stations[i])
+    {
+      station = transfer->stations[i];
+      transfer->stations[i] = station->next;
+      free(station);
+    }
+  }
+  transfer->stations_count = 0;
+  free(transfer->stations_wildcard);
+  transfer->stations_wildcard = NULL;
+}
+
+void frame_received(void *context, struct ofdm_modem_frame_s *frame)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+  char *id = frame->id;
+  unsigned int counter = frame->counter;
+  int header_valid = frame->header_valid;
+  unsigned char *payload = frame->payload;
+  unsigned int payload_size = frame->payload_size;
+  int payload_valid = frame->payload_valid;
+  station_t *station;
+
+  transfer->timeout_start = time(NULL);
+
+  /* Check the id first, the frames of the ids that are not received are
+   * not looked at any further */
+  if(header_valid && (memcmp(id, transfer->id, 4) != 0))
+  {
+    station = station_find(transfer, id);
+    if(station == NULL)
+    {
+      transfer->stats.frames_ignored++;
+      transfer->stats.bytes_ignored += payload_size;
+      if(verbose)
+      {
+        fprintf(stderr, _("Frame %u for '%s': ignored\n"), counter, id);
+        fflush(stderr);
+      }
+      return;
+    }
+    if(!payload_valid)
+    {
+      station->stats.payloads_corrupted++;
+      if(verbose)
+      {
+        fprintf(stderr, _("Frame %u for '%s': corrupted payload\n"), counter, id);
+        fflush(stderr);
+      }
+      return;
+    }
+    transfer->scan_activity = 1;
+    station_receive(transfer, station, counter, payload, payload_size);
+    return;
+  }
+
+  if(header_valid && (memcmp(id, transfer->id, 4) == 0))
+  {
+    hop_after_frame(transfer, counter);
+    transfer->scan_activity = 1;
+  }
+
+  if(!header_valid || !payload_valid)
+  {
+    if(!header_valid)
+    {
+      transfer->stats.headers_corrupted++;
+    }
+    else
+    {
+      transfer->stats.payloads_corrupted++;
+      if(transfer->arq_data && (memcmp(id, transfer->id, 4) == 0))
+      {
+        arq_request_ack(transfer);
+      }
+    }
+    if(verbose)
+    {
+      if(!header_valid)
+      {
+        fprintf(stderr, _("Frame %u for '%s': corrupted header\n"), counter, id);
+      }
+      if(!payload_valid)
+      {
+        fprintf(stderr, _("Frame %u for '%s': corrupted payload\n"), counter, id);
+      }
+      fflush(stderr);
+    }
+  }
+  else
+  {
+    transfer->stats.frames_received++;
+    transfer->stats.bytes_received += payload_size;
+    /* In reliable mode, the frames sent again are handled by the ARQ */
+    if((!transfer->arq_data) &&
+       (sequence_update(&transfer->stats, &transfer->sequence, counter) ==
+        SEQUENCE_DUPLICATE) &&
+       transfer->drop_duplicates)
+    {
+      if(verbose)
+      {
+        fprintf(stderr, _("Frame %u for '%s': duplicate\n"), counter, id);
+        fflush(stderr);
+      }
+      return;
+    }
+    if(transfer->erasure)
+    {
+      erasure_skip_unsent(transfer, counter, payload, payload_size);
+    }
+    if(transfer->reorder)
+    {
+      reorder_push(transfer, counter, payload, payload_size);
+    }
+    else
+    {
+      receive_frame(transfer, counter, payload, payload_size);
+    }
+  }
+}
+
+void demodulator_free(ofdm_transfer_t transfer)
+{
+  ofdm_modem_free(transfer->demodulator);
+  transfer->demodulator = NULL;
+}
+
+/* Decide from its header whether the payload of a frame must be decoded: only
+ * the frames of the id of the transfer and of the ids added are kept */
+int header_received(void *context, struct ofdm_modem_frame_s *frame)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) context;
+
+  if((memcmp(frame->id, transfer->id, 4) == 0) ||
+     (station_find(transfer, frame->id) != NULL))
+  {
+    return(1);
+  }
+
+  transfer->timeout_start = time(NULL);
+  transfer->stats.frames_ignored++;
+  transfer->stats.bytes_ignored += frame->payload_size;
+  transfer->stats.symbols_skipped += frame->payload_symbols;
+  if(verbose)
+  {
+    fprintf(stderr,
+            _("Frame %u for '%s': ignored\n"),
+            frame->counter,
+            frame->id);
+    fflush(stderr);
+  }
+
+  return(0);
+}
+
+/* Create the modem used to receive frames, or only reset it if it was already
+ * created by a previous transfer */
+int demodulator_prepare(ofdm_transfer_t transfer)
+{
+  struct ofdm_modem_config_s config;
+
+  if(transfer->demodulator)
+  {
+    ofdm_modem_reset(transfer->demodulator);
+    ofdm_modem_set_frequency_offset(transfer->demodulator,
+                                    transfer->frequency_offset);
+    return(0);
+  }
+
+  get_modem_config(transfer, &config);
+  config.frame_callback = frame_received;
+  if(transfer->skip_other_ids)
+  {
+    config.header_callback = header_received;
+  }
+  config.callback_context = transfer;
+  transfer->demodulator = ofdm_modem_create(&config);
+  if(transfer->demodulator == NULL)
+  {
+    return(-1);
+  }
+
+  return(get_samples_buffer(transfer, transfer->demodulator));
+}
+
+/* When scanning, stay on the current channel while frames are detected,
+ * otherwise go to the next channel after the dwell time, or after the quiet
+ * time if frames were received on this channel */
+void scan_after_block(ofdm_transfer_t transfer, unsigned int samples)
+{
+  unsigned long int limit;
+
+  if(transfer->scan_count == 0)
+  {
+    return;
+  }
+
+  if(transfer->scan_activity ||
+     ofdm_modem_is_frame_open(transfer->demodulator))
+  {
+    if(verbose && !transfer->scan_locked)
+    {
+      fprintf(stderr,
+              _("Info: Locked on %lu Hz\n"),
+              transfer->scan_frequencies[transfer->scan_channel]);
+    }
+    transfer->scan_activity = 0;
+    transfer->scan_locked = 1;
+    transfer->scan_samples = 0;
+    return;
+  }
+
+  transfer->scan_samples += samples;
+  limit = transfer->scan_locked ? transfer->scan_quiet : transfer->scan_dwell;
+  if(transfer->scan_samples < limit)
+  {
+    return;
+  }
+
+  transfer->scan_locked = 0;
+  transfer->scan_samples = 0;
+  if(transfer->scan_count > 1)
+  {
+    transfer->scan_channel = (transfer->scan_channel + 1) % transfer->scan_count;
+    move_to_frequency(transfer, transfer->scan_frequencies[transfer->scan_channel]);
+    ofdm_modem_reset(transfer->demodulator);
+  }
+}
+
+int receive_frames_begin(ofdm_transfer_t transfer)
+{
+  station_t *station;
+  unsigned int i;
+
+  if(demodulator_prepare(transfer) != 0)
+  {
+    return(-1);
+  }
+  if(transfer->erasure)
+  {
+    if(erasure_prepare(transfer) != 0)
+    {
+      return(-1);
+    }
+    transfer->erasure->block_valid = 0;
+  }
+  if(transfer->carousel)
+  {
+    free(transfer->carousel->bitmap);
+    transfer->carousel->bitmap = NULL;
+    transfer->carousel->started = 0;
+    transfer->carousel->complete = 0;
+    transfer->carousel->checkpoint_dirty = 0;
+    transfer->carousel->checkpoint_time = get_monotonic_time();
+    if(transfer->carousel->checkpoint &&
+       (carousel_load_checkpoint(transfer) != 0))
+    {
+      return(-1);
+    }
+  }
+  transfer->sequence.valid = 0;
+  for(i = 0; i < STATIONS_HASH_SIZE; i++)
+  {
+    for(station = transfer->stations[i];
+        station != NULL;
+        station = station->next)
+    {
+      station->sequence.valid = 0;
+    }
+  }
+  if(transfer->reorder && (reorder_prepare(transfer) != 0))
+  {
+    return(-1);
+  }
+  if(transfer->truncate_output)
+  {
+    /* Keep the data of the file when resuming from a checkpoint */
+    if(!(transfer->carousel && transfer->carousel->started) &&
+       (ftruncate(fileno(transfer->file), 0) != 0) &&
+       (errno != EINVAL))
+    {
+      fprintf(stderr, _("Error: Failed to write the file\n"));
+      return(-1);
+    }
+    transfer->truncate_output = 0;
+  }
+  start_delivery_thread(transfer);
+  transfer->next_timestamp_valid = 0;
+  transfer->resync_needed = 0;
+  if(transfer->arq_data)
+  {
+    arq_reset(transfer->arq);
+  }
+  /* Wait for the sender on the first channel. If the receiver loses the
+   * sender, it will find it again when the sender comes back to this
+   * channel. */
+  if(transfer->hop_count > 0)
+  {
+    transfer->hop_channel = 0;
+    move_to_frequency(transfer, transfer->hop_frequencies[0]);
+  }
+  if(transfer->scan_count > 0)
+  {
+    transfer->scan_channel = 0;
+    transfer->scan_samples = 0;
+    transfer->scan_locked = 0;
+    transfer->scan_activity = 0;
+    move_to_frequency(transfer, transfer->scan_frequencies[0]);
+  }
+
+  return(0);
+}
+
+/* Receive and decode the next block of samples. Return 0 when there are no
+ * more samples or after a timeout, -1 if the radio has failed, 1 otherwise. */
+int receive_frames_step(ofdm_transfer_t transfer)
+{
+  unsigned int n;
+
+  apply_settings(transfer);
+  n = receive_from_radio(transfer,
+                         transfer->samples,
+                         ofdm_modem_get_block_size(transfer->demodulator));
+  if(transfer->radio_failed)
+  {
+    return(-1);
+  }
+  if((n == 0) &&
+     ((transfer->radio_type == IO) || (transfer->radio_type == FILENAME)))
+  {
+    return(0);
+  }
+  if((transfer->timeout > 0) &&
+     (time(NULL) > transfer->timeout_start + transfer->timeout))
+  {
+    if(verbose)
+    {
+      fprintf(stderr, _("Timeout: %d s without frames\n"), transfer->timeout);
+    }
+    return(0);
+  }
+  if(transfer->dump)
+  {
+    dump_samples(transfer, transfer->samples, n);
+  }
+  if(transfer->resync_needed)
+  {
+    /* Drop the frame that was being decoded, it can't be complete */
+    ofdm_modem_reset(transfer->demodulator);
+    transfer->resync_needed = 0;
+  }
+  ofdm_modem_demodulate(transfer->demodulator, transfer->samples, n);
+  if(transfer->carousel && transfer->carousel->complete)
+  {
+    return(0);
+  }
+  if(transfer->reorder &&
+     (transfer->reorder->held > 0) &&
+     (get_monotonic_time() - transfer->reorder->hold_time >=
+      ((transfer->latency > 0) ?
+       transfer->latency / 1000.0 :
+       OUTPUT_THROUGHPUT_DELAY)))
+  {
+    /* Don't wait any longer for the missing frames */
+    reorder_deliver(transfer, 1);
+  }
+  if(transfer->carousel &&
+     transfer->carousel->checkpoint &&
+     transfer->carousel->checkpoint_dirty &&
+     (get_monotonic_time() - transfer->carousel->checkpoint_time >=
+      CHECKPOINT_INTERVAL))
+  {
+    carousel_save_checkpoint(transfer);
+  }
+  scan_after_block(transfer, n);
+  if(transfer->data_callback == write_data)
+  {
+    flush_output_if_due(transfer);
+  }
+
+  return(1);
+}
+
+void receive_frames_end(ofdm_transfer_t transfer)
+{
+  ofdm_modem_demodulate_end(transfer->demodulator);
+  if(transfer->reorder)
+  {
+    reorder_deliver(transfer, 1);
+  }
+  if(transfer->erasure && transfer->erasure->block_valid)
+  {
+    /* Deliver what remains of the last block */
+    erasure_deliver(transfer, 1);
+    transfer->erasure->block_valid = 0;
+  }
+  if(transfer->carousel &&
+     transfer->carousel->checkpoint &&
+     transfer->carousel->checkpoint_dirty)
+  {
+    carousel_save_checkpoint(transfer);
+  }
+  stop_delivery_thread(transfer);
+  pthread_mutex_lock(&transfer->output_mutex);
+  flush_output(transfer, NULL, 0);
+  pthread_mutex_unlock(&transfer->output_mutex);
+}
+
+ofdm_transfer_t ofdm_transfer_create_callback(char *radio_driver,
+                                              unsigned char emit,
+                                              int (*data_callback)(void *,
+                                                                   unsigned char *,
+                                                                   unsigned int),
+                                              void *callback_context,
+                                              unsigned long int sample_rate,
+                                              unsigned int bit_rate,
+                                              unsigned long int frequency,
+                                              long int frequency_offset,
+                                              char *gain,
+                                              float ppm,
+                                              char *subcarrier_modulation,
+                                              unsigned int subcarriers,
+                                              unsigned int cyclic_prefix_length,
+                                              unsigned int taper_length,
+                                              char *inner_fec,
+                                              char *outer_fec,
+                                              char *id,
+                                              char *dump,
+                                              unsigned int timeout,
+                                              unsigned char audio)
+{
+  int gain_value;
+  ofdm_transfer_t transfer = malloc(sizeof(struct ofdm_transfer_s));
+
+  if(transfer == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(NULL);
+  }
+  bzero(transfer, sizeof(struct ofdm_transfer_s));
+  transfer->timer_fd = -1;
+
+  if(strcasecmp(radio_driver, "io") == 0)
+  {
+    transfer->radio_type = IO;
+  }
+  else if(strncasecmp(radio_driver, "file=", 5) == 0)
+  {
+    transfer->radio_type = FILENAME;
+  }
+  else
+  {
+    transfer->radio_type = SOAPYSDR;
+  }
+
+  transfer->stop = 0;
+  transfer->emit = emit;
+  transfer->file = NULL;
+  transfer->data_callback = data_callback;
+  transfer->callback_context = callback_context;
+
+  if(sample_rate != 0)
+  {
+    transfer->sample_rate = sample_rate * ((1000000.0 - ppm) / 1000000.0);
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Invalid sample rate\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  if(frequency != 0)
+  {
+    transfer->frequency = frequency * ((1000000.0 - ppm) / 1000000.0);
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Invalid frequency\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  transfer->frequency_offset = frequency_offset;
+  transfer->ppm = ppm;
+
+  if(audio)
+  {
+    if((transfer->radio_type == IO) || (transfer->radio_type == FILENAME))
+    {
+      transfer->audio_converter = firhilbf_create(25, 60);
+      /* The rate of audio samples is twice the rate of IQ samples */
+      transfer->sample_rate = transfer->sample_rate / 2;
+      /* -(sample_rate / 2) Hz IQ <=> 0 Hz audio
+       * (sample_rate / 2) Hz IQ <=> (sample_rate * 2) Hz audio */
+      transfer->frequency_offset = transfer->frequency - (transfer->sample_rate / 2);
+      transfer->frequency = 0;
+      gain_value = strtol(gain, NULL, 10);
+      transfer->audio_gain = powf(10, gain_value / 20.0);
+    }
+    else
+    {
+      fprintf(stderr, _("Error: This radio type only supports IQ samples\n"));
+      free(transfer);
+      return(NULL);
+    }
+  }
+  else
+  {
+    transfer->audio_converter = NULL;
+    transfer->audio_gain = 0;
+  }
+
+  if(bit_rate != 0)
+  {
+    transfer->bit_rate = bit_rate;
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Invalid bit rate\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  transfer->subcarrier_modulation = liquid_getopt_str2mod(subcarrier_modulation);
+  switch(transfer->subcarrier_modulation)
+  {
+  case LIQUID_MODEM_BPSK:
+  case LIQUID_MODEM_QPSK:
+  case LIQUID_MODEM_PSK8:
+  case LIQUID_MODEM_APSK16:
+  case LIQUID_MODEM_APSK32:
+  case LIQUID_MODEM_APSK64:
+  case LIQUID_MODEM_APSK128:
+  case LIQUID_MODEM_APSK256:
+    break;
+
+  default:
+    fprintf(stderr, _("Error: Invalid subcarrier modulation\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  if(subcarriers != 0)
+  {
+    transfer->subcarriers = subcarriers;
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Invalid number of subcarriers\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  transfer->cyclic_prefix_length = cyclic_prefix_length;
+  transfer->taper_length = taper_length;
+  transfer->crc = LIQUID_CRC_32;
+
+  transfer->inner_fec = liquid_getopt_str2fec(inner_fec);
+  if(transfer->inner_fec == LIQUID_FEC_UNKNOWN)
+  {
+    fprintf(stderr, _("Error: Invalid inner FEC\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  transfer->outer_fec = liquid_getopt_str2fec(outer_fec);
+  if(transfer->outer_fec == LIQUID_FEC_UNKNOWN)
+  {
+    fprintf(stderr, _("Error: Invalid outer FEC\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  if(strlen(id) <= 4)
+  {
+    strcpy(transfer->id, id);
+  }
+  else
+  {
+    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
+    free(transfer);
+    return(NULL);
+  }
+
+  if(dump)
+  {
+    transfer->dump = fopen(dump, "wb");
+    if(transfer->dump == NULL)
+    {
+      fprintf(stderr, _("Error: Failed to open '%s'\n"), dump);
+      free(transfer);
+      return(NULL);
+    }
+  }
+  else
+  {
+    transfer->dump = NULL;
+  }
+
+  transfer->timeout = timeout;
+  transfer->latency = 100;
+  transfer->minimum_payload_size = 16;
+  transfer->maximum_payload_size = MAX_PAYLOAD_SIZE;
+  transfer->adaptive_payload_size = 0;
+  transfer->coalescing_delay = 0;
+  transfer->datagram = 0;
+  transfer->message = NULL;
+
+  switch(transfer->radio_type)
+  {
+  case IO:
+    break;
+
+  case FILENAME:
+    transfer->radio_filename = strdup(radio_driver + 5);
+    if(transfer->radio_filename == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      free(transfer);
+      return(NULL);
+    }
+    if(emit)
+    {
+      transfer->radio_device.file = fopen(radio_driver + 5, "wb");
+    }
+    else
+    {
+      transfer->radio_device.file = fopen(radio_driver + 5, "rb");
+    }
+    if(transfer->radio_device.file == NULL)
+    {
+      fprintf(stderr, _("Error: Failed to open '%s'\n"), radio_driver + 5);
+      free(transfer->radio_filename);
+      free(transfer);
+      return(NULL);
+    }
+    break;
+
+  case SOAPYSDR:
+    /* Kept to open the radio again if it fails */
+    transfer->radio_args = strdup(radio_driver);
+    if(transfer->radio_args == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      free(transfer);
+      return(NULL);
+    }
+    transfer->radio_device.soapysdr = SoapySDRDevice_makeStrArgs(radio_driver);
+    if(transfer->radio_device.soapysdr == NULL)
+    {
+      fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
+      free(transfer->radio_args);
+      free(transfer);
+      return(NULL);
+    }
+    transfer->radio_stream.soapysdr = setup_soapysdr_stream(transfer,
+                                                            emit,
+                                                            gain);
+    if(transfer->radio_stream.soapysdr == NULL)
+    {
+      SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
+      free(transfer->radio_gain[SOAPY_SDR_TX]);
+      free(transfer->radio_gain[SOAPY_SDR_RX]);
+      free(transfer->radio_args);
+      free(transfer);
+      return(NULL);
+    }
+    break;
+
+  default:
+    fprintf(stderr, _("Error: Unknown radio type\n"));
+    free(transfer);
+    return(NULL);
+    break;
+  }
+
+  transfer->default_frequency_offset = transfer->frequency_offset;
+  pthread_mutex_init(&transfer->settings_mutex, NULL);
+  pthread_mutex_init(&transfer->output_mutex, NULL);
+
+  return(transfer);
+}
+
+ofdm_transfer_t ofdm_transfer_create(char *radio_driver,
+                                     unsigned char emit,
+                                     char *file,
+                                     unsigned long int sample_rate,
+                                     unsigned int bit_rate,
+                                     unsigned long int frequency,
+                                     long int frequency_offset,
+                                     char *gain,
+                                     float ppm,
+                                     char *subcarrier_modulation,
+                                     unsigned int subcarriers,
+                                     unsigned int cyclic_prefix_length,
+                                     unsigned int taper_length,
+                                     char *inner_fec,
+                                     char *outer_fec,
+                                     char *id,
+                                     char *dump,
+                                     unsigned int timeout,
+                                     unsigned char audio)
+{
+  int flags;
+  int fd;
+  ofdm_transfer_t transfer;
+
+  transfer = ofdm_transfer_create_callback(radio_driver,
+                                           emit,
+                                           emit ? read_data : write_data,
+                                           NULL,
+                                           sample_rate,
+                                           bit_rate,
+                                           frequency,
+                                           frequency_offset,
+                                           gain,
+                                           ppm,
+                                           subcarrier_modulation,
+                                           subcarriers,
+                                           cyclic_prefix_length,
+                                           taper_length,
+                                           inner_fec,
+                                           outer_fec,
+                                           id,
+                                           dump,
+                                           timeout,
+                                           audio);
+  if(transfer == NULL)
+  {
+    return(NULL);
+  }
+
+  transfer->callback_context = transfer;
+  if(file)
+  {
+    if(emit)
+    {
+      transfer->file = fopen(file, "rb");
+    }
+    else
+    {
+      /* The file is truncated when the reception begins, so that it can be
+       * kept when resuming from a checkpoint */
+      fd = open(file, O_WRONLY | O_CREAT, 0666);
+      transfer->file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+      transfer->truncate_output = 1;
+    }
+    if(transfer->file == NULL)
+    {
+      fprintf(stderr, _("Error: Failed to open '%s'\n"), file);
+      free(transfer);
+      return(NULL);
+    }
+  }
+  else
+  {
+    if(emit)
+    {
+      transfer->file = stdin;
+      flags = fcntl(STDIN_FILENO, F_GETFL);
+      fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+    }
+    else
+    {
+      transfer->file = stdout;
+    }
+  }
+  if((!emit) &&
+     (ofdm_transfer_set_output_buffer(transfer, OUTPUT_BUFFER_SIZE, 0) != 0))
+  {
+    ofdm_transfer_free(transfer);
+    return(NULL);
+  }
+
+  return(transfer);
+}
+
+ofdm_transfer_t ofdm_transfer_create_reverse(ofdm_transfer_t transfer,
+                                             int (*data_callback)(void *,
+                                                                  unsigned char *,
+                                                                  unsigned int),
+                                             void *callback_context,
+                                             unsigned long int frequency,
+                                             char *gain)
+{
+  int flags;
+  ofdm_transfer_t reverse;
+
+  if((transfer->radio_type != IO) && (transfer->radio_type != SOAPYSDR))
+  {
+    fprintf(stderr,
+            _("Error: This radio type doesn't support full-duplex transfers\n"));
+    return(NULL);
+  }
+  if(transfer->other_radio_stream.soapysdr)
+  {
+    fprintf(stderr,
+            _("Error: The radio is already used in the other direction\n"));
+    return(NULL);
+  }
+
+  reverse = malloc(sizeof(struct ofdm_transfer_s));
+  if(reverse == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(NULL);
+  }
+  bzero(reverse, sizeof(struct ofdm_transfer_s));
+  reverse->timer_fd = -1;
+
+  /* Same radio and modem settings, opposite direction */
+  reverse->radio_type = transfer->radio_type;
+  reverse->radio_device = transfer->radio_device;
+  reverse->emit = !transfer->emit;
+  if(data_callback)
+  {
+    reverse->file = NULL;
+    reverse->data_callback = data_callback;
+    reverse->callback_context = callback_context;
+  }
+  else if(transfer->tun)
+  {
+    /* Same network interface, the other way */
+    reverse->file = NULL;
+    reverse->tun = 1;
+    reverse->tun_fd = transfer->tun_fd;
+    reverse->tun_mtu = transfer->tun_mtu;
+    reverse->data_callback = reverse->emit ? read_tun : write_tun;
+    reverse->callback_context = reverse;
+  }
+  else if(reverse->emit)
+  {
+    reverse->file = stdin;
+    flags = fcntl(STDIN_FILENO, F_GETFL);
+    fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+    reverse->data_callback = read_data;
+    reverse->callback_context = reverse;
+  }
+  else
+  {
+    reverse->file = stdout;
+    reverse->data_callback = write_data;
+    reverse->callback_context = reverse;
+  }
+  reverse->sample_rate = transfer->sample_rate;
+  reverse->bit_rate = transfer->bit_rate;
+  reverse->frequency = transfer->frequency;
+  reverse->frequency_offset = transfer->frequency_offset;
+  reverse->ppm = transfer->ppm;
+  if(frequency != 0)
+  {
+    if(transfer->audio_converter)
+    {
+      reverse->frequency_offset = (frequency * ((1000000.0 - transfer->ppm) /
+                                                1000000.0)) -
+        (transfer->sample_rate / 2);
+    }
+    else
+    {
+      reverse->frequency = frequency * ((1000000.0 - transfer->ppm) / 1000000.0);
+    }
+  }
+  reverse->default_frequency_offset = reverse->frequency_offset;
+  reverse->subcarrier_modulation = transfer->subcarrier_modulation;
+  reverse->subcarriers = transfer->subcarriers;
+  reverse->cyclic_prefix_length = transfer->cyclic_prefix_length;
+  reverse->taper_length = transfer->taper_length;
+  reverse->crc = transfer->crc;
+  reverse->inner_fec = transfer->inner_fec;
+  reverse->outer_fec = transfer->outer_fec;
+  strcpy(reverse->id, transfer->id);
+  reverse->dump = NULL;
+  reverse->timeout = transfer->timeout;
+  if(transfer->audio_converter)
+  {
+    reverse->audio_converter = firhilbf_create(25, 60);
+    reverse->audio_gain = powf(10, strtol(gain, NULL, 10) / 20.0);
+  }
+  reverse->latency = transfer->latency;
+  reverse->minimum_payload_size = transfer->minimum_payload_size;
+  reverse->maximum_payload_size = transfer->maximum_payload_size;
+  reverse->adaptive_payload_size = transfer->adaptive_payload_size;
+  reverse->coalescing_delay = transfer->coalescing_delay;
+  if(transfer->datagram &&
+     (ofdm_transfer_set_datagram_mode(reverse, 1) != 0))
+  {
+    if(reverse->audio_converter)
+    {
+      firhilbf_destroy(reverse->audio_converter);
+    }
+    free(reverse);
+    return(NULL);
+  }
+
+  if(transfer->radio_type == SOAPYSDR)
+  {
+    if(transfer->shared_device == NULL)
+    {
+      transfer->shared_device = malloc(sizeof(shared_device_t));
+      if(transfer->shared_device == NULL)
+      {
+        fprintf(stderr, _("Error: Memory allocation failed\n"));
+        free(reverse->message);
+        free(reverse);
+        return(NULL);
+      }
+      pthread_mutex_init(&transfer->shared_device->mutex, NULL);
+      transfer->shared_device->references = 1;
+    }
+    lock_device(transfer);
+    reverse->radio_stream.soapysdr = setup_soapysdr_stream(reverse,
+                                                           reverse->emit,
+                                                           gain);
+    if(reverse->radio_stream.soapysdr != NULL)
+    {
+      transfer->shared_device->references++;
+      reverse->shared_device = transfer->shared_device;
+    }
+    unlock_device(transfer);
+    if(reverse->radio_stream.soapysdr == NULL)
+    {
+      free(reverse->message);
+      if(reverse->audio_converter)
+      {
+        firhilbf_destroy(reverse->audio_converter);
+      }
+      free(reverse);
+      return(NULL);
+    }
+  }
+  pthread_mutex_init(&reverse->settings_mutex, NULL);
+  pthread_mutex_init(&reverse->output_mutex, NULL);
+  if((reverse->data_callback == write_data) &&
+     (ofdm_transfer_set_output_buffer(reverse, OUTPUT_BUFFER_SIZE, 0) != 0))
+  {
+    ofdm_transfer_free(reverse);
+    return(NULL);
+  }
+
+  return(reverse);
+}
+
+void ofdm_transfer_free(ofdm_transfer_t transfer)
+{
+  if(transfer)
+  {
+    /* The delivery thread uses the output and the stations until it has
+     * passed all the data queued to the callbacks */
+    stop_delivery_thread(transfer);
+    flush_output(transfer, NULL, 0);
+    output_buffers_free(transfer);
+    if(transfer->file)
+    {
+      fclose(transfer->file);
+    }
+    if(transfer->tun_owned)
+    {
+      close(transfer->tun_fd);
+    }
+    if(transfer->timer_fd >= 0)
+    {
+      close(transfer->timer_fd);
+    }
+    if(transfer->arq)
+    {
+      arq_release(transfer->arq);
+    }
+    erasure_free(transfer->erasure);
+    reorder_free(transfer->reorder);
+    stations_free(transfer);
+    if(transfer->carousel)
+    {
+      free(transfer->carousel->bitmap);
+      free(transfer->carousel->checkpoint);
+      free(transfer->carousel);
+    }
+    if(transfer->dump)
+    {
+      fclose(transfer->dump);
+    }
+    if(transfer->audio_converter)
+    {
+      firhilbf_destroy(transfer->audio_converter);
+    }
+    if(transfer->message)
+    {
+      free(transfer->message);
+    }
+    modulator_free(transfer);
+    demodulator_free(transfer);
+    free(transfer->payload);
+    free(transfer->coalesce_buffer);
+    free(transfer->samples);
+    free(transfer->new_gain);
+    free(transfer->hop_frequencies);
+    free(transfer->scan_frequencies);
+    queue_free(transfer->send_queue);
+    queue_free(transfer->delivery_queue);
+    free(transfer->delivery_buffer);
+    pthread_mutex_destroy(&transfer->settings_mutex);
+    pthread_mutex_destroy(&transfer->output_mutex);
+    switch(transfer->radio_type)
+    {
+    case IO:
+      break;
+
+    case FILENAME:
+      if(transfer->radio_device.file)
+      {
+        fclose(transfer->radio_device.file);
+      }
+      free(transfer->radio_filename);
+      break;
+
+    case SOAPYSDR:
+      free(transfer->radio_args);
+      free(transfer->radio_gain[SOAPY_SDR_TX]);
+      free(transfer->radio_gain[SOAPY_SDR_RX]);
+      if(transfer->radio_device.soapysdr == NULL)
+      {
+        /* The radio couldn't be opened again after a failure */
+        break;
+      }
+      lock_device(transfer);
+      if(transfer->radio_stream_active)
+      {
+        SoapySDRDevice_deactivateStream(transfer->radio_device.soapysdr,
+                                        transfer->radio_stream.soapysdr,
+                                        0,
+                                        0);
+      }
+      if(transfer->radio_stream.soapysdr)
+      {
+        SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                                   transfer->radio_stream.soapysdr);
+      }
+      if(transfer->other_radio_stream.soapysdr)
+      {
+        SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
+                                   transfer->other_radio_stream.soapysdr);
+      }
+      if(transfer->shared_device)
+      {
+        /* The device is closed by the last transfer using it */
+        transfer->shared_device->references--;
+        if(transfer->shared_device->references > 0)
+        {
+          unlock_device(transfer);
+          break;
+        }
+        unlock_device(transfer);
+        pthread_mutex_destroy(&transfer->shared_device->mutex);
+        free(transfer->shared_device);
+      }
+      SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
+      break;
+
+    default:
+      break;
+    }
+    free(transfer);
+  }
+}
+
+void ofdm_transfer_config_init_default(struct ofdm_transfer_config_s *config)
+{
+  bzero(config, sizeof(struct ofdm_transfer_config_s));
+  config->radio_driver = "";
+  config->emit = 0;
+  config->file = NULL;
+  config->data_callback = NULL;
+  config->callback_context = NULL;
+  config->sample_rate = 2000000;
+  config->bit_rate = 38400;
+  config->frequency = 434000000;
+  config->frequency_offset = 0;
+  config->gain = "0";
+  config->ppm = 0;
+  config->subcarrier_modulation = "qpsk";
+  config->subcarriers = 64;
+  config->cyclic_prefix_length = 16;
+  config->taper_length = 4;
+  config->inner_fec = "h128";
+  config->outer_fec = "none";
+  config->id = "";
+  config->dump = NULL;
+  config->timeout = 0;
+  config->audio = 0;
+  config->latency = 100;
+  config->minimum_payload_size = 16;
+  config->maximum_payload_size = MAX_PAYLOAD_SIZE;
+  config->adaptive_payload_size = 0;
+  config->coalescing_delay = 0;
+  config->datagram = 0;
+  config->hop_frequencies = NULL;
+  config->hop_count = 0;
+  config->hop_dwell = 1;
+  config->scan_frequencies = NULL;
+  config->scan_count = 0;
+  config->scan_dwell = 100;
+  config->scan_quiet = 1000;
+  config->send_queue_size = 0;
+  config->delivery_queue_size = 0;
+  config->delivery_policy = OFDM_TRANSFER_DELIVERY_BLOCK;
+  config->output_buffer_size = OUTPUT_BUFFER_SIZE;
+  config->output_splice = 0;
+  config->tun = NULL;
+  config->tun_fd = -1;
+  config->tun_mtu = 0;
+  config->erasure_data_frames = 0;
+  config->erasure_parity_frames = 0;
+  config->carousel = 0;
+  config->carousel_cycles = 0;
+  config->carousel_start = 0;
+  config->checkpoint = NULL;
+  config->reorder_frames = 0;
+  config->drop_duplicates = 0;
+  config->skip_other_ids = 0;
+}
+
+ofdm_transfer_t ofdm_transfer_create_with_config(struct ofdm_transfer_config_s *config)
+{
+  ofdm_transfer_t transfer;
+  int tun_fd;
+
+  if(config->data_callback ||
+     config->tun ||
+     (config->tun_fd >= 0) ||
+     (config->emit && config->send_queue_size))
+  {
+    transfer = ofdm_transfer_create_callback(config->radio_driver,
+                                             config->emit,
+                                             config->data_callback,
+                                             config->callback_context,
+                                             config->sample_rate,
+                                             config->bit_rate,
+                                             config->frequency,
+                                             config->frequency_offset,
+                                             config->gain,
+                                             config->ppm,
+                                             config->subcarrier_modulation,
+                                             config->subcarriers,
+                                             config->cyclic_prefix_length,
+                                             config->taper_length,
+                                             config->inner_fec,
+                                             config->outer_fec,
+                                             config->id,
+                                             config->dump,
+                                             config->timeout,
+                                             config->audio);
+  }
+  else
+  {
+    transfer = ofdm_transfer_create(config->radio_driver,
+                                    config->emit,
+                                    config->file,
+                                    config->sample_rate,
+                                    config->bit_rate,
+                                    config->frequency,
+                                    config->frequency_offset,
+                                    config->gain,
+                                    config->ppm,
+                                    config->subcarrier_modulation,
+                                    config->subcarriers,
+                                    config->cyclic_prefix_length,
+                                    config->taper_length,
+                                    config->inner_fec,
+                                    config->outer_fec,
+                                    config->id,
+                                    config->dump,
+                                    config->timeout,
+                                    config->audio);
+  }
+  if(transfer == NULL)
+  {
+    return(NULL);
+  }
+
+  ofdm_transfer_set_latency(transfer, config->latency);
+  ofdm_transfer_set_coalescing(transfer, config->coalescing_delay);
+  if((ofdm_transfer_set_payload_size(transfer,
+                                     config->minimum_payload_size,
+                                     config->maximum_payload_size,
+                                     config->adaptive_payload_size) != 0) ||
+     (ofdm_transfer_set_datagram_mode(transfer, config->datagram) != 0) ||
+     (ofdm_transfer_set_hopping(transfer,
+                                config->hop_frequencies,
+                                config->hop_count,
+                                config->hop_dwell) != 0) ||
+     (ofdm_transfer_set_scanning(transfer,
+                                 config->scan_frequencies,
+                                 config->scan_count,
+                                 config->scan_dwell,
+                                 config->scan_quiet) != 0) ||
+     (config->emit &&
+      config->send_queue_size &&
+      (ofdm_transfer_set_send_queue(transfer, config->send_queue_size) != 0)) ||
+     ((!config->emit) &&
+      config->delivery_queue_size &&
+      (ofdm_transfer_set_delivery_queue(transfer,
+                                        config->delivery_queue_size,
+                                        config->delivery_policy) != 0)) ||
+     ((!config->emit) &&
+      (!config->data_callback) &&
+      (!config->tun) &&
+      (config->tun_fd < 0) &&
+      (ofdm_transfer_set_output_buffer(transfer,
+                                       config->output_buffer_size,
+                                       config->output_splice) != 0)) ||
+     (ofdm_transfer_set_reorder_buffer(transfer, config->reorder_frames) != 0) ||
+     (config->erasure_parity_frames &&
+      (ofdm_transfer_set_erasure_code(transfer,
+                                      config->erasure_data_frames,
+                                      config->erasure_parity_frames) != 0)) ||
+     (config->carousel &&
+      ((ofdm_transfer_set_carousel(transfer, config->carousel_cycles) != 0) ||
+       (ofdm_transfer_set_carousel_start(transfer,
+                                         config->carousel_start) != 0) ||
+       (config->checkpoint &&
+        (ofdm_transfer_set_checkpoint(transfer, config->checkpoint) != 0)))))
+  {
+    ofdm_transfer_free(transfer);
+    return(NULL);
+  }
+
+  ofdm_transfer_set_drop_duplicates(transfer, config->drop_duplicates);
+  ofdm_transfer_set_skip_other_ids(transfer, config->skip_other_ids);
+
+  if(config->tun && (!config->data_callback))
+  {
+    tun_fd = ofdm_transfer_open_tun(config->tun, config->tun_mtu);
+    if(tun_fd < 0)
+    {
+      ofdm_transfer_free(transfer);
+      return(NULL);
+    }
+    if(ofdm_transfer_set_tun(transfer, tun_fd, config->tun_mtu) != 0)
+    {
+      close(tun_fd);
+      ofdm_transfer_free(transfer);
+      return(NULL);
+    }
+    transfer->tun_owned = 1;
+  }
+  else if((config->tun_fd >= 0) && (!config->data_callback))
+  {
+    if(ofdm_transfer_set_tun(transfer, config->tun_fd, config->tun_mtu) != 0)
+    {
+      ofdm_transfer_free(transfer);
+      return(NULL);
+    }
+  }
+
+  return(transfer);
+}
+
+void ofdm_transfer_set_frequency(ofdm_transfer_t transfer,
+                                 unsigned long int frequency)
+{
+  pthread_mutex_lock(&transfer->settings_mutex);
+  transfer->new_frequency = frequency * ((1000000.0 - transfer->ppm) / 1000000.0);
+  transfer->settings_changed |= SETTING_FREQUENCY;
+  pthread_mutex_unlock(&transfer->settings_mutex);
+}
+
+void ofdm_transfer_set_frequency_offset(ofdm_transfer_t transfer,
+                                        long int frequency_offset)
+{
+  pthread_mutex_lock(&transfer->settings_mutex);
+  transfer->new_frequency_offset = frequency_offset;
+  transfer->settings_changed |= SETTING_FREQUENCY_OFFSET;
+  pthread_mutex_unlock(&transfer->settings_mutex);
+}
+
+int ofdm_transfer_set_gain(ofdm_transfer_t transfer, char *gain)
+{
+  char *new_gain = strdup(gain);
+
+  if(new_gain == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+
+  pthread_mutex_lock(&transfer->settings_mutex);
+  free(transfer->new_gain);
+  transfer->new_gain = new_gain;
+  transfer->settings_changed |= SETTING_GAIN;
+  pthread_mutex_unlock(&transfer->settings_mutex);
+  return(0);
+}
+
+int ofdm_transfer_set_id(ofdm_transfer_t transfer, char *id)
+{
+  if(strlen(id) > 4)
+  {
+    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
+    return(-1);
+  }
+
+  pthread_mutex_lock(&transfer->settings_mutex);
+  strcpy(transfer->new_id, id);
+  transfer->settings_changed |= SETTING_ID;
+  pthread_mutex_unlock(&transfer->settings_mutex);
+  return(0);
+}
+
+int ofdm_transfer_set_hopping(ofdm_transfer_t transfer,
+                              unsigned long int *frequencies,
+                              unsigned int count,
+                              unsigned int dwell)
+{
+  unsigned long int *hop_frequencies = NULL;
+  unsigned int i;
+
+  if((count > 0) && (dwell == 0))
+  {
+    fprintf(stderr, _("Error: Invalid hop dwell\n"));
+    return(-1);
+  }
+  if((count > 0) && (transfer->scan_count > 0))
+  {
+    fprintf(stderr,
+            _("Error: Frequency hopping and scanning can't be used together\n"));
+    return(-1);
+  }
+  if(count > 0)
+  {
+    hop_frequencies = malloc(count * sizeof(unsigned long int));
+    if(hop_frequencies == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+    for(i = 0; i < count; i++)
+    {
+      if(frequencies[i] == 0)
+      {
+        fprintf(stderr, _("Error: Invalid frequency\n"));
+        free(hop_frequencies);
+        return(-1);
+      }
+      hop_frequencies[i] = frequencies[i] * ((1000000.0 - transfer->ppm) /
+                                             1000000.0);
+    }
+  }
+
+  free(transfer->hop_frequencies);
+  transfer->hop_frequencies = hop_frequencies;
+  transfer->hop_count = count;
+  transfer->hop_dwell = dwell;
+  transfer->hop_channel = -1;
+  return(0);
+}
+
+int ofdm_transfer_set_scanning(ofdm_transfer_t transfer,
+                               unsigned long int *frequencies,
+                               unsigned int count,
+                               unsigned int dwell,
+                               unsigned int quiet)
+{
+  unsigned long int *scan_frequencies = NULL;
+  unsigned int i;
+
+  if((count > 0) && (dwell == 0))
+  {
+    fprintf(stderr, _("Error: Invalid scan dwell\n"));
+    return(-1);
+  }
+  if((count > 0) && (transfer->hop_count > 0))
+  {
+    fprintf(stderr,
+            _("Error: Frequency hopping and scanning can't be used together\n"));
+    return(-1);
+  }
+  if(count > 0)
+  {
+    scan_frequencies = malloc(count * sizeof(unsigned long int));
+    if(scan_frequencies == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+    for(i = 0; i < count; i++)
+    {
+      if(frequencies[i] == 0)
+      {
+        fprintf(stderr, _("Error: Invalid frequency\n"));
+        free(scan_frequencies);
+        return(-1);
+      }
+      scan_frequencies[i] = frequencies[i] * ((1000000.0 - transfer->ppm) /
+                                              1000000.0);
+    }
+  }
+
+  free(transfer->scan_frequencies);
+  transfer->scan_frequencies = scan_frequencies;
+  transfer->scan_count = count;
+  /* The times are counted in samples, so that scanning a recording works like
+   * scanning with a radio */
+  transfer->scan_dwell = ((unsigned long long int) dwell *
+                          transfer->sample_rate) / 1000;
+  transfer->scan_quiet = ((unsigned long long int) quiet *
+                          transfer->sample_rate) / 1000;
+  return(0);
+}
+
+void ofdm_transfer_set_latency(ofdm_transfer_t transfer, unsigned int latency)
+{
+  if(latency != transfer->latency)
+  {
+    /* The size of the blocks of samples of the modems depends on the
+     * latency */
+    modulator_free(transfer);
+    demodulator_free(transfer);
+  }
+  transfer->latency = latency;
+}
+
+int ofdm_transfer_set_datagram_mode(ofdm_transfer_t transfer,
+                                    unsigned char datagram)
+{
+  if(datagram && (transfer->maximum_payload_size <= DATAGRAM_HEADER_SIZE))
+  {
+    fprintf(stderr,
+            _("Error: The payload size is too small for the datagram mode\n"));
+    return(-1);
+  }
+  if(datagram && (transfer->message == NULL))
+  {
+    transfer->message = malloc(OFDM_TRANSFER_MAX_MESSAGE_SIZE);
+    if(transfer->message == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+  }
+  transfer->datagram = datagram;
+  transfer->message_size = 0;
+  transfer->message_offset = 0;
+  transfer->message_incomplete = 0;
+  return(0);
+}
+
+void ofdm_transfer_set_coalescing(ofdm_transfer_t transfer, unsigned int delay)
+{
+  transfer->coalescing_delay = delay;
+}
+
+int ofdm_transfer_set_payload_size(ofdm_transfer_t transfer,
+                                   unsigned int minimum,
+                                   unsigned int maximum,
+                                   unsigned char adaptive)
+{
+  if((minimum == 0) || (minimum > maximum) || (maximum > MAX_PAYLOAD_SIZE))
+  {
+    fprintf(stderr, _("Error: Invalid payload size\n"));
+    return(-1);
+  }
+  if(transfer->datagram && (maximum <= DATAGRAM_HEADER_SIZE))
+  {
+    fprintf(stderr,
+            _("Error: The payload size is too small for the datagram mode\n"));
+    return(-1);
+  }
+  if(transfer->arq && (maximum > transfer->arq->slot_size))
+  {
+    /* The slots of the window have been allocated for the previous size */
+    fprintf(stderr,
+            _("Error: The payload size can't be increased in reliable mode\n"));
+    return(-1);
+  }
+
+  transfer->minimum_payload_size = minimum;
+  transfer->maximum_payload_size = maximum;
+  transfer->adaptive_payload_size = adaptive;
+  return(0);
+}
+
+int ofdm_transfer_set_send_queue(ofdm_transfer_t transfer, unsigned int size)
+{
+  queue_t *queue;
+
+  if(size < QUEUE_ENTRY_HEADER_SIZE + 1)
+  {
+    fprintf(stderr, _("Error: Invalid send queue size\n"));
+    return(-1);
+  }
+
+  queue = queue_create(size);
+  if(queue == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  queue_free(transfer->send_queue);
+  transfer->send_queue = queue;
+  transfer->data_callback = read_queue;
+  transfer->callback_context = transfer;
+
+  return(0);
+}
+
+int ofdm_transfer_send(ofdm_transfer_t transfer,
+                       unsigned char *data,
+                       unsigned int size,
+                       int timeout)
+{
+  queue_t *queue = transfer->send_queue;
+  struct timespec deadline;
+  unsigned int n = 0;
+  unsigned int space;
+  unsigned int needed;
+
+  if(queue == NULL)
+  {
+    fprintf(stderr, _("Error: The transfer has no send queue\n"));
+    return(-1);
+  }
+  if(size == 0)
+  {
+    return(0);
+  }
+  if(transfer->datagram &&
+     ((size > OFDM_TRANSFER_MAX_MESSAGE_SIZE) ||
+      (size + QUEUE_ENTRY_HEADER_SIZE > queue->size)))
+  {
+    fprintf(stderr, _("Error: Message too large for the send queue\n"));
+    return(-1);
+  }
+
+  if(timeout > 0)
+  {
+    get_deadline(&deadline, timeout);
+  }
+  pthread_mutex_lock(&queue->mutex);
+  while((n < size) && (!queue->closed))
+  {
+    space = queue->size - queue->length;
+    needed = transfer->datagram ? size + QUEUE_ENTRY_HEADER_SIZE : 1;
+    if(space < needed)
+    {
+      if(timeout == 0)
+      {
+        break;
+      }
+      else if(timeout < 0)
+      {
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+      }
+      else if(pthread_cond_timedwait(&queue->not_full,
+                                     &queue->mutex,
+                                     &deadline) == ETIMEDOUT)
+      {
+        break;
+      }
+      continue;
+    }
+
+    if(transfer->datagram)
+    {
+      queue_write_entry(queue, data, size);
+      n = size;
+    }
+    else
+    {
+      needed = MIN(space, size - n);
+      queue_write(queue, data + n, needed);
+      n += needed;
+    }
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+
+  if(n == 0)
+  {
+    return(-1);
+  }
+  return(n);
+}
+
+void ofdm_transfer_send_finish(ofdm_transfer_t transfer)
+{
+  if(transfer->send_queue)
+  {
+    queue_close(transfer->send_queue);
+  }
+}
+
+unsigned int ofdm_transfer_get_send_queue_depth(ofdm_transfer_t transfer)
+{
+  unsigned int depth;
+
+  if(transfer->send_queue == NULL)
+  {
+    return(0);
+  }
+  pthread_mutex_lock(&transfer->send_queue->mutex);
+  depth = transfer->send_queue->length;
+  pthread_mutex_unlock(&transfer->send_queue->mutex);
+
+  return(depth);
+}
+
+int ofdm_transfer_set_delivery_queue(ofdm_transfer_t transfer,
+                                     unsigned int size,
+                                     int policy)
+{
+  queue_t *queue = NULL;
+  unsigned char *buffer = NULL;
+
+  if(transfer->delivery_thread_running)
+  {
+    fprintf(stderr,
+            _("Error: The delivery queue can't be changed while receiving\n"));
+    return(-1);
+  }
+  if((policy != OFDM_TRANSFER_DELIVERY_BLOCK) &&
+     (policy != OFDM_TRANSFER_DELIVERY_DROP_OLDEST) &&
+     (policy != OFDM_TRANSFER_DELIVERY_DROP_NEWEST))
+  {
+    fprintf(stderr, _("Error: Invalid delivery policy\n"));
+    return(-1);
+  }
+
+  if(size > 0)
+  {
+    queue = queue_create(size);
+    buffer = malloc(MAX(MAX_PAYLOAD_SIZE, OFDM_TRANSFER_MAX_MESSAGE_SIZE));
+    if((queue == NULL) || (buffer == NULL))
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      queue_free(queue);
+      free(buffer);
+      return(-1);
+    }
+  }
+  queue_free(transfer->delivery_queue);
+  free(transfer->delivery_buffer);
+  transfer->delivery_queue = queue;
+  transfer->delivery_buffer = buffer;
+  transfer->delivery_policy = policy;
+
+  return(0);
+}
+
+int ofdm_transfer_set_output_buffer(ofdm_transfer_t transfer,
+                                    unsigned int size,
+                                    unsigned char splice)
+{
+  unsigned char *buffer = NULL;
+#ifdef HAVE_VMSPLICE
+  struct stat output_stat;
+#endif
+  int fd;
+
+  if(transfer->emit || (transfer->data_callback != write_data))
+  {
+    fprintf(stderr, _("Error: The transfer doesn't write to a file\n"));
+    return(-1);
+  }
+
+  fd = fileno(transfer->file);
+  if(splice)
+  {
+#ifdef HAVE_VMSPLICE
+    if((fstat(fd, &output_stat) != 0) || (!S_ISFIFO(output_stat.st_mode)))
+    {
+      if(verbose)
+      {
+        fprintf(stderr, _("Info: The output is not a pipe, not splicing\n"));
+      }
+      splice = 0;
+    }
+#else
+    if(verbose)
+    {
+      fprintf(stderr, _("Info: Splicing is not supported, not splicing\n"));
+    }
+    splice = 0;
+#endif
+  }
+  if(size > 0)
+  {
+    buffer = output_buffer_create(size, splice);
+    if(buffer == NULL)
+    {
+      fprintf(stderr, _("Error: Memory allocation failed\n"));
+      return(-1);
+    }
+  }
+
+  pthread_mutex_lock(&transfer->output_mutex);
+  flush_output(transfer, NULL, 0);
+  output_buffers_free(transfer);
+  transfer->output_fd = fd;
+  transfer->output_buffer = buffer;
+  transfer->output_size = size;
+  transfer->output_splice = splice && (size > 0);
+  bzero(transfer->output_ring, sizeof(transfer->output_ring));
+  bzero(transfer->output_ring_pages, sizeof(transfer->output_ring_pages));
+  transfer->output_ring[0] = buffer;
+  transfer->output_ring_index = 0;
+  transfer->output_spliced_pages = 0;
+  pthread_mutex_unlock(&transfer->output_mutex);
+
+  return(0);
+}
+
+int ofdm_transfer_open_tun(char *name, unsigned int mtu)
+{
+#ifdef HAVE_LINUX_IF_TUN_H
+  struct ifreq ifr;
+  int fd;
+  int sock;
+
+  if(strlen(name) >= IFNAMSIZ)
+  {
+    fprintf(stderr, _("Error: Invalid network interface name '%s'\n"), name);
+    return(-1);
+  }
+
+  fd = open("/dev/net/tun", O_RDWR);
+  if(fd < 0)
+  {
+    fprintf(stderr, _("Error: Failed to open '%s'\n"), "/dev/net/tun");
+    return(-1);
+  }
+  bzero(&ifr, sizeof(ifr));
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  strcpy(ifr.ifr_name, name);
+  if(ioctl(fd, TUNSETIFF, &ifr) < 0)
+  {
+    fprintf(stderr,
+            _("Error: Failed to create the network interface '%s'\n"),
+            name);
+    close(fd);
+    return(-1);
+  }
+
+  if(mtu > 0)
+  {
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    ifr.ifr_mtu = mtu;
+    if((sock < 0) || (ioctl(sock, SIOCSIFMTU, &ifr) < 0))
+    {
+      fprintf(stderr,
+              _("Error: Failed to set the MTU of the network interface '%s'\n"),
+              name);
+      if(sock >= 0)
+      {
+        close(sock);
+      }
+      close(fd);
+      return(-1);
+    }
+    close(sock);
+  }
+  if(verbose)
+  {
+    fprintf(stderr, _("Info: Using the network interface '%s'\n"), ifr.ifr_name);
+  }
+
+  return(fd);
+#else
+  fprintf(stderr,
+          _("Error: Network interfaces are not supported on this system\n"));
+  return(-1);
+#endif
+}
+
+int ofdm_transfer_set_tun(ofdm_transfer_t transfer,
+                          int fd,
+                          unsigned int mtu)
+{
+  int flags;
+
+  if(transfer->file)
+  {
+    fprintf(stderr,
+            _("Error: A transfer using a file can't use a network interface\n"));
+    return(-1);
+  }
+  if(ofdm_transfer_set_datagram_mode(transfer, 1) != 0)
+  {
+    return(-1);
+  }
+
+  flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  transfer->tun = 1;
+  transfer->tun_fd = fd;
+  transfer->tun_mtu = mtu;
+  transfer->data_callback = transfer->emit ? read_tun : write_tun;
+  transfer->callback_context = transfer;
+  if(mtu > 0)
+  {
+    /* Make the frames large enough for a whole packet, so that the packets of
+     * the size of the MTU are not fragmented */
+    transfer->minimum_payload_size = MIN(MAX(transfer->minimum_payload_size,
+                                             mtu + DATAGRAM_HEADER_SIZE),
+                                         transfer->maximum_payload_size);
+  }
+
+  return(0);
+}
+
+int ofdm_transfer_set_arq(ofdm_transfer_t transfer,
+                          ofdm_transfer_t reverse,
+                          unsigned int window)
+{
+  arq_t *arq;
+  unsigned int i;
+
+  /* The slot of a frame is given by its counter modulo the window, which
+   * stays consecutive when the counter wraps only if the window is a power
+   * of 2 */
+  if((window == 0) || (window > ARQ_MAX_WINDOW) || (window & (window - 1)))
+  {
+    fprintf(stderr, _("Error: Invalid window size\n"));
+    return(-1);
+  }
+  if(transfer->emit == reverse->emit)
+  {
+    fprintf(stderr,
+            _("Error: The acknowledgements must be sent in the other direction\n"));
+    return(-1);
+  }
+  if((transfer->hop_count > 0) || (reverse->hop_count > 0))
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with frequency hopping\n"));
+    return(-1);
+  }
+  if(transfer->arq || reverse->arq)
+  {
+    fprintf(stderr, _("Error: The reliable mode is already enabled\n"));
+    return(-1);
+  }
+  if(transfer->erasure || reverse->erasure)
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with the erasure code\n"));
+    return(-1);
+  }
+  if(transfer->carousel || reverse->carousel)
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with the carousel mode\n"));
+    return(-1);
+  }
+  if(transfer->reorder || reverse->reorder)
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with a reorder buffer\n"));
+    return(-1);
+  }
+
+  arq = malloc(sizeof(arq_t));
+  if(arq == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  bzero(arq, sizeof(arq_t));
+  arq->window = window;
+  arq->slot_size = transfer->maximum_payload_size;
+  arq->slots = calloc(window, sizeof(arq_slot_t));
+  arq->buffer = malloc(window * arq->slot_size);
+  if((arq->slots == NULL) || (arq->buffer == NULL))
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    free(arq->slots);
+    free(arq->buffer);
+    free(arq);
+    return(-1);
+  }
+  for(i = 0; i < window; i++)
+  {
+    arq->slots[i].data = &arq->buffer[i * arq->slot_size];
+  }
+  pthread_mutex_init(&arq->mutex, NULL);
+  arq->references = 2;
+  arq->rto = ARQ_INITIAL_RTO;
+  transfer->arq = arq;
+  transfer->arq_data = 1;
+  reverse->arq = arq;
+  reverse->arq_data = 0;
+
+  /* The reverse transfer only carries the acknowledgements, it doesn't use
+   * the standard input or output given by ofdm_transfer_create_reverse() */
+  if(reverse->file && (reverse->file != stdin) && (reverse->file != stdout))
+  {
+    fclose(reverse->file);
+  }
+  reverse->file = NULL;
+  ofdm_transfer_set_datagram_mode(reverse, 0);
+  reverse->coalescing_delay = 0;
+  reverse->data_callback = reverse->emit ? read_arq_ack : write_arq_ack;
+  reverse->callback_context = reverse->emit ? reverse : transfer;
+
+  return(0);
+}
+
+int ofdm_transfer_set_erasure_code(ofdm_transfer_t transfer,
+                                   unsigned int data_frames,
+                                   unsigned int parity_frames)
+{
+  erasure_t *erasure;
+  unsigned int frames = data_frames + parity_frames;
+
+  if(parity_frames == 0)
+  {
+    erasure_free(transfer->erasure);
+    transfer->erasure = NULL;
+    return(0);
+  }
+  if((data_frames == 0) || (frames > ERASURE_MAX_FRAMES))
+  {
+    fprintf(stderr, _("Error: Invalid erasure code\n"));
+    return(-1);
+  }
+  if(transfer->arq)
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with the erasure code\n"));
+    return(-1);
+  }
+  if(transfer->hop_count > 0)
+  {
+    fprintf(stderr,
+            _("Error: The erasure code can't be used with frequency hopping\n"));
+    return(-1);
+  }
+
+  erasure = malloc(sizeof(erasure_t));
+  if(erasure == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  bzero(erasure, sizeof(erasure_t));
+  erasure->data_frames = data_frames;
+  erasure->parity_frames = parity_frames;
+  erasure->shards = calloc(frames, sizeof(unsigned char *));
+  erasure->lengths = calloc(frames, sizeof(unsigned int));
+  erasure->received = calloc(frames, sizeof(unsigned char));
+  erasure->matrix = malloc(parity_frames * parity_frames);
+  erasure->inverse = malloc(parity_frames * parity_frames);
+  erasure->missing = calloc(data_frames, sizeof(unsigned int));
+  erasure->rows = calloc(parity_frames, sizeof(unsigned int));
+  if((erasure->shards == NULL) ||
+     (erasure->lengths == NULL) ||
+     (erasure->received == NULL) ||
+     (erasure->matrix == NULL) ||
+     (erasure->inverse == NULL) ||
+     (erasure->missing == NULL) ||
+     (erasure->rows == NULL))
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    erasure_free(erasure);
+    return(-1);
+  }
+  pthread_once(&gf_tables_once, gf_init_tables);
+  erasure_free(transfer->erasure);
+  transfer->erasure = erasure;
+
+  return(0);
+}
+
+int ofdm_transfer_set_carousel(ofdm_transfer_t transfer, unsigned int cycles)
+{
+  carousel_t *carousel;
+  struct stat file_stat;
+  int fd;
+
+  if(transfer->file == NULL)
+  {
+    fprintf(stderr, _("Error: The carousel mode requires a file\n"));
+    return(-1);
+  }
+  fd = fileno(transfer->file);
+  if((fstat(fd, &file_stat) != 0) || (!S_ISREG(file_stat.st_mode)))
+  {
+    fprintf(stderr, _("Error: The carousel mode requires a regular file\n"));
+    return(-1);
+  }
+  if(transfer->datagram || transfer->arq)
+  {
+    fprintf(stderr,
+            _("Error: The carousel mode can't be used with the datagram mode "
+              "or the reliable mode\n"));
+    return(-1);
+  }
+
+  carousel = malloc(sizeof(carousel_t));
+  if(carousel == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  bzero(carousel, sizeof(carousel_t));
+  carousel->fd = fd;
+  carousel->cycles = cycles;
+  if(transfer->carousel)
+  {
+    free(transfer->carousel->bitmap);
+    free(transfer->carousel->checkpoint);
+    free(transfer->carousel);
+  }
+  transfer->carousel = carousel;
+
+  return(0);
+}
+
+int ofdm_transfer_set_reorder_buffer(ofdm_transfer_t transfer,
+                                     unsigned int frames)
+{
+  reorder_t *reorder;
+
+  if(frames == 0)
+  {
+    reorder_free(transfer->reorder);
+    transfer->reorder = NULL;
+    return(0);
+  }
+  if(frames > REORDER_MAX_FRAMES)
+  {
+    fprintf(stderr, _("Error: Invalid reorder buffer size\n"));
+    return(-1);
+  }
+  if(transfer->arq)
+  {
+    fprintf(stderr,
+            _("Error: The reliable mode can't be used with a reorder buffer\n"));
+    return(-1);
+  }
+
+  reorder = malloc(sizeof(reorder_t));
+  if(reorder == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  bzero(reorder, sizeof(reorder_t));
+  reorder->frames = frames;
+  reorder->lengths = calloc(frames, sizeof(unsigned int));
+  reorder->used = calloc(frames, sizeof(unsigned char));
+  if((reorder->lengths == NULL) || (reorder->used == NULL))
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    reorder_free(reorder);
+    return(-1);
+  }
+  reorder_free(transfer->reorder);
+  transfer->reorder = reorder;
+
+  return(0);
+}
+
+void ofdm_transfer_set_drop_duplicates(ofdm_transfer_t transfer,
+                                       unsigned char drop)
+{
+  transfer->drop_duplicates = drop;
+}
+
+void ofdm_transfer_set_skip_other_ids(ofdm_transfer_t transfer,
+                                      unsigned char skip)
+{
+  if(skip != transfer->skip_other_ids)
+  {
+    /* The demodulator looks for the headers first when skipping */
+    demodulator_free(transfer);
+  }
+  transfer->skip_other_ids = skip;
+}
+
+int ofdm_transfer_set_carousel_start(ofdm_transfer_t transfer,
+                                     unsigned int block)
+{
+  if(transfer->carousel == NULL)
+  {
+    fprintf(stderr, _("Error: The carousel mode is not enabled\n"));
+    return(-1);
+  }
+
+  transfer->carousel->start = block;
+  return(0);
+}
+
+int ofdm_transfer_set_checkpoint(ofdm_transfer_t transfer, char *filename)
+{
+  char *checkpoint;
+
+  if((transfer->carousel == NULL) || transfer->emit)
+  {
+    fprintf(stderr,
+            _("Error: A checkpoint requires receiving in carousel mode\n"));
+    return(-1);
+  }
+
+  checkpoint = strdup(filename);
+  if(checkpoint == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  free(transfer->carousel->checkpoint);
+  transfer->carousel->checkpoint = checkpoint;
+
+  return(0);
+}
+
+void ofdm_transfer_report_frames(ofdm_transfer_t transfer,
+                                 unsigned int valid,
+                                 unsigned int corrupted)
+{
+  if((!transfer->adaptive_payload_size) || (valid + corrupted == 0))
+  {
+    return;
   }
 
-  return(transfer);
+  /* The payload size is changed by the thread running the transfer, between
+   * two frames */
+  pthread_mutex_lock(&transfer->settings_mutex);
+  transfer->reported_valid += valid;
+  transfer->reported_corrupted += corrupted;
+  transfer->settings_changed |= SETTING_PAYLOAD_SIZE;
+  pthread_mutex_unlock(&transfer->settings_mutex);
 }
 
-ofdm_transfer_t ofdm_transfer_create(char *radio_driver,
-                                     unsigned char emit,
-                                     char *file,
-                                     unsigned long int sample_rate,
-                                     unsigned int bit_rate,
-                                     unsigned long int frequency,
-                                     long int frequency_offset,
-                                     char *gain,
-                                     float ppm,
-                                     char *subcarrier_modulation,
-                                     unsigned int subcarriers,
-                                     unsigned int cyclic_prefix_length,
-                                     unsigned int taper_length,
-                                     char *inner_fec,
-                                     char *outer_fec,
-                                     char *id,
-                                     char *dump,
-                                     unsigned int timeout,
-                                     unsigned char audio)
+void ofdm_transfer_get_stats(ofdm_transfer_t transfer,
+                             struct ofdm_transfer_stats_s *stats)
 {
-  int flags;
-  ofdm_transfer_t transfer;
+  memcpy(stats, &transfer->stats, sizeof(struct ofdm_transfer_stats_s));
+  stats->payload_size = transfer->payload_size;
+  stats->send_queue_depth = ofdm_transfer_get_send_queue_depth(transfer);
+  stats->delivery_queue_depth = 0;
+  if(transfer->delivery_queue)
+  {
+    pthread_mutex_lock(&transfer->delivery_queue->mutex);
+    stats->delivery_queue_depth = transfer->delivery_queue->length;
+    pthread_mutex_unlock(&transfer->delivery_queue->mutex);
+  }
+  if(transfer->arq)
+  {
+    pthread_mutex_lock(&transfer->arq->mutex);
+    stats->round_trip_time = transfer->arq->srtt * 1000;
+    pthread_mutex_unlock(&transfer->arq->mutex);
+  }
+  stats->loss_rate = 0;
+  if(stats->frames_lost > 0)
+  {
+    stats->loss_rate = (float) stats->frames_lost /
+      (stats->frames_received + stats->frames_lost);
+  }
+}
 
-  transfer = ofdm_transfer_create_callback(radio_driver,
-                                           emit,
-                                           emit ? read_data : write_data,
-                                           NULL,
-                                           sample_rate,
-                                           bit_rate,
-                                           frequency,
-                                           frequency_offset,
-                                           gain,
-                                           ppm,
-                                           subcarrier_modulation,
-                                           subcarriers,
-                                           cyclic_prefix_length,
-                                           taper_length,
-                                           inner_fec,
-                                           outer_fec,
-                                           id,
-                                           dump,
-                                           timeout,
-                                           audio);
-  if(transfer == NULL)
+int ofdm_transfer_add_id(ofdm_transfer_t transfer,
+                         char *id,
+                         int (*data_callback)(void *,
+                                              unsigned char *,
+                                              unsigned int),
+                         void *callback_context)
+{
+  station_t *station;
+  char key[5];
+  unsigned int hash;
+
+  if(strlen(id) > 4)
   {
-    return(NULL);
+    fprintf(stderr, _("Error: Id must be at most 4 bytes long\n"));
+    return(-1);
+  }
+  if(data_callback == NULL)
+  {
+    fprintf(stderr, _("Error: Invalid data callback\n"));
+    return(-1);
+  }
+  if(transfer->emit)
+  {
+    fprintf(stderr, _("Error: Only a receiving transfer can have other ids\n"));
+    return(-1);
   }
 
-  transfer->callback_context = transfer;
-  if(file)
+  if(strcmp(id, "*") == 0)
   {
-    if(emit)
-    {
-      transfer->file = fopen(file, "rb");
-    }
-    else
-    {
-      transfer->file = fopen(file, "wb");
-    }
-    if(transfer->file == NULL)
+    station = transfer->stations_wildcard;
+    if(station == NULL)
     {
-      fprintf(stderr, _("Error: Failed to open '%s'\n"), file);
-      free(transfer);
-      return(NULL);
+      station = malloc(sizeof(station_t));
+      if(station == NULL)
+      {
+        fprintf(stderr, _("Error: Memory allocation failed\n"));
+        return(-1);
+      }
+      bzero(station, sizeof(station_t));
+      strcpy(station->id, id);
+      transfer->stations_wildcard = station;
     }
+    station->data_callback = data_callback;
+    station->callback_context = callback_context;
+    return(0);
   }
-  else
+
+  bzero(key, sizeof(key));
+  strcpy(key, id);
+  if(memcmp(key, transfer->id, 4) == 0)
   {
-    if(emit)
-    {
-      transfer->file = stdin;
-      flags = fcntl(STDIN_FILENO, F_GETFL);
-      fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
-    }
-    else
+    fprintf(stderr, _("Error: Id already used by the transfer\n"));
+    return(-1);
+  }
+  hash = station_hash(key);
+  for(station = transfer->stations[hash];
+      station != NULL;
+      station = station->next)
+  {
+    if(memcmp(station->id, key, 4) == 0)
     {
-      transfer->file = stdout;
+      station->data_callback = data_callback;
+      station->callback_context = callback_context;
+      return(0);
     }
   }
 
-  return(transfer);
+  station = malloc(sizeof(station_t));
+  if(station == NULL)
+  {
+    fprintf(stderr, _("Error: Memory allocation failed\n"));
+    return(-1);
+  }
+  bzero(station, sizeof(station_t));
+  memcpy(station->id, key, 5);
+  station->data_callback = data_callback;
+  station->callback_context = callback_context;
+  station->next = transfer->stations[hash];
+  transfer->stations[hash] = station;
+  transfer->stations_count++;
+
+  return(0);
 }
 
-void ofdm_transfer_free(ofdm_transfer_t transfer)
+int ofdm_transfer_get_id_stats(ofdm_transfer_t transfer,
+                               unsigned int index,
+                               struct ofdm_transfer_id_stats_s *stats)
 {
-  if(transfer)
+  station_t *station;
+  unsigned int i;
+
+  for(i = 0; i < STATIONS_HASH_SIZE; i++)
   {
-    if(transfer->file)
-    {
-      fclose(transfer->file);
-    }
-    if(transfer->dump)
-    {
-      fclose(transfer->dump);
-    }
-    if(transfer->audio_converter)
+    for(station = transfer->stations[i];
+        station != NULL;
+        station = station->next)
     {
-      firhilbf_destroy(transfer->audio_converter);
+      if(index > 0)
+      {
+        index--;
+        continue;
+      }
+      strcpy(stats->id, station->id);
+      stats->frames_received = station->stats.frames_received;
+      stats->bytes_received = station->stats.bytes_received;
+      stats->frames_lost = station->stats.frames_lost;
+      stats->frames_duplicated = station->stats.frames_duplicated;
+      stats->frames_reordered = station->stats.frames_reordered;
+      stats->payloads_corrupted = station->stats.payloads_corrupted;
+      stats->loss_rate = 0;
+      if(stats->frames_lost > 0)
+      {
+        stats->loss_rate = (float) stats->frames_lost /
+          (stats->frames_received + stats->frames_lost);
+      }
+      return(0);
     }
+  }
+
+  return(-1);
+}
+
+int ofdm_transfer_set_direction(ofdm_transfer_t transfer,
+                                unsigned char emit,
+                                int (*data_callback)(void *,
+                                                     unsigned char *,
+                                                     unsigned int),
+                                void *callback_context,
+                                char *gain)
+{
+  radio_stream_t stream;
+
+  if(transfer->file)
+  {
+    fprintf(stderr,
+            _("Error: The direction of a transfer using a file can't be changed\n"));
+    return(-1);
+  }
+  if(transfer->shared_device)
+  {
+    fprintf(stderr,
+            _("Error: The direction of a full-duplex transfer can't be changed\n"));
+    return(-1);
+  }
+
+  if((emit && !transfer->emit) || (!emit && transfer->emit))
+  {
     switch(transfer->radio_type)
     {
     case IO:
       break;
 
     case FILENAME:
-      fclose(transfer->radio_device.file);
+      if(transfer->radio_device.file)
+      {
+        fclose(transfer->radio_device.file);
+      }
+      transfer->radio_device.file = fopen(transfer->radio_filename,
+                                          emit ? "wb" : "rb");
+      if(transfer->radio_device.file == NULL)
+      {
+        fprintf(stderr,
+                _("Error: Failed to open '%s'\n"),
+                transfer->radio_filename);
+        return(-1);
+      }
       break;
 
     case SOAPYSDR:
-      SoapySDRDevice_deactivateStream(transfer->radio_device.soapysdr,
-                                      transfer->radio_stream.soapysdr,
-                                      0,
-                                      0);
-      SoapySDRDevice_closeStream(transfer->radio_device.soapysdr,
-                                 transfer->radio_stream.soapysdr);
-      SoapySDRDevice_unmake(transfer->radio_device.soapysdr);
+      if(transfer->radio_stream_active)
+      {
+        SoapySDRDevice_deactivateStream(transfer->radio_device.soapysdr,
+                                        transfer->radio_stream.soapysdr,
+                                        0,
+                                        0);
+        transfer->radio_stream_active = 0;
+      }
+      /* The stream for the other direction is only set up the first time,
+       * then the two streams are swapped */
+      if(transfer->other_radio_stream.soapysdr == NULL)
+      {
+        transfer->other_radio_stream.soapysdr = setup_soapysdr_stream(transfer,
+                                                                      emit,
+                                                                      gain);
+        if(transfer->other_radio_stream.soapysdr == NULL)
+        {
+          return(-1);
+        }
+      }
+      stream = transfer->radio_stream;
+      transfer->radio_stream = transfer->other_radio_stream;
+      transfer->other_radio_stream = stream;
       break;
 
     default:
-      break;
+      return(-1);
     }
-    free(transfer);
+    transfer->emit = emit;
+  }
+
+  if(emit && (data_callback == NULL) && transfer->send_queue)
+  {
+    transfer->data_callback = read_queue;
+    transfer->callback_context = transfer;
+  }
+  else if((data_callback == NULL) && transfer->tun)
+  {
+    transfer->data_callback = emit ? read_tun : write_tun;
+    transfer->callback_context = transfer;
+  }
+  else
+  {
+    transfer->data_callback = data_callback;
+    transfer->callback_context = callback_context;
+  }
+
+  /* Prepare the modem now instead of when the transfer starts */
+  if(emit)
+  {
+    return(modulator_prepare(transfer));
+  }
+  else
+  {
+    return(demodulator_prepare(transfer));
   }
 }
 
-void ofdm_transfer_start(ofdm_transfer_t transfer)
+#ifdef HAVE_SYS_TIMERFD_H
+/* Make the timer of ofdm_transfer_get_fd() expire at each block of samples
+ * of the modem, which is how long ofdm_transfer_process() takes with a
+ * SoapySDR radio */
+int arm_timer(ofdm_transfer_t transfer)
 {
-  stop = 0;
+  ofdm_modem_t modem;
+  struct itimerspec period;
+  double seconds = TIMER_DEFAULT_PERIOD;
+
+  modem = transfer->emit ? transfer->modulator : transfer->demodulator;
+  if(modem)
+  {
+    seconds = (double) ofdm_modem_get_block_size(modem) / transfer->sample_rate;
+  }
+  period.it_interval.tv_sec = floor(seconds);
+  period.it_interval.tv_nsec = (seconds - floor(seconds)) * 1000000000;
+  if((period.it_interval.tv_sec == 0) && (period.it_interval.tv_nsec == 0))
+  {
+    /* A null period would disarm the timer */
+    period.it_interval.tv_nsec = 1;
+  }
+  period.it_value = period.it_interval;
+  if(timerfd_settime(transfer->timer_fd, 0, &period, NULL) != 0)
+  {
+    fprintf(stderr, _("Error: Failed to set the timer\n"));
+    return(-1);
+  }
+  return(0);
+}
+#endif
+
+/* Prepare a transfer to be driven step by step with
+ * ofdm_transfer_process() ('step_mode' = 1), or by ofdm_transfer_start()
+ * ('step_mode' = 0), which can block while waiting for data */
+int begin_transfer(ofdm_transfer_t transfer, unsigned char step_mode)
+{
+  int r;
+
   transfer->stop = 0;
+  transfer->step_mode = step_mode;
 
   switch(transfer->radio_type)
   {
@@ -1153,26 +6624,159 @@ void ofdm_transfer_start(ofdm_transfer_t transfer)
     break;
 
   case SOAPYSDR:
-    SoapySDRDevice_activateStream(transfer->radio_device.soapysdr,
-                                  transfer->radio_stream.soapysdr,
-                                  0,
-                                  0,
-                                  0);
+    /* When the transfer is reused, the stream is kept active between the
+     * transfers to reduce the turnaround time */
+    if(transfer->radio_failed)
+    {
+      fprintf(stderr, _("Error: The radio has failed\n"));
+      return(-1);
+    }
+    if(!transfer->radio_stream_active)
+    {
+      lock_device(transfer);
+      if(SoapySDRDevice_activateStream(transfer->radio_device.soapysdr,
+                                       transfer->radio_stream.soapysdr,
+                                       0,
+                                       0,
+                                       0) != 0)
+      {
+        fprintf(stderr, _("Error: %s\n"), SoapySDRDevice_lastError());
+        unlock_device(transfer);
+        return(-1);
+      }
+      unlock_device(transfer);
+      transfer->radio_stream_active = 1;
+    }
+    transfer->stream_failures = 0;
+    transfer->recovery_level = 0;
     break;
 
   default:
-    return;
+    return(-1);
   }
 
+  /* Don't keep a partial message from a previous run of the transfer */
+  transfer->message_size = 0;
+  transfer->message_offset = 0;
+  transfer->message_incomplete = 0;
+
   transfer->timeout_start = time(NULL);
   if(transfer->emit)
   {
-    send_frames(transfer);
+    r = send_frames_begin(transfer);
+  }
+  else
+  {
+    r = receive_frames_begin(transfer);
+  }
+#ifdef HAVE_SYS_TIMERFD_H
+  if((r == 0) && (transfer->timer_fd >= 0))
+  {
+    /* The modem has been created, use the duration of its blocks */
+    r = arm_timer(transfer);
+  }
+#endif
+
+  return(r);
+}
+
+int ofdm_transfer_begin(ofdm_transfer_t transfer)
+{
+  return(begin_transfer(transfer, 1));
+}
+
+int ofdm_transfer_process(ofdm_transfer_t transfer)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+  uint64_t expirations;
+
+  if(transfer->timer_fd >= 0)
+  {
+    /* Clear the expirations of the timer, the timer is non blocking */
+    if(read(transfer->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+      expirations = 0;
+    }
+  }
+#endif
+  if(transfer->stop)
+  {
+    return(0);
+  }
+  if(transfer->emit)
+  {
+    return(send_frames_step(transfer));
+  }
+  else
+  {
+    return(receive_frames_step(transfer));
+  }
+}
+
+void ofdm_transfer_end(ofdm_transfer_t transfer)
+{
+  if(transfer->emit)
+  {
+    send_frames_end(transfer);
   }
   else
   {
-    receive_frames(transfer);
+    receive_frames_end(transfer);
+  }
+}
+
+int ofdm_transfer_get_fd(ofdm_transfer_t transfer)
+{
+  switch(transfer->radio_type)
+  {
+  case IO:
+    return(transfer->emit ? STDOUT_FILENO : STDIN_FILENO);
+
+  case FILENAME:
+    return(fileno(transfer->radio_device.file));
+
+#ifdef HAVE_SYS_TIMERFD_H
+  case SOAPYSDR:
+    if(transfer->timer_fd < 0)
+    {
+      transfer->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                          TFD_NONBLOCK | TFD_CLOEXEC);
+      if(transfer->timer_fd < 0)
+      {
+        fprintf(stderr, _("Error: Failed to create the timer\n"));
+        return(-1);
+      }
+      if(arm_timer(transfer) != 0)
+      {
+        close(transfer->timer_fd);
+        transfer->timer_fd = -1;
+        return(-1);
+      }
+    }
+    return(transfer->timer_fd);
+#endif
+
+  default:
+    return(-1);
+  }
+}
+
+int ofdm_transfer_start(ofdm_transfer_t transfer)
+{
+  int r = 1;
+
+  stop = 0;
+  if(begin_transfer(transfer, 0) != 0)
+  {
+    return(-1);
+  }
+  while((!stop) && (r > 0))
+  {
+    r = ofdm_transfer_process(transfer);
   }
+  ofdm_transfer_end(transfer);
+
+  return((r < 0) ? -1 : 0);
 }
 
 void ofdm_transfer_stop(ofdm_transfer_t transfer)
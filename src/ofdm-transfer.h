@@ -23,6 +23,140 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 typedef struct ofdm_transfer_s *ofdm_transfer_t;
 
+/* Maximum size of a message in datagram mode */
+#define OFDM_TRANSFER_MAX_MESSAGE_SIZE 65535
+
+/* What to do with received data when the delivery queue is full, see
+ * ofdm_transfer_set_delivery_queue() */
+#define OFDM_TRANSFER_DELIVERY_BLOCK 0
+#define OFDM_TRANSFER_DELIVERY_DROP_OLDEST 1
+#define OFDM_TRANSFER_DELIVERY_DROP_NEWEST 2
+
+/* Counters of a transfer */
+struct ofdm_transfer_stats_s
+{
+  unsigned long int frames_sent;
+  unsigned long int bytes_sent;
+  unsigned long int frames_received;
+  unsigned long int bytes_received;
+  unsigned long int frames_ignored; /* frames with a different id */
+  unsigned long int headers_corrupted;
+  unsigned long int payloads_corrupted;
+  unsigned long int messages_sent; /* datagram mode */
+  unsigned long int messages_received; /* datagram mode */
+  unsigned long int messages_dropped; /* datagram mode, incomplete messages */
+  unsigned int payload_size; /* current payload size when sending */
+  unsigned int send_queue_depth; /* bytes waiting in the send queue */
+  unsigned long int payloads_dropped; /* delivery queue full */
+  unsigned int delivery_queue_depth; /* bytes waiting in the delivery queue */
+  unsigned long int radio_overflows; /* samples not read in time */
+  unsigned long int radio_underflows; /* samples not written in time */
+  unsigned long int radio_timeouts;
+  unsigned long int radio_time_errors;
+  unsigned long int radio_errors; /* other stream errors */
+  unsigned long int samples_lost; /* estimated from the timestamps */
+  unsigned long int radio_recoveries; /* broken streams made to work again */
+  unsigned int radio_recovery_time; /* duration of the last recovery in ms */
+  unsigned long int frames_retransmitted; /* reliable mode */
+  unsigned long int frames_duplicated; /* received again */
+  unsigned int round_trip_time; /* reliable mode, smoothed, in ms */
+  unsigned long int frames_recovered; /* rebuilt with the erasure code */
+  unsigned int blocks_received; /* carousel mode, blocks of the file */
+  unsigned int blocks_total; /* carousel mode, 0 until the first frame */
+  unsigned int first_missing_block; /* carousel mode */
+  unsigned long int frames_lost; /* gaps in the counters */
+  unsigned long int frames_reordered; /* received after a later frame */
+  float loss_rate; /* frames lost / frames expected */
+  unsigned long int bytes_ignored; /* payloads of the frames ignored */
+  unsigned long int symbols_skipped; /* OFDM symbols of payloads ignored */
+};
+
+/* Counters of an id received by a transfer (see ofdm_transfer_add_id()) */
+struct ofdm_transfer_id_stats_s
+{
+  char id[5];
+  unsigned long int frames_received;
+  unsigned long int bytes_received;
+  unsigned long int frames_lost;
+  unsigned long int frames_duplicated;
+  unsigned long int frames_reordered;
+  unsigned long int payloads_corrupted;
+  float loss_rate;
+};
+
+/* Configuration of a transfer
+ * The fields have the same meaning as the parameters of
+ * ofdm_transfer_create() and ofdm_transfer_create_callback(), and of the
+ * ofdm_transfer_set_*() functions for the last ones.
+ * If 'data_callback' is not NULL, it is used instead of 'file'.
+ * If 'emit' is 1 and 'send_queue_size' is not 0, the data is taken from
+ * a send queue of this size instead, see ofdm_transfer_set_send_queue().
+ * If 'emit' is 0 and 'delivery_queue_size' is not 0, the data is passed to
+ * the callback by a delivery thread, see ofdm_transfer_set_delivery_queue().
+ * If 'emit' is 0 and 'data_callback' is NULL, 'output_buffer_size' and
+ * 'output_splice' are passed to ofdm_transfer_set_output_buffer().
+ * If 'tun' is not NULL and 'data_callback' is NULL, the packets are exchanged
+ * with the TUN interface of this name instead of 'file', see
+ * ofdm_transfer_open_tun() and ofdm_transfer_set_tun().
+ * If 'tun_fd' is not -1 and 'data_callback' is NULL, the packets are exchanged
+ * with this already open interface instead, which is not closed by
+ * ofdm_transfer_free(), see ofdm_transfer_set_tun().
+ */
+struct ofdm_transfer_config_s
+{
+  char *radio_driver;
+  unsigned char emit;
+  char *file;
+  int (*data_callback)(void *, unsigned char *, unsigned int);
+  void *callback_context;
+  unsigned long int sample_rate;
+  unsigned int bit_rate;
+  unsigned long int frequency;
+  long int frequency_offset;
+  char *gain;
+  float ppm;
+  char *subcarrier_modulation;
+  unsigned int subcarriers;
+  unsigned int cyclic_prefix_length;
+  unsigned int taper_length;
+  char *inner_fec;
+  char *outer_fec;
+  char *id;
+  char *dump;
+  unsigned int timeout;
+  unsigned char audio;
+  unsigned int latency;
+  unsigned int minimum_payload_size;
+  unsigned int maximum_payload_size;
+  unsigned char adaptive_payload_size;
+  unsigned int coalescing_delay;
+  unsigned char datagram;
+  unsigned long int *hop_frequencies;
+  unsigned int hop_count;
+  unsigned int hop_dwell;
+  unsigned long int *scan_frequencies;
+  unsigned int scan_count;
+  unsigned int scan_dwell;
+  unsigned int scan_quiet;
+  unsigned int send_queue_size;
+  unsigned int delivery_queue_size;
+  int delivery_policy;
+  unsigned int output_buffer_size;
+  unsigned char output_splice;
+  char *tun;
+  int tun_fd;
+  unsigned int tun_mtu;
+  unsigned int erasure_data_frames;
+  unsigned int erasure_parity_frames;
+  unsigned char carousel;
+  unsigned int carousel_cycles;
+  unsigned int carousel_start;
+  char *checkpoint;
+  unsigned int reorder_frames;
+  unsigned char drop_duplicates;
+  unsigned char skip_other_ids;
+};
+
 /* Set the verbosity level
  *  - v: if not 0, print some debug messages to stderr
  */
@@ -95,8 +229,9 @@ ofdm_transfer_t ofdm_transfer_create(char *radio_driver,
  * read, or -1 if the input stream is finished.
  * When receiving, the callback must take 'payload_size' bytes from 'payload'
  * and write them somewhere. It must return only when all the bytes have been
- * written. The returned value should be the number of bytes written, but
- * currently it is not used.
+ * written. The returned value should be the number of bytes written. When
+ * the delivery queue is used (see ofdm_transfer_set_delivery_queue()), it
+ * can return a negative value to be called again later with the same data.
  * The user-specified 'callback_context' pointer is passed to the callback
  * as 'context'.
  */
@@ -123,11 +258,587 @@ ofdm_transfer_t ofdm_transfer_create_callback(char *radio_driver,
                                               unsigned int timeout,
                                               unsigned char audio);
 
+/* Fill a configuration with the default values
+ * The defaults are the same as the ones of the ofdm-transfer program: receive
+ * mode, 2000000 S/s, 38400 b/s, 434 MHz, qpsk, 64 subcarriers, cyclic prefix
+ * of 16, taper of 4, h128 and no outer FEC, using stdin and stdout.
+ * 'radio_driver' must be set before creating the transfer.
+ */
+void ofdm_transfer_config_init_default(struct ofdm_transfer_config_s *config);
+
+/* Initialize a new transfer from a configuration
+ * If the transfer initialization fails, the function returns NULL.
+ */
+ofdm_transfer_t ofdm_transfer_create_with_config(struct ofdm_transfer_config_s *config);
+
+/* Initialize a transfer in the opposite direction using the same radio
+ *  - transfer: transfer created by ofdm_transfer_create() or
+ *    ofdm_transfer_create_callback()
+ *  - data_callback: callback of the new transfer (see
+ *    ofdm_transfer_create_callback()); if NULL, the data is read from standard
+ *    input or written to standard output, or exchanged with the TUN interface
+ *    of 'transfer' if it uses one
+ *  - callback_context: context passed to the callback
+ *  - frequency: center frequency of the new transfer in Hertz; 0 means the
+ *    same frequency as 'transfer'
+ *  - gain: gain of the radio transceiver for the new transfer
+ *
+ * This is used for full-duplex links with a radio that can send and receive at
+ * the same time: the receive and transmit streams share one SoapySDR device,
+ * and the two transfers can be started in separate threads. The modem and
+ * payload settings of 'transfer' are copied to the new transfer.
+ * The device is closed when both transfers have been freed.
+ *
+ * Only the 'io' and SoapySDR radio types are supported.
+ * If the initialization fails, the function returns NULL.
+ */
+ofdm_transfer_t ofdm_transfer_create_reverse(ofdm_transfer_t transfer,
+                                             int (*data_callback)(void *,
+                                                                  unsigned char *,
+                                                                  unsigned int),
+                                             void *callback_context,
+                                             unsigned long int frequency,
+                                             char *gain);
+
+/* Change the frequency of a transfer
+ *  - frequency: new center frequency of the transfer in Hertz
+ *
+ * The settings changed by this function and the following ones can be changed
+ * while the transfer is running; they are applied between two blocks of
+ * samples, without stopping the stream.
+ * If the new frequency is in the band already covered by the radio, only the
+ * frequency of the oscillator shifting the signal is changed. Otherwise, the
+ * radio is retuned using the frequency offset of the transfer.
+ */
+void ofdm_transfer_set_frequency(ofdm_transfer_t transfer,
+                                 unsigned long int frequency);
+
+/* Change the frequency offset of a transfer
+ *  - frequency_offset: set the frequency of the radio 'frequency_offset' Hz
+ *    lower than the frequency of the transfer
+ */
+void ofdm_transfer_set_frequency_offset(ofdm_transfer_t transfer,
+                                        long int frequency_offset);
+
+/* Change the gain of a transfer
+ *  - gain: gain of the radio transceiver, or audio gain in dB
+ *
+ * If the gain can't be changed, the function returns -1, otherwise it
+ * returns 0.
+ */
+int ofdm_transfer_set_gain(ofdm_transfer_t transfer, char *gain);
+
+/* Change the id of a transfer
+ *  - id: transfer id (at most 4 bytes)
+ *
+ * If the id is invalid, the function returns -1, otherwise it returns 0.
+ */
+int ofdm_transfer_set_id(ofdm_transfer_t transfer, char *id);
+
+/* Set the frequency hopping schedule
+ *  - frequencies: frequencies of the channels in Hertz
+ *  - count: number of channels; 0 disables frequency hopping (default)
+ *  - dwell: number of frames sent on a channel before hopping to the next one
+ *
+ * Frame number 'n' (the counter in the header of the frame) is sent on
+ * channel '(n / dwell) % count'. The sender changes channel before the first
+ * frame of each dwell and leaves a short silence. The receiver waits on the
+ * first channel, and after each frame received it moves to the channel of the
+ * next frame. If it misses a hop, it finds the sender again when the sender
+ * comes back to its channel.
+ * The hops in the band of the radio only retune the oscillator, see
+ * ofdm_transfer_set_frequency().
+ *
+ * This function must be called before ofdm_transfer_start().
+ * If the schedule is invalid, the function returns -1, otherwise it
+ * returns 0.
+ */
+int ofdm_transfer_set_hopping(ofdm_transfer_t transfer,
+                              unsigned long int *frequencies,
+                              unsigned int count,
+                              unsigned int dwell);
+
+/* Set the frequencies to scan when receiving
+ *  - frequencies: frequencies of the channels in Hertz
+ *  - count: number of channels; 0 disables scanning (default)
+ *  - dwell: number of milliseconds spent on a channel when no frame is
+ *    detected (default: 100)
+ *  - quiet: number of milliseconds without frames after which scanning
+ *    resumes once frames have been received on a channel (default: 1000)
+ *
+ * The receiver listens to each channel in turn. When the start of a frame is
+ * detected it stays on the channel, and it stays there while frames keep
+ * arriving. The times are counted in samples.
+ * The channels in the band of the radio only retune the oscillator, see
+ * ofdm_transfer_set_frequency().
+ *
+ * This function must be called before ofdm_transfer_start(), and can't be
+ * used with frequency hopping.
+ * If the parameters are invalid, the function returns -1, otherwise it
+ * returns 0.
+ */
+int ofdm_transfer_set_scanning(ofdm_transfer_t transfer,
+                               unsigned long int *frequencies,
+                               unsigned int count,
+                               unsigned int dwell,
+                               unsigned int quiet);
+
+/* Set the latency of a transfer
+ *  - latency: maximum delay in milliseconds added by the buffering of data
+ *    and samples (default: 100)
+ *    The samples are processed by blocks of 'latency / 2' ms, and the payload
+ *    of the frames is sized to last approximately 'latency' ms.
+ *    A latency of 0 selects the throughput mode, using blocks of 1 s and
+ *    the largest payloads to minimize the per-call overhead.
+ *
+ * This function must be called before ofdm_transfer_start().
+ */
+void ofdm_transfer_set_latency(ofdm_transfer_t transfer, unsigned int latency);
+
+/* Set the size of the payload of the frames
+ *  - minimum: minimum number of bytes of payload (default: 16)
+ *  - maximum: maximum number of bytes of payload (default and at most: 65535)
+ *  - adaptive: if not 0, change the size of the payload according to the
+ *    quality of the link, given by the acknowledgements in reliable mode
+ *    (see ofdm_transfer_set_arq()) or reported by the caller with
+ *    ofdm_transfer_report_frames()
+ *
+ * The initial size of the payload is computed from the latency and bit rate,
+ * then bounded by 'minimum' and 'maximum'. If 'minimum' and 'maximum' are
+ * equal, the payload size is fixed.
+ * When less data is available, shorter frames are sent.
+ *
+ * This function must be called before ofdm_transfer_start(). In reliable
+ * mode, the maximum can't exceed the one set when ofdm_transfer_set_arq() was
+ * called.
+ * If the sizes are invalid, the function returns -1, otherwise it returns 0.
+ */
+int ofdm_transfer_set_payload_size(ofdm_transfer_t transfer,
+                                   unsigned int minimum,
+                                   unsigned int maximum,
+                                   unsigned char adaptive);
+
+/* Set the datagram mode
+ *  - datagram: if not 0, the data callback exchanges whole messages instead of
+ *    a stream of bytes (default: 0)
+ *
+ * When emitting, each call to the callback must put at most one message in
+ * 'payload' ('payload_size' is OFDM_TRANSFER_MAX_MESSAGE_SIZE) and return its
+ * size, or 0 if no message is ready, or -1 if the input stream is finished.
+ * When receiving, each call to the callback gets one whole message.
+ *
+ * Several small messages are packed in the same frame, each one preceded by
+ * a 2 bytes sub-header. The messages too large for one frame are fragmented
+ * and reassembled by the receiver; if a fragment is lost, the whole message
+ * is dropped. The maximum payload size must be larger than the sub-header.
+ *
+ * This function must be called before ofdm_transfer_start().
+ * If the initialization of the datagram mode fails, the function returns -1,
+ * otherwise it returns 0.
+ */
+int ofdm_transfer_set_datagram_mode(ofdm_transfer_t transfer,
+                                    unsigned char datagram);
+
+/* Set the coalescing of small writes into frames
+ *  - delay: maximum number of milliseconds to wait for more data before
+ *    sending a frame that is not full (default: 0, no coalescing)
+ *
+ * When sending, the data callback (or the input file) is read until the
+ * payload of the frame is full or until 'delay' ms have elapsed since the
+ * first bytes were read, whichever comes first. This reduces the number of
+ * frames (each having a preamble and a header) sent for a stream of small
+ * writes.
+ *
+ * This function must be called before ofdm_transfer_start().
+ */
+void ofdm_transfer_set_coalescing(ofdm_transfer_t transfer, unsigned int delay);
+
+/* Make a transfer reliable, using the transfer in the other direction to carry
+ * the acknowledgements (selective repeat ARQ)
+ *  - transfer: transfer carrying the data
+ *  - reverse: transfer in the other direction, for example created by
+ *    ofdm_transfer_create_reverse(); it carries only the acknowledgements,
+ *    its data callback is replaced
+ *  - window: maximum number of frames sent and not acknowledged yet
+ *    (a power of 2, at most 1024)
+ *
+ * Both stations must enable the reliable mode with the same window. The
+ * counter in the header of the frames is used as sequence number: the
+ * receiver keeps the frames received out of order and delivers the data in
+ * order, and sends acknowledgements listing the frames received. The sender
+ * keeps 'window' frames in flight, and sends again only the frames that are
+ * missing in the acknowledgements or whose timer has expired. The timer is
+ * computed from the measured round trip time.
+ * When emitting, the transfer finishes when all the frames have been
+ * acknowledged. If a frame is still not acknowledged after 20 retries,
+ * ofdm_transfer_start() and ofdm_transfer_process() return -1.
+ *
+ * This function must be called after ofdm_transfer_set_payload_size() and
+ * before ofdm_transfer_start(); the maximum payload size can't be increased
+ * afterwards. It can't be used with frequency hopping.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_arq(ofdm_transfer_t transfer,
+                          ofdm_transfer_t reverse,
+                          unsigned int window);
+
+/* Protect a transfer against lost frames with an erasure code, for the links
+ * where the frames can't be sent again (broadcast, one-way link)
+ *  - data_frames: number of data frames in a block
+ *  - parity_frames: number of parity frames sent after the data frames of a
+ *    block, 0 to disable the erasure code
+ *    (data_frames + parity_frames must be at most 255)
+ *
+ * The frames are sent by blocks of 'data_frames' frames followed by
+ * 'parity_frames' parity frames (Reed-Solomon code). The receiver rebuilds
+ * the data frames of a block from any 'data_frames' frames of the block, and
+ * finds the position of a frame in its block from the counter in its header.
+ * The overhead is 'parity_frames / data_frames', and the data frames after a
+ * lost frame are delayed until the block can be rebuilt. When no data is
+ * ready for 'latency' ms, an incomplete block is sent.
+ *
+ * Both stations must use the same erasure code. This function can't be used
+ * with the reliable mode or frequency hopping.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_erasure_code(ofdm_transfer_t transfer,
+                                   unsigned int data_frames,
+                                   unsigned int parity_frames);
+
+/* Send a file repeatedly, or assemble a file sent repeatedly (carousel mode)
+ *  - cycles: when emitting, number of times the file is sent, 0 to send it
+ *    until the transfer is stopped; ignored when receiving
+ *
+ * Each frame carries a block of the file with its number and the size of the
+ * file, so that a receiver can start receiving at any time. The receiver
+ * writes each block at its offset in the file, and the transfer finishes as
+ * soon as all the blocks have been received, in any order. The number of
+ * blocks received is in the stats.
+ * The transfer must use a regular file (see ofdm_transfer_create()), and
+ * can't use the datagram mode or the reliable mode. It can be combined with
+ * the erasure code (see ofdm_transfer_set_erasure_code()).
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_carousel(ofdm_transfer_t transfer, unsigned int cycles);
+
+/* Start sending the file at a given block in carousel mode
+ *  - block: number of the first block sent, for example the first missing
+ *    block reported by an interrupted receiver (see
+ *    ofdm_transfer_set_checkpoint()); the next cycles start at block 0
+ *
+ * This function must be called after ofdm_transfer_set_carousel().
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_carousel_start(ofdm_transfer_t transfer,
+                                     unsigned int block);
+
+/* Keep a checkpoint of the reception of a file in carousel mode
+ *  - filename: file where the list of the blocks received is saved
+ *
+ * The checkpoint records the id of the transfer, the size of the file and of
+ * the blocks, and a bitmap of the blocks received. It is saved at most once
+ * per second while blocks are received, and when the transfer finishes,
+ * after the received blocks have been flushed to the disk (fsync). When
+ * a transfer begins and the checkpoint exists, the data already received is
+ * kept and only the missing blocks are written. The checkpoint is deleted
+ * when the file is complete.
+ * This function must be called after ofdm_transfer_set_carousel(), and the
+ * file of the transfer is only truncated when the reception begins without
+ * a checkpoint.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_checkpoint(ofdm_transfer_t transfer, char *filename);
+
+/* Put the received frames back in order
+ *  - frames: size of the reorder buffer in frames (at most 1024), 0 to
+ *    deliver the frames in the order they are received
+ *
+ * The frames received after a missing frame are held back until the missing
+ * frame arrives, until the buffer is full, or until the latency (see
+ * ofdm_transfer_set_latency()) has elapsed. The missing frames are then
+ * skipped. The frames arriving after the frames that followed them have been
+ * delivered are delivered immediately.
+ * This function can't be used with the reliable mode, which already
+ * delivers the frames in order.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_reorder_buffer(ofdm_transfer_t transfer,
+                                     unsigned int frames);
+
+/* Drop the frames that are received more than once
+ *  - drop: if not 0, drop the frames with a counter already received
+ *
+ * The counters of the last 1024 frames are remembered. The duplicates are
+ * counted in the stats, with the frames lost and received out of order, even
+ * when they are not dropped. This is ignored in reliable mode, which always
+ * drops the duplicates.
+ */
+void ofdm_transfer_set_drop_duplicates(ofdm_transfer_t transfer,
+                                       unsigned char drop);
+
+/* Skip the payload of the frames of other ids when receiving
+ *  - skip: if not 0, decode the header of the frames first, and demodulate
+ *    and decode the payload only for the id of the transfer and the ids added
+ *    with ofdm_transfer_add_id()
+ *
+ * The frames skipped are counted in the stats with the OFDM symbols of their
+ * payload that were not demodulated. The headers are decoded twice for the
+ * frames that are kept.
+ */
+void ofdm_transfer_set_skip_other_ids(ofdm_transfer_t transfer,
+                                      unsigned char skip);
+
+/* Report the quality of the link for the adaptive payload size
+ *  - valid: number of frames received correctly by the remote station
+ *  - corrupted: number of frames received with a corrupted payload by the
+ *    remote station
+ *
+ * When the link is clean the payload size grows, and when the rate of
+ * corrupted frames rises the payload size shrinks. The new size is used from
+ * the next frame. This function can be called from any thread. In reliable
+ * mode, it is called automatically with the frames acknowledged and lost.
+ */
+void ofdm_transfer_report_frames(ofdm_transfer_t transfer,
+                                 unsigned int valid,
+                                 unsigned int corrupted);
+
+/* Take the data to send from a queue filled by ofdm_transfer_send() instead
+ * of the data callback or file
+ *  - size: size of the queue in bytes
+ *
+ * When the queue is empty, the transmitter sleeps until some data is queued
+ * instead of polling. In datagram mode, each call to ofdm_transfer_send()
+ * queues one message (using 2 more bytes of the queue).
+ * Calling this function again empties the queue.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_send_queue(ofdm_transfer_t transfer, unsigned int size);
+
+/* Queue some data to send
+ *  - data: bytes to send, or message in datagram mode
+ *  - size: number of bytes
+ *  - timeout: maximum time in milliseconds to wait when the queue is full;
+ *    0 to return immediately, or a negative value to wait until there is
+ *    enough space
+ *
+ * This function can be called from any thread while the transfer is
+ * running. In datagram mode, the whole message is queued or nothing.
+ * Return the number of bytes queued, or -1 if nothing could be queued
+ * (queue full until the timeout, or closed by ofdm_transfer_send_finish()).
+ */
+int ofdm_transfer_send(ofdm_transfer_t transfer,
+                       unsigned char *data,
+                       unsigned int size,
+                       int timeout);
+
+/* Signal that no more data will be queued: the transfer finishes when the
+ * data already in the send queue has been sent */
+void ofdm_transfer_send_finish(ofdm_transfer_t transfer);
+
+/* Get the number of bytes waiting in the send queue */
+unsigned int ofdm_transfer_get_send_queue_depth(ofdm_transfer_t transfer);
+
+/* Pass the received data to the data callback from a delivery thread, so that
+ * a slow consumer doesn't slow down the demodulation
+ *  - size: size of the queue between the demodulator and the delivery thread
+ *    in bytes; 0 calls the data callback directly (default)
+ *  - policy: what to do with new data when the queue is full
+ *    - OFDM_TRANSFER_DELIVERY_BLOCK: wait for the consumer
+ *    - OFDM_TRANSFER_DELIVERY_DROP_OLDEST: drop the oldest data in the queue
+ *    - OFDM_TRANSFER_DELIVERY_DROP_NEWEST: drop the new data
+ *
+ * Each payload (or message in datagram mode) uses 2 more bytes of the queue.
+ * The dropped payloads are counted in 'payloads_dropped' of the stats.
+ * When the data callback returns a negative value, it is called again 1 ms
+ * later with the same data, and meanwhile the queue fills up.
+ *
+ * This function must be called before ofdm_transfer_start().
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_delivery_queue(ofdm_transfer_t transfer,
+                                     unsigned int size,
+                                     int policy);
+
+/* Set how a transfer created by ofdm_transfer_create() writes the received
+ * data to its file (or to the standard output)
+ *  - size: the data is written in batches of at most 'size' bytes
+ *    (default: 65536); 0 writes the data of each frame immediately
+ *  - splice: if not 0 and the output is a pipe, give the pages of the
+ *    batches to the pipe with vmsplice() instead of copying them (Linux only)
+ *
+ * A batch is written when it is full, or 'latency' ms after its first byte
+ * has been received (1 s in throughput mode), or at the end of the transfer.
+ *
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_output_buffer(ofdm_transfer_t transfer,
+                                    unsigned int size,
+                                    unsigned char splice);
+
+/* Create a TUN network interface
+ *  - name: name of the interface (e.g. "ofdm0")
+ *  - mtu: maximum size of the packets; 0 keeps the default of the system
+ *
+ * The interface must then be configured (address, routes) and brought up
+ * with the usual tools, e.g. 'ip addr add' and 'ip link set up'. This requires
+ * the CAP_NET_ADMIN capability, and is only supported on Linux.
+ * Return the file descriptor of the interface, or -1 if it can't be created.
+ */
+int ofdm_transfer_open_tun(char *name, unsigned int mtu);
+
+/* Exchange IP packets with a TUN interface instead of using the data callback
+ *  - fd: file descriptor of the interface, for example returned by
+ *    ofdm_transfer_open_tun(); it is not closed by ofdm_transfer_free()
+ *  - mtu: MTU of the interface, or 0 if unknown
+ *
+ * The datagram mode is used: each packet is sent as one message, several small
+ * packets are packed in the same frame, and the receiver writes each message
+ * to the interface as one packet. The packets are read and written directly by
+ * the thread running the transfer, and the transmitter sleeps until a packet
+ * is ready. The minimum payload size is raised so that a packet of 'mtu' bytes
+ * fits in one frame.
+ * Any file descriptor of a packet device or packet socket can be used; when
+ * reading it returns the end of file, the transfer finishes.
+ *
+ * This function must be called before ofdm_transfer_start().
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_set_tun(ofdm_transfer_t transfer,
+                          int fd,
+                          unsigned int mtu);
+
+/* Get the counters of a transfer */
+void ofdm_transfer_get_stats(ofdm_transfer_t transfer,
+                             struct ofdm_transfer_stats_s *stats);
+
+/* Also receive the frames of another id
+ *  - id: id of the frames (at most 4 bytes), or "*" for all the ids that
+ *    are not registered
+ *  - data_callback: function called with the payload of each frame of this
+ *    id, its return value is ignored
+ *  - callback_context: context passed to the callback
+ *
+ * One receiving transfer can serve many stations sharing a channel: all the
+ * frames go through the same demodulator, and the frames with a different
+ * id than the one of the transfer are dispatched to their callback through
+ * a hash table on the id. The callback is called from the thread running the
+ * transfer, so it should not block.
+ * With "*", each new id gets its own counters and uses the callback of the
+ * wildcard (at most 1024 ids).
+ * The payloads are passed as they are received: the datagram, reliable and
+ * carousel modes, the erasure code and the reorder buffer only apply to the
+ * id of the transfer. The duplicates are dropped if
+ * ofdm_transfer_set_drop_duplicates() has been called.
+ * This function must not be called while the transfer is running. If the id
+ * is already registered, its callback is replaced.
+ * Return 0 if successful, -1 otherwise.
+ */
+int ofdm_transfer_add_id(ofdm_transfer_t transfer,
+                         char *id,
+                         int (*data_callback)(void *,
+                                              unsigned char *,
+                                              unsigned int),
+                         void *callback_context);
+
+/* Get the counters of one of the ids added to a transfer
+ *  - index: number of the id, from 0
+ *  - stats: counters of the id, including the id itself
+ *
+ * Return 0 if successful, -1 if there is no id with this index.
+ */
+int ofdm_transfer_get_id_stats(ofdm_transfer_t transfer,
+                               unsigned int index,
+                               struct ofdm_transfer_id_stats_s *stats);
+
+/* Change the direction of a transfer created by ofdm_transfer_create_callback()
+ *  - emit: 1 to send data, 0 to receive data
+ *  - data_callback: callback used by the next ofdm_transfer_start() calls;
+ *    when emitting, NULL selects the send queue if it has been set up
+ *  - callback_context: context passed to the callback
+ *  - gain: gain of the radio transceiver for this direction (only used the
+ *    first time the direction is changed)
+ *
+ * A transfer can be started several times. The radio device, its transmit
+ * and receive streams and the modulator and demodulator objects are kept
+ * between the transfers, so this function can be called between two
+ * ofdm_transfer_start() calls to switch between sending and receiving
+ * quickly, instead of creating a new transfer for each message.
+ *
+ * This function must not be called while the transfer is running, or on a
+ * transfer sharing its radio with a reverse transfer.
+ * If the direction can't be changed, the function returns -1, otherwise it
+ * returns 0.
+ */
+int ofdm_transfer_set_direction(ofdm_transfer_t transfer,
+                                unsigned char emit,
+                                int (*data_callback)(void *,
+                                                     unsigned char *,
+                                                     unsigned int),
+                                void *callback_context,
+                                char *gain);
+
 /* Cleanup after a finished transfer */
 void ofdm_transfer_free(ofdm_transfer_t transfer);
 
-/* Start a transfer and return when finished */
-void ofdm_transfer_start(ofdm_transfer_t transfer);
+/* Start a transfer and return when finished
+ *
+ * When the stream of a SoapySDR radio stops working (errors or no samples
+ * for about 1 s), it is reactivated, then set up again, then the radio is
+ * opened again, without losing the state of the transfer. The recoveries are
+ * counted in the stats.
+ *
+ * Return 0 if successful, -1 if the transfer couldn't start, if the radio
+ * failed and couldn't be recovered, or if a frame couldn't be delivered in
+ * reliable mode.
+ */
+int ofdm_transfer_start(ofdm_transfer_t transfer);
+
+/* Non-blocking API
+ *
+ * Instead of ofdm_transfer_start(), a transfer can be driven step by step,
+ * for example to run several transfers from one event loop:
+ *
+ *   if(ofdm_transfer_begin(transfer) == 0)
+ *   {
+ *     while(ofdm_transfer_process(transfer) > 0)
+ *     {
+ *       (wait for ofdm_transfer_get_fd() or do other work)
+ *     }
+ *     ofdm_transfer_end(transfer);
+ *   }
+ *
+ * These functions ignore ofdm_transfer_stop_all(); use ofdm_transfer_stop()
+ * to interrupt the transfer.
+ */
+
+/* Prepare a transfer to be driven with ofdm_transfer_process()
+ * Return 0 if successful, -1 otherwise. */
+int ofdm_transfer_begin(ofdm_transfer_t transfer);
+
+/* Do a bounded amount of work: when emitting, get the data of at most one
+ * frame and send one block of samples; when receiving, receive and decode
+ * one block of samples (see ofdm_transfer_set_latency() for the size of
+ * the blocks). With coalescing (see ofdm_transfer_set_coalescing()), the
+ * data of a frame is gathered over several calls instead of waiting for it.
+ * Return 1 if the transfer must continue, 0 if it is finished (no more data
+ * to send, no more samples, timeout or ofdm_transfer_stop() called), -1 if
+ * the radio failed and couldn't be recovered, or if a frame couldn't be
+ * delivered in reliable mode (see ofdm_transfer_set_arq()). */
+int ofdm_transfer_process(ofdm_transfer_t transfer);
+
+/* Finish a transfer driven with ofdm_transfer_process(), sending or decoding
+ * the samples still in the filters */
+void ofdm_transfer_end(ofdm_transfer_t transfer);
+
+/* Get the file descriptor of the samples of a transfer, to wait with poll()
+ * or select() until ofdm_transfer_process() can be called
+ *  - receiving: readable (POLLIN) when samples are available
+ *  - emitting: writable (POLLOUT) when samples can be sent
+ * For SoapySDR radios, the file descriptor is a timer which is readable
+ * (POLLIN) at each block of samples; it is cleared by
+ * ofdm_transfer_process() and closed by ofdm_transfer_free().
+ * Return -1 if the file descriptor can't be created. */
+int ofdm_transfer_get_fd(ofdm_transfer_t transfer);
 
 /* Interrupt a transfer */
 void ofdm_transfer_stop(ofdm_transfer_t transfer);
@@ -0,0 +1,80 @@
+#!/bin/sh
+
+# This file is part of ofdm-transfer, a program to send or receive data
+# by software defined radio using the OFDM modulation.
+#
+# Copyright 2021-2022 Guillaume LE VAILLANT
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Compare the throughput measured by perf-check with the baseline stored
+# for this host.
+#
+# Environment variables:
+#  - PERF_TOLERANCE: maximum allowed throughput drop in percent (default: 10)
+#  - PERF_BASELINE: baseline file (default: perf-baseline-<hostname>.txt)
+#  - PERF_CORPUS: directory of the reference IQ captures
+#    (default: perf-corpus)
+#  - PERF_UPDATE: if set to 1, replace the baseline with the new results
+
+set -e
+
+PERF_CHECK=./perf-check
+PERF_TOLERANCE=${PERF_TOLERANCE:-10}
+PERF_BASELINE=${PERF_BASELINE:-perf-baseline-$(hostname).txt}
+PERF_CORPUS=${PERF_CORPUS:-perf-corpus}
+RESULTS=$(mktemp -t perf.XXXXXX)
+trap 'rm -f ${RESULTS}' EXIT
+
+${PERF_CHECK} ${PERF_CORPUS} > ${RESULTS}
+
+if [ ! -f ${PERF_BASELINE} ] || [ "${PERF_UPDATE}" = "1" ]
+then
+    cp ${RESULTS} ${PERF_BASELINE}
+    echo "Baseline written to ${PERF_BASELINE}:"
+    cat ${PERF_BASELINE}
+    exit 0
+fi
+
+awk -v tolerance=${PERF_TOLERANCE} '
+    NR == FNR { baseline[$1 " " $2] = $3; next }
+    {
+        key = $1 " " $2
+        if(!(key in baseline))
+        {
+            printf("New:  %-30s %12.1f\n", key, $3)
+            next
+        }
+        floor = baseline[key] * (1 - (tolerance / 100))
+        change = (($3 / baseline[key]) - 1) * 100
+        if($3 < floor)
+        {
+            printf("FAIL: %-30s %12.1f (baseline %.1f, %+.1f%%)\n",
+                   key, $3, baseline[key], change)
+            failed = 1
+        }
+        else
+        {
+            printf("OK:   %-30s %12.1f (baseline %.1f, %+.1f%%)\n",
+                   key, $3, baseline[key], change)
+        }
+    }
+    END { exit(failed) }' ${PERF_BASELINE} ${RESULTS} || STATUS=$?
+
+if [ -n "${STATUS}" ]
+then
+    echo "Throughput dropped more than ${PERF_TOLERANCE}% below the baseline."
+    exit 1
+fi
+echo "All throughput measures are within ${PERF_TOLERANCE}% of the baseline."
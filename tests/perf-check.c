@@ -0,0 +1,247 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Measure the throughput of the modulator and of the demodulator for a few
+ * reference configurations.
+ *
+ * For each configuration, a reference IQ capture is stored in the corpus
+ * directory (it is generated the first time if it doesn't exist yet). The
+ * capture is then replayed through the receiver to measure the number of
+ * samples decoded per second, and the same data is sent again to /dev/null
+ * to measure the number of frames generated per second.
+ *
+ * The results are written to standard output, one measure per line:
+ *
+ *   <configuration> <measure> <value>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define RUNS 3
+
+struct configuration_s
+{
+  char *name;
+  unsigned long int sample_rate;
+  unsigned int bit_rate;
+  char *subcarrier_modulation;
+  unsigned int subcarriers;
+  unsigned int cyclic_prefix_length;
+  unsigned int taper_length;
+  char *inner_fec;
+  char *outer_fec;
+  unsigned int data_size;
+};
+
+/* About one second of transmission for each configuration */
+struct configuration_s configurations[] =
+  {
+    {"default", 2000000, 38400, "qpsk", 64, 16, 4, "h128", "none", 4800},
+    {"narrow", 250000, 9600, "bpsk", 64, 16, 4, "h74", "none", 1200},
+    {"wide", 4000000, 400000, "apsk16", 128, 32, 8, "g2412", "none", 50000}
+  };
+
+struct context_s
+{
+  unsigned int size;
+  unsigned int index;
+  unsigned int frames;
+  unsigned int errors;
+};
+
+/* Deterministic test data, so that the decoded bytes can be checked without
+ * storing the original data */
+unsigned char data_byte(unsigned int index)
+{
+  return((index * 2654435761U) >> 24);
+}
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+  unsigned int i;
+
+  if(ctx->index == ctx->size)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > ctx->size)
+  {
+    size = ctx->size - ctx->index;
+  }
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = data_byte(ctx->index + i);
+  }
+  ctx->index += size;
+  ctx->frames++;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  for(i = 0; i < payload_size; i++)
+  {
+    if(payload[i] != data_byte(ctx->index + i))
+    {
+      ctx->errors++;
+    }
+  }
+  ctx->index += payload_size;
+  ctx->frames++;
+
+  return(payload_size);
+}
+
+double now()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return(t.tv_sec + (t.tv_nsec / 1000000000.0));
+}
+
+/* Run a transfer and return its duration in seconds, or a negative value
+ * if it failed */
+double run(struct configuration_s *configuration,
+           char *radio,
+           unsigned char emit,
+           struct context_s *context)
+{
+  ofdm_transfer_t transfer;
+  double start;
+  double duration;
+
+  bzero(context, sizeof(struct context_s));
+  context->size = configuration->data_size;
+  transfer = ofdm_transfer_create_callback(radio,
+                                           emit,
+                                           emit ? read_data : write_data,
+                                           context,
+                                           configuration->sample_rate,
+                                           configuration->bit_rate,
+                                           434000000,
+                                           0,
+                                           "0",
+                                           0,
+                                           configuration->subcarrier_modulation,
+                                           configuration->subcarriers,
+                                           configuration->cyclic_prefix_length,
+                                           configuration->taper_length,
+                                           configuration->inner_fec,
+                                           configuration->outer_fec,
+                                           "",
+                                           NULL,
+                                           0,
+                                           0);
+  if(transfer == NULL)
+  {
+    return(-1);
+  }
+  start = now();
+  ofdm_transfer_start(transfer);
+  duration = now() - start;
+  ofdm_transfer_free(transfer);
+
+  return(duration);
+}
+
+int main(int argc, char **argv)
+{
+  char *corpus = (argc > 1) ? argv[1] : "perf-corpus";
+  unsigned int n = sizeof(configurations) / sizeof(struct configuration_s);
+  unsigned int i;
+  unsigned int j;
+  char radio[1024];
+  struct stat capture;
+  struct context_s context;
+  double duration;
+  double best_send;
+  double best_receive;
+  unsigned int frames;
+
+  mkdir(corpus, 0755);
+
+  for(i = 0; i < n; i++)
+  {
+    snprintf(radio, sizeof(radio), "file=%s/%s.cf32", corpus, configurations[i].name);
+    if(stat(radio + 5, &capture) != 0)
+    {
+      fprintf(stderr, "Info: Generating '%s'\n", radio + 5);
+      if((run(&configurations[i], radio, 1, &context) < 0) ||
+         (stat(radio + 5, &capture) != 0))
+      {
+        fprintf(stderr, "Error: Failed to generate '%s'\n", radio + 5);
+        return(EXIT_FAILURE);
+      }
+    }
+
+    best_send = 0;
+    best_receive = 0;
+    frames = 0;
+    for(j = 0; j < RUNS; j++)
+    {
+      duration = run(&configurations[i], "file=/dev/null", 1, &context);
+      if(duration < 0)
+      {
+        fprintf(stderr, "Error: Failed to send '%s'\n", configurations[i].name);
+        return(EXIT_FAILURE);
+      }
+      if((best_send == 0) || (duration < best_send))
+      {
+        best_send = duration;
+      }
+      frames = context.frames;
+
+      duration = run(&configurations[i], radio, 0, &context);
+      if((duration < 0) ||
+         (context.index != configurations[i].data_size) ||
+         (context.errors != 0))
+      {
+        fprintf(stderr, "Error: Failed to decode '%s'\n", radio + 5);
+        return(EXIT_FAILURE);
+      }
+      if((best_receive == 0) || (duration < best_receive))
+      {
+        best_receive = duration;
+      }
+    }
+
+    printf("%s frames_per_second %.1f\n",
+           configurations[i].name,
+           frames / best_send);
+    printf("%s samples_per_second %.1f\n",
+           configurations[i].name,
+           (capture.st_size / 8) / best_receive);
+  }
+
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,268 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <complex.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 20000
+#define WINDOW 8
+#define CHUNK_SIZE 4096
+#define LOST_SAMPLES 300000
+
+struct context_s
+{
+  unsigned int index;
+  unsigned int errors;
+};
+
+struct relay_s
+{
+  FILE *input;
+  FILE *output;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+  unsigned int i;
+
+  if(ctx->index == DATA_SIZE)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > DATA_SIZE)
+  {
+    size = DATA_SIZE - ctx->index;
+  }
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = (ctx->index + i) * 7;
+  }
+  ctx->index += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  for(i = 0; i < payload_size; i++)
+  {
+    if(payload[i] != (((ctx->index + i) * 7) & 255))
+    {
+      ctx->errors++;
+    }
+  }
+  ctx->index += payload_size;
+
+  return(payload_size);
+}
+
+/* Channel between the sender and the receiver, losing the first frames */
+void * relay_thread(void *arg)
+{
+  struct relay_s *relay = (struct relay_s *) arg;
+  complex float samples[CHUNK_SIZE];
+  unsigned long int count = 0;
+  size_t n;
+
+  while((n = fread(samples, sizeof(complex float), CHUNK_SIZE, relay->input)) > 0)
+  {
+    if(count < LOST_SAMPLES)
+    {
+      bzero(samples, n * sizeof(complex float));
+    }
+    count += n;
+    fwrite(samples, sizeof(complex float), n, relay->output);
+  }
+  fclose(relay->input);
+  fclose(relay->output);
+
+  return(NULL);
+}
+
+void * transfer_thread(void *arg)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) arg;
+
+  ofdm_transfer_start(transfer);
+
+  return(NULL);
+}
+
+int main()
+{
+  ofdm_transfer_t data_send;
+  ofdm_transfer_t data_receive;
+  ofdm_transfer_t ack_send;
+  ofdm_transfer_t ack_receive;
+  pthread_t data_send_id;
+  pthread_t data_receive_id;
+  pthread_t ack_send_id;
+  pthread_t ack_receive_id;
+  pthread_t relay_id;
+  struct relay_s relay;
+  struct context_s receive_context;
+  struct context_s send_context;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  char radios[3][80];
+  char directory[] = "/tmp/arq.XXXXXX";
+  char fifos[3][64];
+  int fds[3];
+  unsigned int i;
+  int ok;
+
+  fprintf(stderr, "Test: Send data reliably on a lossy link\n");
+
+  if(mkdtemp(directory) == NULL)
+  {
+    fprintf(stderr, "Error: Failed to create temporary directory\n");
+    return(EXIT_FAILURE);
+  }
+  /* Sender to relay, relay to receiver, acknowledgements. Each FIFO is kept
+   * open for reading and writing while the transfers open it, so that the
+   * opening doesn't block. */
+  for(i = 0; i < 3; i++)
+  {
+    sprintf(fifos[i], "%s/fifo%u", directory, i);
+    sprintf(radios[i], "file=%s", fifos[i]);
+    if((mkfifo(fifos[i], 0600) != 0) ||
+       ((fds[i] = open(fifos[i], O_RDWR)) == -1))
+    {
+      fprintf(stderr, "Error: Failed to create FIFO\n");
+      return(EXIT_FAILURE);
+    }
+  }
+
+  bzero(&receive_context, sizeof(receive_context));
+  bzero(&send_context, sizeof(send_context));
+  ofdm_transfer_config_init_default(&config);
+  config.maximum_payload_size = 1000;
+
+  config.radio_driver = radios[0];
+  config.emit = 1;
+  config.data_callback = read_data;
+  config.callback_context = &send_context;
+  data_send = ofdm_transfer_create_with_config(&config);
+
+  config.radio_driver = radios[1];
+  config.emit = 0;
+  config.data_callback = write_data;
+  config.callback_context = &receive_context;
+  data_receive = ofdm_transfer_create_with_config(&config);
+
+  /* The acknowledgement transfers get their callbacks from
+   * ofdm_transfer_set_arq() */
+  config.radio_driver = radios[2];
+  config.emit = 1;
+  config.data_callback = NULL;
+  config.callback_context = NULL;
+  ack_send = ofdm_transfer_create_with_config(&config);
+
+  config.emit = 0;
+  ack_receive = ofdm_transfer_create_with_config(&config);
+  relay.input = fopen(fifos[0], "rb");
+  relay.output = fopen(fifos[1], "wb");
+  if((data_send == NULL) || (data_receive == NULL) ||
+     (ack_send == NULL) || (ack_receive == NULL) ||
+     (relay.input == NULL) || (relay.output == NULL))
+  {
+    fprintf(stderr, "Error: Failed to initialize transfers\n");
+    return(EXIT_FAILURE);
+  }
+  if(ofdm_transfer_set_arq(data_send, ack_receive, WINDOW - 1) == 0)
+  {
+    fprintf(stderr, "Error: Window size not a power of 2 accepted\n");
+    return(EXIT_FAILURE);
+  }
+  if((ofdm_transfer_set_arq(data_send, ack_receive, WINDOW) != 0) ||
+     (ofdm_transfer_set_arq(data_receive, ack_send, WINDOW) != 0))
+  {
+    fprintf(stderr, "Error: Failed to enable the reliable mode\n");
+    return(EXIT_FAILURE);
+  }
+  /* The slots of the window can't hold larger payloads */
+  if(ofdm_transfer_set_payload_size(data_send, 16, 2000, 0) == 0)
+  {
+    fprintf(stderr, "Error: Payload size increased in reliable mode\n");
+    return(EXIT_FAILURE);
+  }
+  for(i = 0; i < 3; i++)
+  {
+    close(fds[i]);
+  }
+
+  if((pthread_create(&relay_id, NULL, relay_thread, &relay) != 0) ||
+     (pthread_create(&ack_receive_id, NULL, transfer_thread, ack_receive) != 0) ||
+     (pthread_create(&ack_send_id, NULL, transfer_thread, ack_send) != 0) ||
+     (pthread_create(&data_receive_id, NULL, transfer_thread, data_receive) != 0) ||
+     (pthread_create(&data_send_id, NULL, transfer_thread, data_send) != 0))
+  {
+    fprintf(stderr, "Error: Failed to start threads\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* The sender finishes when all the data has been acknowledged, then
+   * closing its samples ends the relay and the receiver */
+  pthread_join(data_send_id, NULL);
+  ofdm_transfer_get_stats(data_send, &stats);
+  ofdm_transfer_free(data_send);
+  pthread_join(relay_id, NULL);
+  pthread_join(data_receive_id, NULL);
+  ofdm_transfer_stop(ack_send);
+  pthread_join(ack_send_id, NULL);
+  ofdm_transfer_free(ack_send);
+  pthread_join(ack_receive_id, NULL);
+  ofdm_transfer_free(ack_receive);
+  ofdm_transfer_free(data_receive);
+
+  for(i = 0; i < 3; i++)
+  {
+    unlink(fifos[i]);
+  }
+  rmdir(directory);
+
+  ok = (receive_context.index == DATA_SIZE) &&
+    (receive_context.errors == 0) &&
+    (stats.frames_retransmitted > 0);
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    fprintf(stderr, "Error: %u bytes received, %u errors, %lu retransmissions\n",
+            receive_context.index,
+            receive_context.errors,
+            stats.frames_retransmitted);
+    return(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,167 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define FILE_SIZE 3000
+
+int identical(char *message_file, char *decoded_file)
+{
+  FILE *message;
+  FILE *decoded;
+  unsigned int i1;
+  unsigned int i2;
+  unsigned char buffer1[1024];
+  unsigned char buffer2[1024];
+  int ok = 1;
+
+  if((message = fopen(message_file, "rb")) == NULL)
+  {
+    fprintf(stderr, "Error: Failed to open '%s'\n", message_file);
+    return(0);
+  }
+  if((decoded = fopen(decoded_file, "rb")) == NULL)
+  {
+    fprintf(stderr, "Error: Failed to open '%s'\n", decoded_file);
+    fclose(message);
+    return(0);
+  }
+
+  while(1)
+  {
+    i1 = fread(buffer1, 1, 1024, message);
+    i2 = fread(buffer2, 1, 1024, decoded);
+    if((i1 == 0) && (i2 == 0))
+    {
+      break;
+    }
+    if((i1 != i2) || (memcmp(buffer1, buffer2, i1) != 0))
+    {
+      ok = 0;
+      break;
+    }
+  }
+  fclose(message);
+  fclose(decoded);
+
+  return(ok);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  unsigned char message[FILE_SIZE];
+  char message_file[] = "/tmp/message.XXXXXX";
+  int message_fd = mkstemp(message_file);
+  char decoded_file[] = "/tmp/decoded.XXXXXX";
+  int decoded_fd = mkstemp(decoded_file);
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  off_t size;
+  unsigned int i;
+  int ok = 0;
+
+  fprintf(stderr, "Test: Receive a file sent in carousel mode, starting late\n");
+
+  if((message_fd == -1) || (decoded_fd == -1) || (samples_fd == -1))
+  {
+    fprintf(stderr, "Error: Failed to create temporary files\n");
+    return(EXIT_FAILURE);
+  }
+  for(i = 0; i < FILE_SIZE; i++)
+  {
+    message[i] = i * 7;
+  }
+  write(message_fd, message, FILE_SIZE);
+  close(message_fd);
+  close(decoded_fd);
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.sample_rate = 500000;
+  config.minimum_payload_size = 200;
+  config.maximum_payload_size = 200;
+  config.carousel = 1;
+  config.carousel_cycles = 2;
+
+  config.emit = 1;
+  config.file = message_file;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  /* Start receiving in the middle of the first cycle */
+  size = lseek(samples_fd, 0, SEEK_END);
+  lseek(samples_fd, (size / 4) & ~7, SEEK_SET);
+  config.emit = 0;
+  config.file = decoded_file;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_get_stats(receive, &stats);
+  ofdm_transfer_free(receive);
+
+  fprintf(stderr, "%u of %u blocks received\n",
+          stats.blocks_received, stats.blocks_total);
+  ok = (stats.blocks_total > 0) &&
+    (stats.blocks_received == stats.blocks_total) &&
+    identical(message_file, decoded_file);
+  unlink(message_file);
+  unlink(decoded_file);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
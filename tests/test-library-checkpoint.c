@@ -0,0 +1,286 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define FILE_SIZE 3000
+
+int identical(char *message_file, char *decoded_file)
+{
+  FILE *message;
+  FILE *decoded;
+  unsigned int i1;
+  unsigned int i2;
+  unsigned char buffer1[1024];
+  unsigned char buffer2[1024];
+  int ok = 1;
+
+  if((message = fopen(message_file, "rb")) == NULL)
+  {
+    fprintf(stderr, "Error: Failed to open '%s'\n", message_file);
+    return(0);
+  }
+  if((decoded = fopen(decoded_file, "rb")) == NULL)
+  {
+    fprintf(stderr, "Error: Failed to open '%s'\n", decoded_file);
+    fclose(message);
+    return(0);
+  }
+
+  while(1)
+  {
+    i1 = fread(buffer1, 1, 1024, message);
+    i2 = fread(buffer2, 1, 1024, decoded);
+    if((i1 == 0) && (i2 == 0))
+    {
+      break;
+    }
+    if((i1 != i2) || (memcmp(buffer1, buffer2, i1) != 0))
+    {
+      ok = 0;
+      break;
+    }
+  }
+  fclose(message);
+  fclose(decoded);
+
+  return(ok);
+}
+
+/* Copy a checkpoint with a wrong count of blocks received */
+int corrupt_checkpoint(char *checkpoint_file, char *corrupted_file)
+{
+  FILE *input;
+  FILE *output;
+  char line[256];
+  unsigned int blocks;
+
+  if((input = fopen(checkpoint_file, "r")) == NULL)
+  {
+    return(-1);
+  }
+  if((output = fopen(corrupted_file, "w")) == NULL)
+  {
+    fclose(input);
+    return(-1);
+  }
+  while(fgets(line, sizeof(line), input) != NULL)
+  {
+    if(sscanf(line, "blocks_received %u", &blocks) == 1)
+    {
+      fprintf(output, "blocks_received %u\n", blocks + 1);
+    }
+    else
+    {
+      fputs(line, output);
+    }
+  }
+  fclose(input);
+  fclose(output);
+
+  return(0);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  unsigned char message[FILE_SIZE];
+  char message_file[] = "/tmp/message.XXXXXX";
+  int message_fd = mkstemp(message_file);
+  char decoded_file[] = "/tmp/decoded.XXXXXX";
+  int decoded_fd = mkstemp(decoded_file);
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  char checkpoint_file[sizeof(decoded_file) + 11];
+  char corrupted_file[sizeof(checkpoint_file) + 4];
+  char corrupted_decoded_file[sizeof(decoded_file) + 4];
+  unsigned char *zeros;
+  unsigned int first_missing_block;
+  off_t size;
+  unsigned int i;
+  int ok = 0;
+
+  fprintf(stderr, "Test: Resume an interrupted reception from a checkpoint\n");
+
+  if((message_fd == -1) || (decoded_fd == -1) || (samples_fd == -1))
+  {
+    fprintf(stderr, "Error: Failed to create temporary files\n");
+    return(EXIT_FAILURE);
+  }
+  for(i = 0; i < FILE_SIZE; i++)
+  {
+    message[i] = i * 7;
+  }
+  write(message_fd, message, FILE_SIZE);
+  close(message_fd);
+  close(decoded_fd);
+  sprintf(checkpoint_file, "%s.checkpoint", decoded_file);
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.sample_rate = 500000;
+  config.minimum_payload_size = 200;
+  config.maximum_payload_size = 200;
+  config.carousel = 1;
+  config.carousel_cycles = 1;
+
+  config.emit = 1;
+  config.file = message_file;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  /* The signal is lost in the second half of the transfer */
+  size = lseek(samples_fd, 0, SEEK_END);
+  zeros = calloc(size - (size / 2), 1);
+  if(zeros == NULL)
+  {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return(EXIT_FAILURE);
+  }
+  pwrite(samples_fd, zeros, size - (size / 2), size / 2);
+  free(zeros);
+
+  lseek(samples_fd, 0, SEEK_SET);
+  config.emit = 0;
+  config.file = decoded_file;
+  config.checkpoint = checkpoint_file;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_get_stats(receive, &stats);
+  ofdm_transfer_free(receive);
+
+  fprintf(stderr, "%u of %u blocks received, first missing block %u\n",
+          stats.blocks_received, stats.blocks_total,
+          stats.first_missing_block);
+  if((stats.blocks_received == 0) ||
+     (stats.blocks_received == stats.blocks_total) ||
+     (access(checkpoint_file, F_OK) != 0))
+  {
+    fprintf(stderr, "Error: No checkpoint for an incomplete file\n");
+    return(EXIT_FAILURE);
+  }
+  first_missing_block = stats.first_missing_block;
+
+  /* A checkpoint whose bitmap doesn't match its count is rejected */
+  sprintf(corrupted_file, "%s.bad", checkpoint_file);
+  sprintf(corrupted_decoded_file, "%s.bad", decoded_file);
+  if(corrupt_checkpoint(checkpoint_file, corrupted_file) != 0)
+  {
+    fprintf(stderr, "Error: Failed to copy the checkpoint\n");
+    return(EXIT_FAILURE);
+  }
+  config.file = corrupted_decoded_file;
+  config.checkpoint = corrupted_file;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  if(ofdm_transfer_start(receive) == 0)
+  {
+    fprintf(stderr, "Error: Inconsistent checkpoint accepted\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_free(receive);
+  unlink(corrupted_file);
+  unlink(corrupted_decoded_file);
+
+  /* Send only the missing blocks, and receive them with a new transfer */
+  ftruncate(samples_fd, 0);
+  lseek(samples_fd, 0, SEEK_SET);
+  config.emit = 1;
+  config.file = message_file;
+  config.carousel_start = first_missing_block;
+  config.checkpoint = NULL;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  lseek(samples_fd, 0, SEEK_SET);
+  config.emit = 0;
+  config.file = decoded_file;
+  config.carousel_start = 0;
+  config.checkpoint = checkpoint_file;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_get_stats(receive, &stats);
+  ofdm_transfer_free(receive);
+
+  fprintf(stderr, "%u of %u blocks received\n",
+          stats.blocks_received, stats.blocks_total);
+  ok = (stats.blocks_received == stats.blocks_total) &&
+    (access(checkpoint_file, F_OK) != 0) &&
+    identical(message_file, decoded_file);
+  unlink(message_file);
+  unlink(decoded_file);
+  unlink(checkpoint_file);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,164 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+struct context_s
+{
+  unsigned char data[128];
+  unsigned int size;
+  unsigned int index;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+
+  if(ctx->index == ctx->size)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > ctx->size)
+  {
+    size = ctx->size - ctx->index;
+  }
+  memcpy(payload, ctx->data + ctx->index, size);
+  ctx->index += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+
+  if(ctx->size + payload_size <= sizeof(ctx->data))
+  {
+    memcpy(ctx->data + ctx->size, payload, payload_size);
+    ctx->size += payload_size;
+  }
+
+  return(payload_size);
+}
+
+/* Receive the samples at the beginning of the temporary file */
+unsigned int receive(int samples_fd, char *id, struct context_s *context)
+{
+  ofdm_transfer_t transfer;
+  struct ofdm_transfer_config_s config;
+
+  lseek(samples_fd, 0, SEEK_SET);
+  bzero(context, sizeof(struct context_s));
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.data_callback = write_data;
+  config.callback_context = context;
+  config.bit_rate = 9600;
+  /* Same radio frequency as the sender, signal shifted by the oscillator */
+  config.frequency = 434100000;
+  config.frequency_offset = 100000;
+  config.id = id;
+  transfer = ofdm_transfer_create_with_config(&config);
+  if(transfer == NULL)
+  {
+    return(0);
+  }
+  ofdm_transfer_start(transfer);
+  ofdm_transfer_free(transfer);
+
+  return(context->size);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  struct ofdm_transfer_config_s config;
+  struct context_s context;
+  char message[] = "This is a test transmission using ofdm-transfer.";
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  int ok = 0;
+
+  fprintf(stderr, "Test: Create transfers from a configuration and retune them\n");
+
+  strcpy(context.data, message);
+  context.size = strlen(message);
+  context.index = 0;
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.emit = 1;
+  config.data_callback = read_data;
+  config.callback_context = &context;
+  config.bit_rate = 9600;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_set_frequency(send, 434100000);
+  if((ofdm_transfer_set_id(send, "test") != 0) ||
+     (ofdm_transfer_set_id(send, "too long") == 0))
+  {
+    fprintf(stderr, "Error: Failed to check the id\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  ok = (receive(samples_fd, "test", &context) == strlen(message)) &&
+    (memcmp(message, context.data, strlen(message)) == 0) &&
+    (receive(samples_fd, "", &context) == 0);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
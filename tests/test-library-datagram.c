@@ -0,0 +1,182 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define MESSAGES 40
+
+struct context_s
+{
+  unsigned int index;
+  unsigned int errors;
+};
+
+/* Mix small messages with messages larger than a frame */
+unsigned int message_size(unsigned int index)
+{
+  if(index % 10 == 9)
+  {
+    return(3000 + index);
+  }
+  return(1 + ((index * 97) % 200));
+}
+
+int read_message(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size;
+  unsigned int i;
+
+  if(ctx->index == MESSAGES)
+  {
+    return(-1);
+  }
+  size = message_size(ctx->index);
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = ctx->index + i;
+  }
+  ctx->index++;
+
+  return(size);
+}
+
+int write_message(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  if(payload_size != message_size(ctx->index))
+  {
+    ctx->errors++;
+  }
+  else
+  {
+    for(i = 0; i < payload_size; i++)
+    {
+      if(payload[i] != ((ctx->index + i) & 255))
+      {
+        ctx->errors++;
+        break;
+      }
+    }
+  }
+  ctx->index++;
+
+  return(payload_size);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct context_s context;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  int ok = 0;
+
+  fprintf(stderr, "Test: Send and receive messages in datagram mode\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  bzero(&context, sizeof(context));
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.callback_context = &context;
+  config.bit_rate = 9600;
+  config.minimum_payload_size = 1000;
+  config.maximum_payload_size = 1000;
+  config.datagram = 1;
+
+  config.emit = 1;
+  config.data_callback = read_message;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_get_stats(send, &stats);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  /* Small messages must have been packed together */
+  if(stats.frames_sent >= MESSAGES)
+  {
+    fprintf(stderr, "Error: %lu frames sent for %u messages\n",
+            stats.frames_sent, MESSAGES);
+    return(EXIT_FAILURE);
+  }
+
+  lseek(samples_fd, 0, SEEK_SET);
+  bzero(&context, sizeof(context));
+  config.emit = 0;
+  config.data_callback = write_message;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* A payload can't be smaller than the sub-header of a message */
+  if(ofdm_transfer_set_payload_size(receive, 1, 2, 0) == 0)
+  {
+    fprintf(stderr, "Error: Payload too small for the datagram mode accepted\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_free(receive);
+
+  ok = (context.index == MESSAGES) && (context.errors == 0);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
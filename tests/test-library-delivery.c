@@ -0,0 +1,168 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 20000
+#define QUEUE_SIZE 1000
+
+unsigned char data[DATA_SIZE];
+unsigned int data_index = 0;
+unsigned char decoded[DATA_SIZE];
+unsigned int decoded_size = 0;
+unsigned int busy = 0;
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  unsigned int size = DATA_SIZE - data_index;
+
+  if(size == 0)
+  {
+    return(-1);
+  }
+  if(size > payload_size)
+  {
+    size = payload_size;
+  }
+  memcpy(payload, &data[data_index], size);
+  data_index += size;
+
+  return(size);
+}
+
+/* Slow consumer, busy every other time it is called */
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  busy = !busy;
+  if(busy)
+  {
+    usleep(5000);
+    return(-1);
+  }
+  if(decoded_size + payload_size <= DATA_SIZE)
+  {
+    memcpy(&decoded[decoded_size], payload, payload_size);
+  }
+  decoded_size += payload_size;
+
+  return(payload_size);
+}
+
+int receive(struct ofdm_transfer_config_s *config,
+            struct ofdm_transfer_stats_s *stats)
+{
+  ofdm_transfer_t transfer;
+
+  decoded_size = 0;
+  transfer = ofdm_transfer_create_with_config(config);
+  if(transfer == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(-1);
+  }
+  ofdm_transfer_start(transfer);
+  ofdm_transfer_get_stats(transfer, stats);
+  ofdm_transfer_free(transfer);
+
+  return(0);
+}
+
+int main()
+{
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  ofdm_transfer_t send;
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned int i;
+  int ok = 1;
+
+  fprintf(stderr, "Test: Deliver received data to a slow consumer\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+  close(samples_fd);
+  for(i = 0; i < DATA_SIZE; i++)
+  {
+    data[i] = (i * 7) + (i >> 8);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = malloc(strlen(samples_file) + 6);
+  sprintf(config.radio_driver, "file=%s", samples_file);
+  config.emit = 1;
+  config.data_callback = read_data;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+
+  /* Wait for the consumer, nothing must be lost */
+  config.emit = 0;
+  config.data_callback = write_data;
+  config.delivery_queue_size = QUEUE_SIZE;
+  config.delivery_policy = OFDM_TRANSFER_DELIVERY_BLOCK;
+  if(receive(&config, &stats) != 0)
+  {
+    return(EXIT_FAILURE);
+  }
+  if((decoded_size != DATA_SIZE) ||
+     (memcmp(data, decoded, DATA_SIZE) != 0) ||
+     (stats.payloads_dropped != 0))
+  {
+    fprintf(stderr, "Error: %u bytes decoded instead of %u\n",
+            decoded_size, DATA_SIZE);
+    ok = 0;
+  }
+
+  /* The demodulator must not wait for the consumer */
+  config.delivery_policy = OFDM_TRANSFER_DELIVERY_DROP_NEWEST;
+  if(receive(&config, &stats) != 0)
+  {
+    return(EXIT_FAILURE);
+  }
+  if((stats.payloads_dropped == 0) || (decoded_size >= DATA_SIZE))
+  {
+    fprintf(stderr, "Error: No data dropped with a full queue\n");
+    ok = 0;
+  }
+
+  free(config.radio_driver);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,175 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 8000
+
+struct context_s
+{
+  unsigned int index;
+  unsigned int errors;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+  unsigned int i;
+
+  if(ctx->index == DATA_SIZE)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > DATA_SIZE)
+  {
+    size = DATA_SIZE - ctx->index;
+  }
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = (ctx->index + i) * 7;
+  }
+  ctx->index += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  for(i = 0; i < payload_size; i++)
+  {
+    if(payload[i] != (((ctx->index + i) * 7) & 255))
+    {
+      ctx->errors++;
+      break;
+    }
+  }
+  ctx->index += payload_size;
+
+  return(payload_size);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct ofdm_transfer_config_s config;
+  struct context_s context;
+  struct ofdm_transfer_stats_s stats;
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned char *zeros;
+  off_t size;
+  int ok = 0;
+
+  fprintf(stderr, "Test: Rebuild lost frames with the erasure code\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.callback_context = &context;
+  config.sample_rate = 500000;
+  config.minimum_payload_size = 200;
+  config.maximum_payload_size = 200;
+  config.erasure_data_frames = 8;
+  config.erasure_parity_frames = 4;
+
+  bzero(&context, sizeof(context));
+  config.emit = 1;
+  config.data_callback = read_data;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  /* Lose a few frames in the middle of the transfer */
+  size = lseek(samples_fd, 0, SEEK_END);
+  zeros = calloc(size / 50, 1);
+  if(zeros == NULL)
+  {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return(EXIT_FAILURE);
+  }
+  if(pwrite(samples_fd, zeros, size / 50, (size / 2) & ~7) != size / 50)
+  {
+    fprintf(stderr, "Error: Failed to write samples\n");
+    return(EXIT_FAILURE);
+  }
+  free(zeros);
+
+  lseek(samples_fd, 0, SEEK_SET);
+  bzero(&context, sizeof(context));
+  config.emit = 0;
+  config.data_callback = write_data;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_get_stats(receive, &stats);
+  ofdm_transfer_free(receive);
+
+  fprintf(stderr, "%lu frames received, %lu frames rebuilt\n",
+          stats.frames_received, stats.frames_recovered);
+  ok = (context.index == DATA_SIZE) &&
+    (context.errors == 0) &&
+    (stats.frames_recovered > 0);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,180 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 20000
+
+struct context_s
+{
+  unsigned int index;
+  unsigned int errors;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+  unsigned int i;
+
+  if(ctx->index == DATA_SIZE)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > DATA_SIZE)
+  {
+    size = DATA_SIZE - ctx->index;
+  }
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = (ctx->index + i) * 7;
+  }
+  ctx->index += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  for(i = 0; i < payload_size; i++)
+  {
+    if(payload[i] != (((ctx->index + i) * 7) & 255))
+    {
+      ctx->errors++;
+    }
+  }
+  ctx->index += payload_size;
+
+  return(payload_size);
+}
+
+void * send_thread(void *arg)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) arg;
+
+  ofdm_transfer_start(transfer);
+  /* End of the samples for the receiver */
+  fflush(stdout);
+  close(STDOUT_FILENO);
+
+  return(NULL);
+}
+
+void * receive_thread(void *arg)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) arg;
+
+  ofdm_transfer_start(transfer);
+
+  return(NULL);
+}
+
+int main()
+{
+  ofdm_transfer_t receive;
+  ofdm_transfer_t send;
+  pthread_t receive_id;
+  pthread_t send_id;
+  struct context_s receive_context;
+  struct context_s send_context;
+  int samples_pipe[2];
+
+  fprintf(stderr, "Test: Send and receive at the same time with one radio\n");
+
+  if(pipe(samples_pipe) != 0)
+  {
+    fprintf(stderr, "Error: Failed to create pipe\n");
+    return(EXIT_FAILURE);
+  }
+  if((dup2(samples_pipe[0], STDIN_FILENO) == -1) ||
+     (dup2(samples_pipe[1], STDOUT_FILENO) == -1))
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input and output\n");
+    return(EXIT_FAILURE);
+  }
+  close(samples_pipe[0]);
+  close(samples_pipe[1]);
+
+  bzero(&receive_context, sizeof(receive_context));
+  bzero(&send_context, sizeof(send_context));
+  receive = ofdm_transfer_create_callback("io",
+                                          0,
+                                          write_data,
+                                          &receive_context,
+                                          2000000,
+                                          38400,
+                                          434000000,
+                                          0,
+                                          "0",
+                                          0,
+                                          "qpsk",
+                                          64,
+                                          16,
+                                          4,
+                                          "h128",
+                                          "none",
+                                          "",
+                                          NULL,
+                                          0,
+                                          0);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  send = ofdm_transfer_create_reverse(receive, read_data, &send_context, 0, "0");
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize reverse transfer\n");
+    ofdm_transfer_free(receive);
+    return(EXIT_FAILURE);
+  }
+
+  if((pthread_create(&receive_id, NULL, receive_thread, receive) != 0) ||
+     (pthread_create(&send_id, NULL, send_thread, send) != 0))
+  {
+    fprintf(stderr, "Error: Failed to start threads\n");
+    return(EXIT_FAILURE);
+  }
+  pthread_join(send_id, NULL);
+  pthread_join(receive_id, NULL);
+
+  ofdm_transfer_free(send);
+  ofdm_transfer_free(receive);
+
+  if((receive_context.index == DATA_SIZE) && (receive_context.errors == 0))
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    fprintf(stderr, "Error: %u bytes received, %u errors\n",
+            receive_context.index, receive_context.errors);
+    return(EXIT_FAILURE);
+  }
+}
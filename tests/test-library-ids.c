@@ -0,0 +1,231 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 2000
+#define STATIONS 3
+
+struct context_s
+{
+  unsigned int station;
+  unsigned int index;
+  unsigned int errors;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = payload_size;
+  unsigned int i;
+
+  if(ctx->index == DATA_SIZE)
+  {
+    return(-1);
+  }
+  if(ctx->index + size > DATA_SIZE)
+  {
+    size = DATA_SIZE - ctx->index;
+  }
+  for(i = 0; i < size; i++)
+  {
+    payload[i] = (ctx->index + i) * (ctx->station + 3);
+  }
+  ctx->index += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  for(i = 0; i < payload_size; i++)
+  {
+    if(payload[i] != (((ctx->index + i) * (ctx->station + 3)) & 255))
+    {
+      ctx->errors++;
+      break;
+    }
+  }
+  ctx->index += payload_size;
+
+  return(payload_size);
+}
+
+int main()
+{
+  ofdm_transfer_t transfer;
+  struct ofdm_transfer_config_s config;
+  struct context_s contexts[STATIONS];
+  struct ofdm_transfer_id_stats_s stats;
+  struct ofdm_transfer_stats_s transfer_stats;
+  char *ids[STATIONS] = { "st0", "st1", "st2" };
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned int n;
+  unsigned int i;
+  unsigned char skip;
+  int ok = 1;
+
+  fprintf(stderr, "Test: Receive the frames of several ids with one transfer\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.sample_rate = 500000;
+  config.minimum_payload_size = 200;
+  config.maximum_payload_size = 200;
+
+  /* Each station sends its data in turn on the same channel */
+  for(i = 0; i < STATIONS; i++)
+  {
+    bzero(&contexts[i], sizeof(struct context_s));
+    contexts[i].station = i;
+    config.emit = 1;
+    config.data_callback = read_data;
+    config.callback_context = &contexts[i];
+    config.id = ids[i];
+    transfer = ofdm_transfer_create_with_config(&config);
+    if(transfer == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize transfer\n");
+      return(EXIT_FAILURE);
+    }
+    ofdm_transfer_start(transfer);
+    ofdm_transfer_free(transfer);
+    fflush(stdout);
+  }
+
+  /* The first id is the one of the transfer, the second one is registered
+   * and the last one is received with the wildcard */
+  lseek(samples_fd, 0, SEEK_SET);
+  for(i = 0; i < STATIONS; i++)
+  {
+    bzero(&contexts[i], sizeof(struct context_s));
+    contexts[i].station = i;
+  }
+  config.emit = 0;
+  config.data_callback = write_data;
+  config.callback_context = &contexts[0];
+  config.id = ids[0];
+  transfer = ofdm_transfer_create_with_config(&config);
+  if((transfer == NULL) ||
+     (ofdm_transfer_add_id(transfer, ids[1], write_data, &contexts[1]) != 0) ||
+     (ofdm_transfer_add_id(transfer, "*", write_data, &contexts[2]) != 0))
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(transfer);
+
+  for(i = 0; i < STATIONS; i++)
+  {
+    fprintf(stderr, "Id '%s': %u bytes, %u errors\n",
+            ids[i], contexts[i].index, contexts[i].errors);
+    if((contexts[i].index != DATA_SIZE) || (contexts[i].errors != 0))
+    {
+      ok = 0;
+    }
+  }
+  for(n = 0; ofdm_transfer_get_id_stats(transfer, n, &stats) == 0; n++)
+  {
+    if((stats.bytes_received != DATA_SIZE) ||
+       ((strcmp(stats.id, ids[1]) != 0) && (strcmp(stats.id, ids[2]) != 0)))
+    {
+      ok = 0;
+    }
+  }
+  if(n != STATIONS - 1)
+  {
+    ok = 0;
+  }
+  ofdm_transfer_free(transfer);
+
+  /* Without the wildcard, the frames of the last id are ignored, and with
+   * the headers checked first their payload is not even demodulated */
+  for(skip = 0; skip < 2; skip++)
+  {
+    lseek(samples_fd, 0, SEEK_SET);
+    for(i = 0; i < STATIONS; i++)
+    {
+      bzero(&contexts[i], sizeof(struct context_s));
+      contexts[i].station = i;
+    }
+    config.skip_other_ids = skip;
+    transfer = ofdm_transfer_create_with_config(&config);
+    if((transfer == NULL) ||
+       (ofdm_transfer_add_id(transfer, ids[1], write_data, &contexts[1]) != 0))
+    {
+      fprintf(stderr, "Error: Failed to initialize transfer\n");
+      return(EXIT_FAILURE);
+    }
+    ofdm_transfer_start(transfer);
+    ofdm_transfer_get_stats(transfer, &transfer_stats);
+    ofdm_transfer_free(transfer);
+    fprintf(stderr,
+            "Skip %u: %lu frames (%lu bytes) ignored, %lu symbols skipped\n",
+            skip,
+            transfer_stats.frames_ignored,
+            transfer_stats.bytes_ignored,
+            transfer_stats.symbols_skipped);
+    if((contexts[0].index != DATA_SIZE) || (contexts[0].errors != 0) ||
+       (contexts[1].index != DATA_SIZE) || (contexts[1].errors != 0) ||
+       (contexts[2].index != 0) ||
+       (transfer_stats.bytes_ignored != DATA_SIZE) ||
+       (transfer_stats.payloads_corrupted != 0) ||
+       ((transfer_stats.symbols_skipped > 0) != skip))
+    {
+      ok = 0;
+    }
+  }
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
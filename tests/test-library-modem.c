@@ -0,0 +1,154 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <complex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofdm-modem.h"
+
+#define FRAMES 5
+#define MAX_SAMPLES 4000000
+
+struct context_s
+{
+  unsigned int frames;
+  unsigned int errors;
+};
+
+unsigned int payload_size(unsigned int index)
+{
+  return(10 + (index * 300));
+}
+
+void frame_found(void *context, struct ofdm_modem_frame_s *frame)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  if((!frame->header_valid) ||
+     (!frame->payload_valid) ||
+     (strcmp(frame->id, "test") != 0) ||
+     (frame->counter != ctx->frames) ||
+     (frame->payload_size != payload_size(ctx->frames)))
+  {
+    ctx->errors++;
+  }
+  else
+  {
+    for(i = 0; i < frame->payload_size; i++)
+    {
+      if(frame->payload[i] != ((ctx->frames + i) & 255))
+      {
+        ctx->errors++;
+        break;
+      }
+    }
+  }
+  ctx->frames++;
+}
+
+int main()
+{
+  struct ofdm_modem_config_s config;
+  struct context_s context;
+  ofdm_modem_t modulator;
+  ofdm_modem_t demodulator;
+  unsigned char payload[2000];
+  complex float *samples = malloc(MAX_SAMPLES * sizeof(complex float));
+  unsigned int block_size;
+  unsigned int n = 0;
+  unsigned int i;
+  unsigned int j;
+
+  fprintf(stderr, "Test: Modulate and demodulate frames without radio\n");
+
+  if(samples == NULL)
+  {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_modem_config_init_default(&config);
+  config.emit = 1;
+  config.frequency_offset = 200000;
+  config.id = "test";
+  modulator = ofdm_modem_create(&config);
+  if(modulator == NULL)
+  {
+    fprintf(stderr, "Error: Failed to create modulator\n");
+    return(EXIT_FAILURE);
+  }
+  block_size = ofdm_modem_get_block_size(modulator);
+
+  for(i = 0; i < FRAMES; i++)
+  {
+    for(j = 0; j < payload_size(i); j++)
+    {
+      payload[j] = i + j;
+    }
+    if(ofdm_modem_assemble(modulator, payload, payload_size(i)) != 0)
+    {
+      fprintf(stderr, "Error: Failed to assemble frame\n");
+      return(EXIT_FAILURE);
+    }
+    while(ofdm_modem_is_frame_open(modulator))
+    {
+      if(n + block_size > MAX_SAMPLES)
+      {
+        fprintf(stderr, "Error: Too many samples\n");
+        return(EXIT_FAILURE);
+      }
+      n += ofdm_modem_modulate(modulator, &samples[n]);
+    }
+  }
+  n += ofdm_modem_modulate_end(modulator, &samples[n]);
+  ofdm_modem_free(modulator);
+
+  bzero(&context, sizeof(context));
+  config.emit = 0;
+  config.frame_callback = frame_found;
+  config.callback_context = &context;
+  demodulator = ofdm_modem_create(&config);
+  if(demodulator == NULL)
+  {
+    fprintf(stderr, "Error: Failed to create demodulator\n");
+    return(EXIT_FAILURE);
+  }
+  /* Feed the samples by blocks of any size */
+  for(i = 0; i < n; i += j)
+  {
+    j = (n - i < 1000) ? n - i : 1000;
+    ofdm_modem_demodulate(demodulator, &samples[i], j);
+  }
+  ofdm_modem_demodulate_end(demodulator);
+  ofdm_modem_free(demodulator);
+  free(samples);
+
+  if((context.frames == FRAMES) && (context.errors == 0))
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    fprintf(stderr, "Error: %u frames received, %u errors\n",
+            context.frames, context.errors);
+    return(EXIT_FAILURE);
+  }
+}
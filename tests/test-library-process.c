@@ -0,0 +1,263 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define TRANSFERS 2
+
+struct context_s
+{
+  char *message;
+  unsigned int offset;
+  unsigned int chunk;
+  double next_chunk;
+  char decoded[256];
+  unsigned int decoded_size;
+};
+
+double get_time()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return(now.tv_sec + (now.tv_nsec / 1000000000.0));
+}
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int size = strlen(ctx->message) - ctx->offset;
+
+  if(size == 0)
+  {
+    return(-1);
+  }
+  if(ctx->chunk > 0)
+  {
+    /* Trickle the message, a chunk every 20 ms */
+    if(get_time() < ctx->next_chunk)
+    {
+      return(0);
+    }
+    ctx->next_chunk = get_time() + 0.02;
+    if(size > ctx->chunk)
+    {
+      size = ctx->chunk;
+    }
+  }
+  if(size > payload_size)
+  {
+    size = payload_size;
+  }
+  memcpy(payload, ctx->message + ctx->offset, size);
+  ctx->offset += size;
+
+  return(size);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+
+  if(ctx->decoded_size + payload_size < sizeof(ctx->decoded))
+  {
+    memcpy(ctx->decoded + ctx->decoded_size, payload, payload_size);
+    ctx->decoded_size += payload_size;
+  }
+
+  return(payload_size);
+}
+
+/* Drive all the transfers from the same loop, one step at a time */
+int run(ofdm_transfer_t *transfers, double *longest_step)
+{
+  unsigned char running[TRANSFERS];
+  unsigned int active = TRANSFERS;
+  unsigned int i;
+  double start;
+  int r;
+
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    if((ofdm_transfer_get_fd(transfers[i]) < 0) ||
+       (ofdm_transfer_begin(transfers[i]) != 0))
+    {
+      return(-1);
+    }
+    running[i] = 1;
+  }
+  *longest_step = 0;
+  while(active > 0)
+  {
+    for(i = 0; i < TRANSFERS; i++)
+    {
+      if(!running[i])
+      {
+        continue;
+      }
+      start = get_time();
+      r = ofdm_transfer_process(transfers[i]);
+      if(get_time() - start > *longest_step)
+      {
+        *longest_step = get_time() - start;
+      }
+      if(r <= 0)
+      {
+        ofdm_transfer_end(transfers[i]);
+        running[i] = 0;
+        active--;
+      }
+    }
+  }
+
+  return(0);
+}
+
+int main()
+{
+  ofdm_transfer_t transfers[TRANSFERS];
+  struct context_s contexts[TRANSFERS];
+  char *messages[TRANSFERS] = {
+    "This is a test transmission using ofdm-transfer.",
+    "This is another transmission driven by the same loop."
+  };
+  char samples_files[TRANSFERS][32];
+  char radios[TRANSFERS][40];
+  struct ofdm_transfer_config_s config;
+  unsigned int i;
+  double longest_step;
+  int ok = 1;
+
+  fprintf(stderr, "Test: Drive several transfers from one loop\n");
+
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    strcpy(samples_files[i], "/tmp/samples.XXXXXX");
+    if(mkstemp(samples_files[i]) == -1)
+    {
+      fprintf(stderr, "Error: Failed to create temporary files\n");
+      return(EXIT_FAILURE);
+    }
+    sprintf(radios[i], "file=%s", samples_files[i]);
+  }
+  ofdm_transfer_config_init_default(&config);
+
+  bzero(contexts, sizeof(contexts));
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    contexts[i].message = messages[i];
+    config.radio_driver = radios[i];
+    config.emit = 1;
+    config.data_callback = read_data;
+    config.callback_context = &contexts[i];
+    transfers[i] = ofdm_transfer_create_with_config(&config);
+    if(transfers[i] == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize transfer\n");
+      return(EXIT_FAILURE);
+    }
+  }
+  /* The second transfer gathers the trickled message in one frame, without
+   * waiting for the data inside the steps */
+  contexts[1].chunk = 5;
+  ofdm_transfer_set_coalescing(transfers[1], 2000);
+  if(run(transfers, &longest_step) != 0)
+  {
+    fprintf(stderr, "Error: Failed to start transfers\n");
+    return(EXIT_FAILURE);
+  }
+  if(longest_step >= 0.1)
+  {
+    fprintf(stderr, "Error: A step lasted %f s\n", longest_step);
+    ok = 0;
+  }
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    ofdm_transfer_free(transfers[i]);
+  }
+
+  bzero(contexts, sizeof(contexts));
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    config.radio_driver = radios[i];
+    config.emit = 0;
+    config.data_callback = write_data;
+    config.callback_context = &contexts[i];
+    transfers[i] = ofdm_transfer_create_with_config(&config);
+    if(transfers[i] == NULL)
+    {
+      fprintf(stderr, "Error: Failed to initialize transfer\n");
+      return(EXIT_FAILURE);
+    }
+  }
+  if(run(transfers, &longest_step) != 0)
+  {
+    fprintf(stderr, "Error: Failed to start transfers\n");
+    return(EXIT_FAILURE);
+  }
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    ofdm_transfer_free(transfers[i]);
+    if((contexts[i].decoded_size != strlen(messages[i])) ||
+       (memcmp(contexts[i].decoded, messages[i], strlen(messages[i])) != 0))
+    {
+      fprintf(stderr, "Error: Transfer %u decoded %u bytes\n",
+              i, contexts[i].decoded_size);
+      ok = 0;
+    }
+  }
+
+  /* A stopped transfer has nothing more to do */
+  bzero(contexts, sizeof(contexts));
+  config.radio_driver = radios[0];
+  config.callback_context = &contexts[0];
+  transfers[0] = ofdm_transfer_create_with_config(&config);
+  if((transfers[0] == NULL) || (ofdm_transfer_begin(transfers[0]) != 0))
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_stop(transfers[0]);
+  if(ofdm_transfer_process(transfers[0]) != 0)
+  {
+    fprintf(stderr, "Error: Stopped transfer still running\n");
+    ok = 0;
+  }
+  ofdm_transfer_end(transfers[0]);
+  ofdm_transfer_free(transfers[0]);
+
+  for(i = 0; i < TRANSFERS; i++)
+  {
+    unlink(samples_files[i]);
+  }
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
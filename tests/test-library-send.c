@@ -0,0 +1,151 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define DATA_SIZE 20000
+#define QUEUE_SIZE 1000
+
+unsigned char data[DATA_SIZE];
+unsigned char decoded[DATA_SIZE];
+unsigned int decoded_size = 0;
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  if(decoded_size + payload_size <= DATA_SIZE)
+  {
+    memcpy(&decoded[decoded_size], payload, payload_size);
+  }
+  decoded_size += payload_size;
+
+  return(payload_size);
+}
+
+/* Push the data in small pieces, waiting when the queue is full */
+void * producer(void *arg)
+{
+  ofdm_transfer_t transfer = (ofdm_transfer_t) arg;
+  unsigned int n = 0;
+  int r;
+
+  while(n < DATA_SIZE)
+  {
+    r = ofdm_transfer_send(transfer, &data[n], ((DATA_SIZE - n < 300) ? DATA_SIZE - n : 300), -1);
+    if(r < 0)
+    {
+      break;
+    }
+    n += r;
+  }
+  ofdm_transfer_send_finish(transfer);
+
+  return(NULL);
+}
+
+int main()
+{
+  struct ofdm_transfer_config_s config;
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  pthread_t producer_thread;
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned int i;
+  int ok = 1;
+
+  fprintf(stderr, "Test: Send data queued by another thread\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+  close(samples_fd);
+  for(i = 0; i < DATA_SIZE; i++)
+  {
+    data[i] = (i * 7) + (i >> 8);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = malloc(strlen(samples_file) + 6);
+  sprintf(config.radio_driver, "file=%s", samples_file);
+  config.emit = 1;
+  config.send_queue_size = QUEUE_SIZE;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* The queue is full and nobody sends it */
+  if((ofdm_transfer_send(send, data, QUEUE_SIZE, 0) != QUEUE_SIZE) ||
+     (ofdm_transfer_send(send, data, 1, 0) != -1) ||
+     (ofdm_transfer_send(send, data, 1, 10) != -1) ||
+     (ofdm_transfer_get_send_queue_depth(send) != QUEUE_SIZE))
+  {
+    fprintf(stderr, "Error: Full queue accepted more data\n");
+    ok = 0;
+  }
+  ofdm_transfer_set_send_queue(send, QUEUE_SIZE);
+
+  if(pthread_create(&producer_thread, NULL, producer, send) != 0)
+  {
+    fprintf(stderr, "Error: Failed to start producer thread\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  pthread_join(producer_thread, NULL);
+  ofdm_transfer_free(send);
+
+  config.emit = 0;
+  config.send_queue_size = 0;
+  config.data_callback = write_data;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_free(receive);
+  free(config.radio_driver);
+  unlink(samples_file);
+
+  if((decoded_size != DATA_SIZE) || (memcmp(data, decoded, DATA_SIZE) != 0))
+  {
+    fprintf(stderr, "Error: %u bytes decoded instead of %u\n",
+            decoded_size, DATA_SIZE);
+    ok = 0;
+  }
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,235 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define PAYLOAD_SIZE 200
+#define FRAMES 30
+#define PARTS 3
+#define GAP 20
+#define GAP_SIZE 16384
+
+struct context_s
+{
+  unsigned int index;
+  unsigned int frames;
+  unsigned int gap;
+  int last;
+  unsigned int errors;
+};
+
+int read_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+
+  if(ctx->index == FRAMES)
+  {
+    return(-1);
+  }
+  if((ctx->index > 0) && (ctx->index % (FRAMES / PARTS) == 0) &&
+     (ctx->gap < GAP))
+  {
+    /* Leave some silence between the parts of the transfer */
+    ctx->gap++;
+    return(0);
+  }
+  ctx->gap = 0;
+  /* Each frame is filled with its number */
+  memset(payload, ctx->index, PAYLOAD_SIZE);
+  ctx->index++;
+
+  return(PAYLOAD_SIZE);
+}
+
+int write_data(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct context_s *ctx = (struct context_s *) context;
+  unsigned int i;
+
+  if((payload_size != PAYLOAD_SIZE) || (payload[0] <= ctx->last))
+  {
+    /* Frame received twice or out of order */
+    ctx->errors++;
+  }
+  for(i = 1; i < payload_size; i++)
+  {
+    if(payload[i] != payload[0])
+    {
+      ctx->errors++;
+      break;
+    }
+  }
+  ctx->last = payload[0];
+  ctx->frames++;
+
+  return(payload_size);
+}
+
+/* Find the middle of the first silence after 'start' */
+off_t find_gap(unsigned char *samples, off_t start, off_t size)
+{
+  off_t begin = start;
+  off_t i;
+
+  for(i = start; i < size; i++)
+  {
+    if(samples[i] != 0)
+    {
+      begin = i + 1;
+    }
+    else if(i + 1 - begin >= GAP_SIZE)
+    {
+      return((begin + (GAP_SIZE / 2)) & ~7);
+    }
+  }
+
+  return(0);
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct ofdm_transfer_config_s config;
+  struct context_s context;
+  struct ofdm_transfer_stats_s stats;
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned char *samples;
+  off_t size;
+  off_t cut1;
+  off_t cut2;
+  int ok = 0;
+
+  fprintf(stderr, "Test: Put the frames back in order and drop duplicates\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.callback_context = &context;
+  config.sample_rate = 500000;
+  config.minimum_payload_size = PAYLOAD_SIZE;
+  config.maximum_payload_size = PAYLOAD_SIZE;
+  config.drop_duplicates = 1;
+
+  bzero(&context, sizeof(context));
+  config.emit = 1;
+  config.data_callback = read_data;
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_free(send);
+  fflush(stdout);
+
+  /* Swap the second and third parts of the samples so that some frames
+   * arrive late, then repeat all the samples to receive every frame twice */
+  size = lseek(samples_fd, 0, SEEK_END);
+  samples = malloc(size);
+  if(samples == NULL)
+  {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return(EXIT_FAILURE);
+  }
+  if(pread(samples_fd, samples, size, 0) != size)
+  {
+    fprintf(stderr, "Error: Failed to read samples\n");
+    return(EXIT_FAILURE);
+  }
+  cut1 = find_gap(samples, 0, size);
+  cut2 = find_gap(samples, cut1 + GAP_SIZE, size);
+  if((cut1 == 0) || (cut2 == 0))
+  {
+    fprintf(stderr, "Error: Silence between the parts not found\n");
+    return(EXIT_FAILURE);
+  }
+  if((pwrite(samples_fd, samples + cut2, size - cut2, cut1) != size - cut2) ||
+     (pwrite(samples_fd,
+             samples + cut1,
+             cut2 - cut1,
+             cut1 + size - cut2) != cut2 - cut1) ||
+     (pwrite(samples_fd, samples, size, size) != size))
+  {
+    fprintf(stderr, "Error: Failed to write samples\n");
+    return(EXIT_FAILURE);
+  }
+  free(samples);
+
+  lseek(samples_fd, 0, SEEK_SET);
+  bzero(&context, sizeof(context));
+  context.last = -1;
+  config.emit = 0;
+  config.data_callback = write_data;
+  config.reorder_frames = 2 * FRAMES;
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_get_stats(receive, &stats);
+  ofdm_transfer_free(receive);
+
+  fprintf(stderr,
+          "%u frames delivered, %lu lost, %lu duplicates, %lu out of order\n",
+          context.frames,
+          stats.frames_lost,
+          stats.frames_duplicated,
+          stats.frames_reordered);
+  ok = (context.errors == 0) &&
+    (context.frames > FRAMES / 2) &&
+    (stats.frames_duplicated > FRAMES / 2) &&
+    (stats.frames_reordered > 0);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
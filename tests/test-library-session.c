@@ -0,0 +1,160 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define ROUNDS 3
+
+struct message_s
+{
+  unsigned char *data;
+  unsigned int size;
+  unsigned int done;
+};
+
+int read_message(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct message_s *message = (struct message_s *) context;
+  unsigned int size = message->size - message->done;
+
+  if(size == 0)
+  {
+    return(-1);
+  }
+  size = (payload_size < size) ? payload_size : size;
+  memcpy(payload, &message->data[message->done], size);
+  message->done += size;
+  return(size);
+}
+
+int write_message(void *context, unsigned char *payload, unsigned int payload_size)
+{
+  struct message_s *message = (struct message_s *) context;
+  unsigned int size = message->size - message->done;
+
+  size = (payload_size < size) ? payload_size : size;
+  memcpy(&message->data[message->done], payload, size);
+  message->done += size;
+  return(payload_size);
+}
+
+int main()
+{
+  ofdm_transfer_t transfer;
+  struct message_s message;
+  unsigned char data[1000];
+  unsigned char buffer[1000];
+  char radio[64];
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  unsigned int round;
+  unsigned int i;
+  int ok = 1;
+
+  fprintf(stderr, "Test: Send and receive messages with the same transfer\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+  close(samples_fd);
+  snprintf(radio, sizeof(radio), "file=%s", samples_file);
+
+  transfer = ofdm_transfer_create_callback(radio,
+                                           1,
+                                           read_message,
+                                           NULL,
+                                           2000000,
+                                           9600,
+                                           434000000,
+                                           0,
+                                           "0",
+                                           0,
+                                           "qpsk",
+                                           64,
+                                           16,
+                                           4,
+                                           "h128",
+                                           "none",
+                                           "",
+                                           NULL,
+                                           0,
+                                           0);
+  if(transfer == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+
+  for(round = 0; (round < ROUNDS) && ok; round++)
+  {
+    for(i = 0; i < sizeof(data); i++)
+    {
+      data[i] = (round * 31) + i;
+    }
+
+    message.data = data;
+    message.size = sizeof(data);
+    message.done = 0;
+    if(ofdm_transfer_set_direction(transfer, 1, read_message, &message, "0") != 0)
+    {
+      fprintf(stderr, "Error: Failed to switch to transmit mode\n");
+      ok = 0;
+      break;
+    }
+    ofdm_transfer_start(transfer);
+
+    bzero(buffer, sizeof(buffer));
+    message.data = buffer;
+    message.size = sizeof(buffer);
+    message.done = 0;
+    if(ofdm_transfer_set_direction(transfer, 0, write_message, &message, "0") != 0)
+    {
+      fprintf(stderr, "Error: Failed to switch to receive mode\n");
+      ok = 0;
+      break;
+    }
+    ofdm_transfer_start(transfer);
+
+    if((message.done != sizeof(data)) ||
+       (memcmp(data, buffer, sizeof(data)) != 0))
+    {
+      fprintf(stderr, "Error: Round %u: message not received\n", round);
+      ok = 0;
+    }
+  }
+
+  ofdm_transfer_free(transfer);
+  unlink(samples_file);
+
+  if(ok)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
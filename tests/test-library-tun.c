@@ -0,0 +1,180 @@
+/*
+This file is part of ofdm-transfer, a program to send or receive data
+by software defined radio using the OFDM modulation.
+
+Copyright 2021-2022 Guillaume LE VAILLANT
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ofdm-transfer.h"
+
+#define PACKETS 20
+#define MTU 1280
+
+/* A packet socket pair stands in for the TUN interface, as creating a real
+ * one requires privileges */
+
+/* Mix small packets with packets of the size of the MTU */
+unsigned int packet_size(unsigned int index)
+{
+  if(index % 5 == 4)
+  {
+    return(MTU);
+  }
+  return(20 + ((index * 97) % 200));
+}
+
+int main()
+{
+  ofdm_transfer_t send;
+  ofdm_transfer_t receive;
+  struct ofdm_transfer_config_s config;
+  struct ofdm_transfer_stats_s stats;
+  unsigned char packet[MTU + 1];
+  char samples_file[] = "/tmp/samples.XXXXXX";
+  int samples_fd = mkstemp(samples_file);
+  int fds[2];
+  unsigned int i;
+  unsigned int j;
+  int n;
+  int errors = 0;
+
+  fprintf(stderr, "Test: Send and receive the packets of a network interface\n");
+
+  if(samples_fd == -1)
+  {
+    fprintf(stderr, "Error: Failed to create temporary file\n");
+    return(EXIT_FAILURE);
+  }
+
+  if(dup2(samples_fd, STDIN_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard input\n");
+    return(EXIT_FAILURE);
+  }
+  if(dup2(samples_fd, STDOUT_FILENO) == -1)
+  {
+    fprintf(stderr, "Error: Failed to redirect standard output\n");
+    return(EXIT_FAILURE);
+  }
+
+  /* Queue the packets, then close the sending side so that the transfer
+   * finishes when they have been sent */
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+  {
+    fprintf(stderr, "Error: Failed to create sockets\n");
+    return(EXIT_FAILURE);
+  }
+  for(i = 0; i < PACKETS; i++)
+  {
+    for(j = 0; j < packet_size(i); j++)
+    {
+      packet[j] = i + j;
+    }
+    write(fds[0], packet, packet_size(i));
+  }
+  close(fds[0]);
+
+  ofdm_transfer_config_init_default(&config);
+  config.radio_driver = "io";
+  config.bit_rate = 9600;
+  config.maximum_payload_size = 4000;
+  config.tun_mtu = MTU;
+
+  config.emit = 1;
+  config.tun_fd = fds[1];
+  send = ofdm_transfer_create_with_config(&config);
+  if(send == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(send);
+  ofdm_transfer_get_stats(send, &stats);
+  ofdm_transfer_free(send);
+  close(fds[1]);
+  fflush(stdout);
+
+  if(stats.messages_sent != PACKETS)
+  {
+    fprintf(stderr, "Error: %lu packets sent instead of %u\n",
+            stats.messages_sent, PACKETS);
+    return(EXIT_FAILURE);
+  }
+  /* The frames must be large enough for the packets of the size of the MTU,
+   * and small packets must have been packed together */
+  if(stats.frames_sent >= PACKETS)
+  {
+    fprintf(stderr, "Error: %lu frames sent for %u packets\n",
+            stats.frames_sent, PACKETS);
+    return(EXIT_FAILURE);
+  }
+
+  lseek(samples_fd, 0, SEEK_SET);
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+  {
+    fprintf(stderr, "Error: Failed to create sockets\n");
+    return(EXIT_FAILURE);
+  }
+  config.emit = 0;
+  config.tun_fd = fds[1];
+  receive = ofdm_transfer_create_with_config(&config);
+  if(receive == NULL)
+  {
+    fprintf(stderr, "Error: Failed to initialize transfer\n");
+    return(EXIT_FAILURE);
+  }
+  ofdm_transfer_start(receive);
+  ofdm_transfer_free(receive);
+  close(fds[1]);
+
+  /* Each message must have been given back as one packet */
+  for(i = 0; i < PACKETS; i++)
+  {
+    n = recv(fds[0], packet, sizeof(packet), MSG_DONTWAIT);
+    if(n != (int) packet_size(i))
+    {
+      fprintf(stderr, "Error: Packet %u has %d bytes instead of %u\n",
+              i, n, packet_size(i));
+      errors++;
+      break;
+    }
+    for(j = 0; j < packet_size(i); j++)
+    {
+      if(packet[j] != ((i + j) & 255))
+      {
+        errors++;
+        break;
+      }
+    }
+  }
+  close(fds[0]);
+  close(samples_fd);
+  unlink(samples_file);
+
+  if(errors == 0)
+  {
+    return(EXIT_SUCCESS);
+  }
+  else
+  {
+    return(EXIT_FAILURE);
+  }
+}
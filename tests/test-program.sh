@@ -51,6 +51,37 @@ check_ok_file()
     diff -q ${MESSAGE} ${DECODED} > /dev/null
 }
 
+check_ok_pipe()
+{
+    NAME=$1
+    OPTIONS1=$2
+    OPTIONS2=$3
+
+    echo "Test: ${NAME}"
+    ${OFDM_TRANSFER} -t -r io ${OPTIONS1} ${MESSAGE} > ${SAMPLES}
+    ${OFDM_TRANSFER} -r io ${OPTIONS2} < ${SAMPLES} | cat > ${DECODED}
+    diff -q ${MESSAGE} ${DECODED} > /dev/null
+}
+
+# The message is sent several times with some silence between the
+# transmissions, the receiver must get at least one of them
+check_ok_scan()
+{
+    NAME=$1
+    OPTIONS1=$2
+    OPTIONS2=$3
+
+    echo "Test: ${NAME}"
+    : > ${SAMPLES}
+    for i in 1 2 3 4 5 6
+    do
+        head -c 800000 /dev/zero >> ${SAMPLES}
+        ${OFDM_TRANSFER} -t -r io ${OPTIONS1} ${MESSAGE} >> ${SAMPLES}
+    done
+    ${OFDM_TRANSFER} -r io ${OPTIONS2} ${DECODED} < ${SAMPLES}
+    grep -q -F -f ${MESSAGE} ${DECODED}
+}
+
 check_nok_io()
 {
     NAME=$1
@@ -93,6 +124,20 @@ check_nok_io "Wrong subcarrier number 64 128" "-n 64" "-n 128"
 check_ok_io "FEC Hamming(7/4)" "-e h74" "-e h74"
 check_ok_file "FEC Golay(24/12) and repeat(3)" "-e g2412,rep3" "-e g2412,rep3"
 check_ok_io "Id a1B2" "-i a1B2" "-i a1B2"
+check_ok_io "Latency 5" "-l 5" "-l 5"
+check_ok_file "Throughput mode" "-l 0" "-l 0"
+check_ok_io "Latency 20 and throughput mode" "-l 20" "-l 0"
+check_ok_io "Payload size 100" "-p 100" ""
+check_ok_file "Payload size 1000,20000 in throughput mode" "-l 0 -p 1000,20000" ""
+check_ok_io "Coalescing 50" "-C 50" ""
+check_ok_file "Delivery queue 4096" "" "-q 4096"
+check_ok_pipe "Output to a pipe" "" ""
+check_ok_pipe "Output spliced to a pipe" "" "-Z"
+check_ok_io "Frequency hopping" "-p 16 -H 1:+0,+200000,-300000" "-p 16 -H 1:+0,+200000,-300000"
+check_ok_file "Frequency hopping, dwell 2" "-p 16 -H 2:434000000,433700000" "-p 16 -H 2:434000000,433700000"
+check_nok_io "Frequency hopping, receiver not hopping" "-p 16 -H 1:+0,+200000" "-p 16"
+check_ok_scan "Scanning" "-f 434200000 -o 200000" "-S 30:434000000,433800000,434200000"
+check_ok_scan "Scanning offsets" "-p 16 -f 433700000 -o 100000" "-f 433700000 -o 100000 -S 20,100:+300000,+0"
 check_nok_file "Wrong id ABCD ABC" "-i ABCD" "-i ABC"
 check_ok_file "Audio frequency 1500" \
               "-a -s 48000 -f 1500 -b 1200" \